@@ -150,6 +150,47 @@ typedef enum QzDirection_E {
     /**< Session will be used for both compression and decompression */
 } QzDirection_T;
 
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Compressed data format
+ *
+ * @description
+ *      This enumerated list identifies the framing of the compressed
+ *    data produced by QATZip.
+ *
+ *****************************************************************************/
+typedef enum QzDataFormat_E {
+    QZ_DEFLATE_GZIP_EXT = 0,
+    /**< One gzip member with QZ extra field per hw_buff_sz chunk */
+    QZ_DEFLATE_GZIP,
+    /**< One standard gzip member per stream, closed by last == 1 */
+    QZ_DEFLATE_RAW,
+    /**< Raw deflate stream (RFC1951), closed by last == 1 */
+    QZ_DEFLATE_ZLIB
+    /**< Zlib stream (RFC1950) with Adler-32, closed by last == 1 */
+} QzDataFormat_T;
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Session priority
+ *
+ * @description
+ *      This enumerated list identifies the scheduling class of a session
+ *    when requests compete for QAT instances.
+ *
+ *****************************************************************************/
+typedef enum QzPriority_E {
+    QZ_PRIORITY_BULK = 0,
+    /**< Background work, kept off the reserved instance and compressed */
+    /**< in slices that let other requests in between */
+    QZ_PRIORITY_NORMAL,
+    /**< Default priority */
+    QZ_PRIORITY_HIGH
+    /**< Latency critical work, served first by the instance wait queue */
+} QzPriority_T;
+
 /**
  *****************************************************************************
  * @ingroup qatZip
@@ -174,6 +215,8 @@ typedef enum QzDirection_E {
 /**<Insufficient buffer error */
 #define QZ_DATA_ERROR           (-4)
 /**<Input data was corrupted */
+#define QZ_TIMEOUT              (-5)
+/**<Deadline reached before all input was processed */
 #define QZ_NO_HW                (11)
 /**<using SW: No QAT HW detected */
 #define QZ_NO_MDRV              (12)
@@ -224,6 +267,7 @@ typedef struct QzSessionParams_S {
     unsigned int  max_forks;
     /**<maximum forks permitted in the current thread.  */
     /**<0 means no forking permitted */
+    /**<children past it run on sw, or fail without sw_backup */
     unsigned char sw_backup;
     /**<0 means no sw backup, 1 means sw backup */
     unsigned int hw_buff_sz;
@@ -235,7 +279,47 @@ typedef struct QzSessionParams_S {
     /**<than the threshold, QATzip will route the request */
     /**<to software */
     unsigned int req_cnt_thrshold;
-    /**set between 1 and 4, default 4*/
+    /**<requests up to which a call submits all of them before */
+    /**<collecting the results on the calling thread, more are */
+    /**<submitted from a second thread, set between 1 and buff_cnt, */
+    /**<default 4 */
+    unsigned int par_decomp_thrshold;
+    /**<minimum input size of a single member standard gzip stream */
+    /**<to be decompressed by speculative parallel software inflate, */
+    /**<0 means disabled */
+    QzDataFormat_T data_fmt;
+    /**<framing of the compressed data */
+    unsigned char index_trailer;
+    /**<1 appends a seek index when last == 1 closes a */
+    /**<QZ_DEFLATE_GZIP_EXT stream, the index needs about 8 bytes */
+    /**<of extra output space per member */
+    unsigned char store_incompressible;
+    /**<1 writes chunks sampled as incompressible as stored blocks */
+    /**<without sending them to the accelerator, 0 compresses all */
+    unsigned int cache_sz;
+    /**<bytes kept by the QZ_DEFLATE_GZIP_EXT compressed chunk cache, */
+    /**<repeated chunks reuse their cached output, 0 means disabled */
+    unsigned char rsyncable;
+    /**<1 ends QZ_DEFLATE_GZIP_EXT chunks at content defined boundaries, */
+    /**<between hw_buff_sz / 4 and hw_buff_sz apart, so that unchanged */
+    /**<data keeps producing identical members */
+    unsigned int wait_timeout;
+    /**<usec a request waits in FIFO order for a busy instance before */
+    /**<falling back to software, 0 falls back at once */
+    QzPriority_T priority;
+    /**<scheduling class of the session */
+    unsigned char service;
+    /**<1 sends the requests of the session to a running qzipd instead */
+    /**<of the QAT instances of the process, set in the defaults before */
+    /**<qzInit to keep the process off the devices altogether */
+    unsigned int buff_cnt;
+    /**<request buffers of an instance, the requests it can have in */
+    /**<flight, an instance keeps the count of the session that sets */
+    /**<it up first */
+    unsigned char adaptive_chunk;
+    /**<1 picks the chunk size of each call between 16K and hw_buff_sz */
+    /**<from its input size, the ratio so far and the device load, */
+    /**<0 always cuts hw_buff_sz chunks */
 } QzSessionParams_T;
 
 #define QZ_HUFF_HDR_DEFAULT          QZ_DYNAMIC_HDR
@@ -251,8 +335,24 @@ typedef struct QzSessionParams_S {
 #define QZ_COMP_THRESHOLD_DEFAULT    1024
 #define QZ_COMP_THRESHOLD_MINIMUM    128
 #define QZ_REQ_THRESHOLD_MINIMUM     1
-#define QZ_REQ_THRESHOLD_MAXINUM     4
+#define QZ_REQ_THRESHOLD_MAXINUM     QZ_BUFF_CNT_MAX
 #define QZ_REQ_THRESHOLD_DEFAULT     4
+#define QZ_PAR_DECOMP_THRESHOLD_DEFAULT  0
+#define QZ_PAR_DECOMP_THRESHOLD_MINIMUM  (2*1024*1024)
+#define QZ_DATA_FORMAT_DEFAULT       QZ_DEFLATE_GZIP_EXT
+#define QZ_INDEX_TRAILER_DEFAULT     0
+#define QZ_STORE_INCOMPRESSIBLE_DEFAULT  1
+#define QZ_CACHE_SZ_DEFAULT          0
+#define QZ_CACHE_SZ_MAX              (1024*1024*1024)
+#define QZ_RSYNCABLE_DEFAULT         0
+#define QZ_WAIT_TIMEOUT_DEFAULT      0
+#define QZ_WAIT_TIMEOUT_MAX          1000000
+#define QZ_PRIORITY_DEFAULT          QZ_PRIORITY_NORMAL
+#define QZ_SERVICE_DEFAULT           0
+#define QZ_BUFF_CNT_DEFAULT          32
+#define QZ_BUFF_CNT_MIN              1
+#define QZ_BUFF_CNT_MAX              512
+#define QZ_ADAPTIVE_CHUNK_DEFAULT    0
 /**
  *****************************************************************************
  * @ingroup qatZip
@@ -309,6 +409,220 @@ typedef struct QzStatus_S {
     /**<count of hw devices supporting algorithms */
 } QzStatus_T;
 
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Why a call was served by software
+ *
+ *****************************************************************************/
+typedef enum QzFallback_E {
+    QZ_FALLBACK_SMALL = 0,
+    /**<input under input_sz_thrshold */
+    QZ_FALLBACK_NO_HW,
+    /**<no hardware, or it is not started yet */
+    QZ_FALLBACK_UNSUPPORTED,
+    /**<level 9, a preset dictionary or data the hardware does not take */
+    QZ_FALLBACK_BUSY,
+    /**<no instance free */
+    QZ_FALLBACK_SETUP,
+    /**<setting up the instance failed */
+    QZ_FALLBACK_FAULT,
+    /**<the instance failed the request */
+    QZ_FALLBACK_MAX
+} QzFallback_T;
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      QATzip statistics of an instance
+ *
+ *****************************************************************************/
+typedef struct QzInstanceStats_S {
+    unsigned long calls;
+    /**<compress and decompress calls served */
+    unsigned long bytes_in;
+    unsigned long bytes_out;
+    unsigned long retries;
+    /**<submits the instance asked to retry */
+    unsigned int slots;
+    /**<request buffers, 0 before the instance is set up */
+    unsigned int slots_busy;
+    /**<request buffers in use */
+    unsigned long pinned_sz;
+    /**<bytes of pinned memory */
+} QzInstanceStats_T;
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      QATzip statistics of the process
+ *
+ *****************************************************************************/
+typedef struct QzStats_S {
+    unsigned long hw_calls;
+    unsigned long hw_bytes_in;
+    unsigned long hw_bytes_out;
+    unsigned long sw_calls;
+    unsigned long sw_bytes_in;
+    unsigned long sw_bytes_out;
+    unsigned long fallback[QZ_FALLBACK_MAX];
+    /**<software calls, and members of hardware calls, by reason */
+    unsigned long par_members;
+    /**<standard gzip members inflated by the parallel software path */
+    unsigned long pinned_sz;
+    /**<bytes of pinned memory of all instances */
+    unsigned int num_instances;
+} QzStats_T;
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      QATzip statistics of one thread
+ *
+ *****************************************************************************/
+typedef struct QzThreadStats_S {
+    unsigned long thread_id;
+    /**<pthread_self() of the thread, 0 for the threads that exited */
+    unsigned long comp_hw_calls;
+    unsigned long comp_sw_calls;
+    unsigned long decomp_hw_calls;
+    unsigned long decomp_sw_calls;
+    unsigned long hw_bytes_in;
+    unsigned long hw_bytes_out;
+    unsigned long sw_bytes_in;
+    unsigned long sw_bytes_out;
+    unsigned long hw_nsec;
+    /**<time spent in calls served by hardware */
+    unsigned long sw_nsec;
+    /**<time spent in calls served by software */
+} QzThreadStats_T;
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Operations with a latency histogram
+ *
+ *****************************************************************************/
+typedef enum QzLatOp_E {
+    QZ_LAT_COMP_HW = 0,
+    QZ_LAT_COMP_SW,
+    QZ_LAT_DECOMP_HW,
+    QZ_LAT_DECOMP_SW,
+    QZ_LAT_OP_MAX
+} QzLatOp_T;
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Input size classes of the latency histograms
+ *
+ *****************************************************************************/
+typedef enum QzLatSize_E {
+    QZ_LAT_SZ_4K = 0,
+    /**<under 4KB */
+    QZ_LAT_SZ_64K,
+    /**<4KB up to 64KB */
+    QZ_LAT_SZ_1M,
+    /**<64KB up to 1MB */
+    QZ_LAT_SZ_LARGE,
+    /**<1MB and more */
+    QZ_LAT_SZ_MAX
+    /**<all sizes, as an argument of qzGetLatency */
+} QzLatSize_T;
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Latency percentiles of an operation, in nanoseconds
+ *
+ *****************************************************************************/
+typedef struct QzLatency_S {
+    unsigned long count;
+    /**<calls recorded since the last reset */
+    unsigned long p50;
+    unsigned long p99;
+    unsigned long p999;
+    unsigned long max;
+} QzLatency_T;
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      QATZIP compressed chunk cache statistics
+ *
+ * @description
+ *      This structure reports the state of the compressed chunk cache of a
+ *      session, see qzGetCacheStats.
+ *
+ *****************************************************************************/
+typedef struct QzCacheStats_S {
+    unsigned long hits;
+    /**<chunks whose output was taken from the cache */
+    unsigned long misses;
+    /**<chunks looked up and not found */
+    unsigned long entries;
+    /**<chunks held by the cache */
+    unsigned long bytes;
+    /**<memory held by the cache, at most cache_sz */
+} QzCacheStats_T;
+
+#define QZ_WAIT_HIST_SZ    24
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      QATZIP instance wait statistics
+ *
+ * @description
+ *      This structure reports the waits of requests that found every
+ *    instance busy, see the wait_timeout session parameter. hist[0] counts
+ *    waits below 1 usec, hist[k] those from 2^(k-1) to 2^k usec and the
+ *    last entry every longer wait.
+ *
+ *****************************************************************************/
+typedef struct QzWaitStats_S {
+    unsigned long waits;
+    /**<requests that waited for an instance */
+    unsigned long timeouts;
+    /**<waits that ended without an instance */
+    unsigned long total_us;
+    /**<sum of all waits in usec */
+    unsigned long max_us;
+    /**<longest wait in usec */
+    unsigned long hist[QZ_WAIT_HIST_SZ];
+    /**<waits by duration */
+} QzWaitStats_T;
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      QATZIP instance health
+ *
+ * @description
+ *      This structure reports the health of a QAT instance. An instance
+ *    whose requests fail, keep the submit retrying or take far longer than
+ *    those of the other instances is quarantined, requests go to the other
+ *    instances while a probe request is sent to it from time to time. A
+ *    successful probe returns the instance to service.
+ *
+ *****************************************************************************/
+typedef struct QzInstanceHealth_S {
+    unsigned long requests;
+    /**<requests served by the instance */
+    unsigned long errors;
+    /**<requests that failed */
+    unsigned long retries;
+    /**<submits the instance asked to retry */
+    unsigned long avg_us;
+    /**<moving average latency per request buffer in usec */
+    unsigned long quarantines;
+    /**<times the instance was quarantined */
+    unsigned char quarantined;
+    /**<1 while the instance is out of service */
+    long heartbeat;
+    /**<time of the last successful request, 0 for none */
+} QzInstanceHealth_T;
+
 /**
  *****************************************************************************
  * @ingroup qatZip
@@ -375,6 +689,95 @@ typedef struct QzStatus_S {
  *****************************************************************************/
 int qzInit(QzSession_T *sess,  unsigned char sw_backup);
 
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Initialize QAT hardware in the background
+ *
+ * @description
+ *      This function starts a thread that does the work of qzInit and
+ *    then of qzWarmup, and returns without waiting for it. Until the
+ *    thread has started the hardware, qzInit returns QZ_NO_HW to callers
+ *    with sw_backup set, so their requests are served by software, and
+ *    blocks the other callers. Until it has set up all instances, only
+ *    instances already set up take requests.
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      Starts a detached thread
+ * @blocking
+ *      No
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @param[in]       sw_backup 0 for no sw backup, 1 for sw backup
+ *
+ * @retval QZ_OK                   The initialization thread started
+ * @retval QZ_DUPLICATE            The hardware has been initialized or
+ *                                 is being initialized already
+ * @retval QZ_PARAMS               sw_backup is out of range
+ * @retval QZ_FAIL                 The thread could not be started
+ *
+ * @pre
+ *      None
+ * @post
+ *      None
+ * @note
+ *      Only an asynchronous version of this function is provided.
+ *
+ * @see
+ *      qzInit(), qzWarmup()
+ *
+ *****************************************************************************/
+int qzInitBackground(unsigned char sw_backup);
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Set up every QAT instance ahead of the first request
+ *
+ * @description
+ *      The pinned buffers and the DC session of an instance are otherwise
+ *    set up by the first request to use the instance. This function sets
+ *    up all instances of the process, in parallel, with the default
+ *    session parameters, and returns when all are done.
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      Allocates pinned memory for every instance
+ * @blocking
+ *      Yes
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @retval QZ_OK                   All instances are set up
+ * @retval QZ_FAIL                 The process has no QAT instance attached
+ * @retval QZ_LOW_MEM              Not enough memory, the return code of the
+ *                                 first instance that failed otherwise
+ *
+ * @pre
+ *      qzInit has been called
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      qzInit(), qzInitBackground()
+ *
+ *****************************************************************************/
+int qzWarmup(void);
+
 /**
  *****************************************************************************
  * @ingroup qatZip
@@ -434,6 +837,61 @@ int qzInit(QzSession_T *sess,  unsigned char sw_backup);
  *****************************************************************************/
 int qzSetupSession(QzSession_T *sess,  QzSessionParams_T *params);
 
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Set the preset dictionary of a session
+ *
+ * @description
+ *      This function copies dict as the preset dictionary of the session.
+ *    Small inputs compress much better when the deflate window starts out
+ *    with data resembling them. Every QZ member is then compressed against
+ *    the dictionary and carries its ID, the Adler-32 of dict, in a 'Q','D'
+ *    subfield of the gzip extra field. A zlib stream carries the ID in its
+ *    header as defined by RFC1950, a raw deflate stream carries none.
+ *
+ *      The hardware has no preset dictionary, so all compression of the
+ *    session and the decompression of members carrying a dictionary ID run
+ *    in software. Decompression needs the same dictionary set on the
+ *    decompressing session. Passing a dict_len of 0 removes the dictionary.
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      Yes
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @param[in]     sess                      Session handle
+ * @param[in]     dict                      point to the dictionary
+ * @param[in]     dict_len                  length of the dictionary, only the
+ *                                          last 32KB take part in compression
+ *
+ * @retval QZ_OK          Function executed successfully.
+ * @retval QZ_FAIL        Function did not succeed.
+ * @retval QZ_PARAMS      *sess is NULL or not set up, a single stream is
+ *                        open or the session uses QZ_DEFLATE_GZIP
+ * @pre
+ *      qzSetupSession has been called. A later qzSetupSession removes the
+ *    dictionary.
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      qzSetupSession()
+ *
+ *****************************************************************************/
+int qzSetDictionary(QzSession_T *sess, const unsigned char *dict,
+                    unsigned int dict_len);
+
 /**
  *****************************************************************************
  * @ingroup qatZip
@@ -458,6 +916,12 @@ int qzSetupSession(QzSession_T *sess,  QzSessionParams_T *params);
  *    possible reason for this may be small amounts of data in the src
  *    buffer.
  *
+ *    If the session data format is QZ_DEFLATE_GZIP, QZ_DEFLATE_RAW or
+ *    QZ_DEFLATE_ZLIB, the output of consecutive calls forms a single
+ *    gzip member, raw deflate stream or zlib stream. The call with last
+ *    set to 1 closes the stream and appends its footer, src_len may be
+ *    zero for that call.
+ *
  * @context
  *      This function shall not be called in an interrupt context.
  * @assumptions
@@ -513,7 +977,8 @@ int qzCompress(QzSession_T *sess, const unsigned char *src,
  *
  *    This function will place completed compression blocks in the output
  *    buffer and put CRC32 checksum for compressed input data in user provided
- *    bufer *crc.
+ *    bufer *crc. For a QZ_DEFLATE_ZLIB session *crc is the Adler-32
+ *    checksum of the input instead.
  *
  *    The caller must check the updated src_len.  This value will be the
  *    number of consumed bytes on exit.  The calling API may have to
@@ -627,12 +1092,16 @@ int qzDecompress(QzSession_T *sess, const unsigned char *src,
 /**
  *****************************************************************************
  * @ingroup qatZip
- *      Deinitialize a QATZip session
+ *      decompress a buffer and return the checksum of the output
  *
  * @description
- *      This function disconnects a session from a hardware instance and
- *    deallocates buffers. If no session has been initialized, then no
- *    action will take place.
+ *      This function decompresses a buffer like qzDecompress and puts the
+ *    CRC32 checksum of the decompressed data in user provided buffer *crc.
+ *    The checksum is combined from the CRC32 already carried and checked
+ *    for every gzip member, the output is not read again. For a
+ *    QZ_DEFLATE_ZLIB session *crc is the Adler-32 checksum of the output
+ *    instead. A raw deflate stream carries no checksum, its CRC32 is
+ *    computed over the output.
  *
  * @context
  *      This function shall not be called in an interrupt context.
@@ -647,12 +1116,21 @@ int qzDecompress(QzSession_T *sess, const unsigned char *src,
  * @threadSafe
  *      Yes
  *
- * @param[in]       sess  Session handle
- *
- * @retval QZ_OK          Function executed successfully.
- * @retval QZ_FAIL        Function did not succeed.
- * @retval QZ_PARAMS      *sess is NULL or member of params is invalid
+ * @param[in]     sess                      Session handle
+ * @param[in]     src                       point to source buffer
+ * @param[in]     src_len                   length of source buffer. Modified to
+ *                                          length of processed compressed data
+ *                                          when function returns
+ * @param[in]      dest                     point to destination buffer
+ * @param[in,out]  dest_len                 length of destination buffer. Modified
+ *                                          to length of decompressed data when
+ *                                          function returns
+ * @param[out]     crc                      point to CRC32 checksum buffer, valid
+ *                                          when QZ_OK is returned
  *
+ * @retval QZ_OK      Function executed successfully.
+ * @retval QZ_FAIL    Function did not succeed.
+ * @retval QZ_PARAMS  *sess is NULL or member of params is invalid
  * @pre
  *      None
  * @post
@@ -661,18 +1139,31 @@ int qzDecompress(QzSession_T *sess, const unsigned char *src,
  *      Only a synchronous version of this function is provided.
  *
  * @see
- *      None
+ *      qzDecompress(), qzCompressCrc()
  *
  *****************************************************************************/
-int qzTeardownSession(QzSession_T *sess);
+int qzDecompressCrc(QzSession_T *sess, const unsigned char *src,
+                    unsigned int *src_len, unsigned char *dest,
+                    unsigned int *dest_len, unsigned long *crc);
 
 /**
  *****************************************************************************
  * @ingroup qatZip
- *      terminates a QATZip session
+ *      Compress a buffer within a time budget
  *
  * @description
- *      This function closes the connection with QAT
+ *      This function compresses a buffer like qzCompress but stops
+ *    submitting further chunks once budget usec have passed since the
+ *    call. The wait for a busy instance is cut short by the budget as
+ *    well. When the budget runs out before all input is consumed the
+ *    function returns QZ_TIMEOUT with src_len and dest_len set to the
+ *    progress made, the output ends on a chunk boundary and the caller
+ *    may continue with the rest of the input in a later call.
+ *
+ *      Chunks already submitted are completed, so the call may overrun
+ *    the budget by the time of the chunks in flight. A single raw
+ *    deflate, zlib or standard gzip stream compressed in software is not
+ *    interrupted.
  *
  * @context
  *      This function shall not be called in an interrupt context.
@@ -687,12 +1178,22 @@ int qzTeardownSession(QzSession_T *sess);
  * @threadSafe
  *      Yes
  *
- * @param[in]       sess  pointer to session data
- *
- * @retval QZ_OK          Function executed successfully.
- * @retval QZ_FAIL        Function did not succeed.
- * @retval QZ_PARAMS      *sess is NULL or member of params is invalid
+ * @param[in]       sess     Session handle
+ * @param[in]       src      point to source buffer
+ * @param[in,out]   src_len  length of source buffer. Modified to number
+ *                           of bytes consumed
+ * @param[in]       dest     point to destination buffer
+ * @param[in,out]   dest_len length of destination buffer.  Modified
+ *                           to length of compressed data when
+ *                           function returns
+ * @param[in]       last     1 for 'No more data to be compressed'
+ *                           0 for 'More data to be compressed'
+ * @param[in]       budget   time budget of the call in usec
  *
+ * @retval QZ_OK             Function executed successfully.
+ * @retval QZ_TIMEOUT        The budget ran out, part of src was consumed.
+ * @retval QZ_FAIL           Function did not succeed.
+ * @retval QZ_PARAMS         *sess is NULL or member of params is invalid
  * @pre
  *      None
  * @post
@@ -701,39 +1202,31 @@ int qzTeardownSession(QzSession_T *sess);
  *      Only a synchronous version of this function is provided.
  *
  * @see
- *      None
+ *      qzCompress()
  *
  *****************************************************************************/
-int qzClose(QzSession_T *sess);
-
+int qzCompressDeadline(QzSession_T *sess, const unsigned char *src,
+                       unsigned int *src_len, unsigned char *dest,
+                       unsigned int *dest_len, unsigned int last,
+                       unsigned long budget);
 
 /**
  *****************************************************************************
  * @ingroup qatZip
- *      Get current QAT status
+ *      Decompress a buffer within a time budget
  *
  * @description
- *    This function retrieves the status of QAT in the platform.
- *    The status structure will be filled in as follows:
- *  qat_hw_count         number of discovered QAT devices on PCU bus
- *  qat_service_stated   1 if qzInit has been successfully run, 0 otherwise
- *  qat_mem_drvr         1 if the QAT memory driver is installed, 0 otherwise
- *  qat_instance_attach  1 if session has attached to a hw instance, 0 otherwise
- *  memory_alloced       amount of memory, in kilobytes, from kernel or huge
- *                       pages allocated  by this process/thread.
- *  using_huge_pages     1 if memory is being allocated from huge pages, 0 if
- *                       memory is being allocated from standard kernel memory
- *  hw_session_stat      Hw session status:  one of:
- *      QZ_OK
- *      QZ_FAIL
- *      QZ_NO_HW
- *      QZ_NO_MDRV
- *      QZ_NO_INST_ATTACH
- *      QZ_LOW_MEM
- *      QZ_NOSW_NO_HW
- *      QZ_NOSW_MDRV
- *      QZ_NOSW_NO_INST_ATTACH
- *      QZ_NOSW_LOW_MEM
+ *      This function decompresses a buffer like qzDecompress but stops
+ *    submitting further members once budget usec have passed since the
+ *    call. The wait for a busy instance is cut short by the budget as
+ *    well. When the budget runs out before all input is consumed the
+ *    function returns QZ_TIMEOUT with src_len and dest_len set to the
+ *    whole members decompressed, the caller may continue from there in a
+ *    later call.
+ *
+ *      Members already submitted are completed, so the call may overrun
+ *    the budget by the time of the members in flight. A raw deflate or
+ *    zlib stream is not interrupted.
  *
  * @context
  *      This function shall not be called in an interrupt context.
@@ -748,17 +1241,230 @@ int qzClose(QzSession_T *sess);
  * @threadSafe
  *      Yes
  *
- * @param[in]  dcInstance  Instance handle derived from discovery functions
- * @retval QZ_OK           Function executed successfully. A hw based
- *                         compression session has been created.
- * @retval QZ_PARAMS       *status is NULL
- *
- * @pre
- *      None
- * @post
- *      None
- * @note
- *      Only a synchronous version of this function is provided.
+ * @param[in]     sess                      Session handle
+ * @param[in]     src                       point to source buffer
+ * @param[in]     src_len                   length of source buffer. Modified to
+ *                                          length of processed compressed data
+ *                                          when function returns
+ * @param[in]      dest                     point to destination buffer
+ * @param[in,out]  dest_len                 length of destination buffer. Modified
+ *                                          to length of decompressed data when
+ *                                          function returns
+ * @param[in]      budget                   time budget of the call in usec
+ *
+ * @retval QZ_OK      Function executed successfully.
+ * @retval QZ_TIMEOUT The budget ran out, part of src was consumed.
+ * @retval QZ_FAIL    Function did not succeed.
+ * @retval QZ_PARAMS  *sess is NULL or member of params is invalid
+ * @pre
+ *      None
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      qzDecompress()
+ *
+ *****************************************************************************/
+int qzDecompressDeadline(QzSession_T *sess, const unsigned char *src,
+                         unsigned int *src_len, unsigned char *dest,
+                         unsigned int *dest_len, unsigned long budget);
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Decompress a range of a QZ stream
+ *
+ * @description
+ *      This function decompresses the bytes [off, off + *len) of the data
+ *    held in the QZ stream src, without inflating the members before or
+ *    after them. The members covering the range are located from the seek
+ *    index of the stream when it carries one, otherwise by walking the
+ *    member headers. Only those members are decompressed, in hardware when
+ *    available. Members straddling either end of the range are inflated
+ *    into a scratch buffer and the requested bytes copied out.
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      Yes
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @param[in]     sess                      Session handle
+ * @param[in]     src                       point to QZ stream
+ * @param[in]     src_len                   length of QZ stream
+ * @param[in]     off                       offset of the range in the
+ *                                          decompressed data
+ * @param[in,out] len                       length of the range. Modified to
+ *                                          the number of bytes written, which
+ *                                          is less when the range runs past
+ *                                          the end of the data
+ * @param[in]     dest                      point to destination buffer of at
+ *                                          least *len bytes
+ *
+ * @retval QZ_OK          Function executed successfully.
+ * @retval QZ_FAIL        src is not a QZ stream or function did not succeed.
+ * @retval QZ_DATA_ERROR  A member header of src is corrupt or truncated.
+ * @retval QZ_PARAMS      *sess is NULL, member of params is invalid or the
+ *                        session decompresses raw or zlib data
+ * @pre
+ *      None
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      qzDecompress()
+ *
+ *****************************************************************************/
+int qzDecompressRange(QzSession_T *sess, const unsigned char *src,
+                      unsigned int src_len, unsigned long off,
+                      unsigned int *len, unsigned char *dest);
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Deinitialize a QATZip session
+ *
+ * @description
+ *      This function disconnects a session from a hardware instance and
+ *    deallocates buffers. If no session has been initialized, then no
+ *    action will take place.
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      Yes
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @param[in]       sess  Session handle
+ *
+ * @retval QZ_OK          Function executed successfully.
+ * @retval QZ_FAIL        Function did not succeed.
+ * @retval QZ_PARAMS      *sess is NULL or member of params is invalid
+ *
+ * @pre
+ *      None
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      None
+ *
+ *****************************************************************************/
+int qzTeardownSession(QzSession_T *sess);
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      terminates a QATZip session
+ *
+ * @description
+ *      This function closes the connection with QAT
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      Yes
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @param[in]       sess  pointer to session data
+ *
+ * @retval QZ_OK          Function executed successfully.
+ * @retval QZ_FAIL        Function did not succeed.
+ * @retval QZ_PARAMS      *sess is NULL or member of params is invalid
+ *
+ * @pre
+ *      None
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      None
+ *
+ *****************************************************************************/
+int qzClose(QzSession_T *sess);
+
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Get current QAT status
+ *
+ * @description
+ *    This function retrieves the status of QAT in the platform.
+ *    The status structure will be filled in as follows:
+ *  qat_hw_count         number of discovered QAT devices on PCU bus
+ *  qat_service_stated   1 if qzInit has been successfully run, 0 otherwise
+ *  qat_mem_drvr         1 if the QAT memory driver is installed, 0 otherwise
+ *  qat_instance_attach  1 if session has attached to a hw instance, 0 otherwise
+ *  memory_alloced       amount of memory, in kilobytes, from kernel or huge
+ *                       pages allocated  by this process/thread.
+ *  using_huge_pages     1 if memory is being allocated from huge pages, 0 if
+ *                       memory is being allocated from standard kernel memory
+ *  hw_session_stat      Hw session status:  one of:
+ *      QZ_OK
+ *      QZ_FAIL
+ *      QZ_NO_HW
+ *      QZ_NO_MDRV
+ *      QZ_NO_INST_ATTACH
+ *      QZ_LOW_MEM
+ *      QZ_NOSW_NO_HW
+ *      QZ_NOSW_MDRV
+ *      QZ_NOSW_NO_INST_ATTACH
+ *      QZ_NOSW_LOW_MEM
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      Yes
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @param[in]  dcInstance  Instance handle derived from discovery functions
+ * @retval QZ_OK           Function executed successfully. A hw based
+ *                         compression session has been created.
+ * @retval QZ_PARAMS       *status is NULL
+ *
+ * @pre
+ *      None
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
  *
  * @see
  *      None
@@ -766,6 +1472,305 @@ int qzClose(QzSession_T *sess);
  *****************************************************************************/
 int qzGetStatus(QzSession_T *sess, QzStatus_T *status);
 
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Get a snapshot of the QATzip statistics
+ *
+ * @description
+ *      This function reports the calls and bytes of the process served by
+ *    hardware and by software, why calls went to software and the pinned
+ *    memory in use, and fills in the statistics of the first inst_cnt
+ *    instances. The counters are always kept and are not reset.
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      No
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @param[out]    stats                     Process statistics
+ * @param[out]    inst                      Array of inst_cnt instance
+ *                                          statistics, may be NULL if
+ *                                          inst_cnt is 0
+ * @param[in]     inst_cnt                  Entries of inst
+ *
+ * @retval QZ_OK          Function executed successfully.
+ * @retval QZ_PARAMS      *stats is NULL, or inst is NULL and inst_cnt is not 0
+ * @pre
+ *      None
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      qzGetInstanceHealth()
+ *
+ *****************************************************************************/
+int qzGetStats(QzStats_T *stats, QzInstanceStats_T *inst,
+               unsigned int inst_cnt);
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Get a snapshot of the QATzip statistics of each thread
+ *
+ * @description
+ *      This function fills in up to *cnt entries of stats, one for each
+ *    thread that called compress or decompress, and sets *cnt to the
+ *    number of entries filled in. The calls of threads that exited are
+ *    summed up in one entry with thread_id 0. The counters are always
+ *    kept, each thread updates its own without locking.
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      No
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @param[out]    stats                     Array of *cnt thread statistics
+ * @param[in,out] cnt                       Entries of stats on input,
+ *                                          entries filled in on output
+ *
+ * @retval QZ_OK          Function executed successfully.
+ * @retval QZ_PARAMS      stats or cnt is NULL
+ * @pre
+ *      None
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      qzGetStats()
+ *
+ *****************************************************************************/
+int qzGetThreadStats(QzThreadStats_T *stats, unsigned int *cnt);
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Get latency percentiles of compress or decompress calls
+ *
+ * @description
+ *      Each compress and decompress call is timed from entry to return
+ *    and recorded in a log-linear histogram of its thread, by operation,
+ *    engine and input size class. This function merges the histograms
+ *    of all threads for op and size, or for all sizes if size is
+ *    QZ_LAT_SZ_MAX, and reports the percentiles. A reported time is the
+ *    upper bound of its histogram bucket, at most 12.5% above the
+ *    recorded times.
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      No
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @param[in]     op                        Operation and engine
+ * @param[in]     size                      Input size class
+ * @param[out]    lat                       Latency percentiles
+ *
+ * @retval QZ_OK          Function executed successfully.
+ * @retval QZ_PARAMS      lat is NULL, or op or size is out of range
+ * @pre
+ *      None
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      qzResetLatency()
+ *
+ *****************************************************************************/
+int qzGetLatency(QzLatOp_T op, QzLatSize_T size, QzLatency_T *lat);
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Reset the latency histograms
+ *
+ * @description
+ *      This function empties the latency histograms of all threads. A
+ *    thread clears its own histograms on its next call, calls that are
+ *    running during the reset may still be counted.
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      No
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @pre
+ *      None
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      qzGetLatency()
+ *
+ *****************************************************************************/
+void qzResetLatency(void);
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Get the compressed chunk cache statistics of a session
+ *
+ * @description
+ *      This function reports the hits, misses and size of the compressed
+ *    chunk cache enabled by the cache_sz session parameter. A hit reuses
+ *    the deflate data of an identical earlier chunk of the session instead
+ *    of compressing the chunk again. All fields are 0 while the session has
+ *    not compressed anything through the cache.
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      Yes
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @param[in]     sess                      Session handle
+ * @param[out]    stats                     Cache statistics
+ *
+ * @retval QZ_OK          Function executed successfully.
+ * @retval QZ_PARAMS      *sess or *stats is NULL or the session is not set up
+ * @pre
+ *      qzSetupSession has been called. A later qzSetupSession empties the
+ *    cache and clears its statistics.
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      qzSetupSession()
+ *
+ *****************************************************************************/
+int qzGetCacheStats(QzSession_T *sess, QzCacheStats_T *stats);
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Get the instance wait statistics of the process
+ *
+ * @description
+ *      This function reports how often and for how long requests of the
+ *    process waited for a QAT instance. A request that finds every
+ *    instance in use queues for up to the wait_timeout of its session, it
+ *    is served by software or fails once the wait is over.
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      Yes
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @param[out]    stats                     Wait statistics
+ *
+ * @retval QZ_OK          Function executed successfully.
+ * @retval QZ_PARAMS      *stats is NULL
+ * @pre
+ *      None
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      None
+ *
+ *****************************************************************************/
+int qzGetWaitStats(QzWaitStats_T *stats);
+
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Get the health of a QAT instance
+ *
+ * @description
+ *      This function reports the request counts, the latency and the
+ *    quarantine state of instance inst of the process, instances are
+ *    numbered from 0 in the order the library uses them.
+ *
+ * @context
+ *      This function shall not be called in an interrupt context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      No
+ * @reentrant
+ *      No
+ * @threadSafe
+ *      Yes
+ *
+ * @param[in]     inst                      Instance number
+ * @param[out]    health                    Instance health
+ *
+ * @retval QZ_OK          Function executed successfully.
+ * @retval QZ_FAIL        The process has no QAT instance attached
+ * @retval QZ_PARAMS      *health is NULL or inst is out of range
+ * @pre
+ *      qzInit has been called
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      qzInit()
+ *
+ *****************************************************************************/
+int qzGetInstanceHealth(unsigned int inst, QzInstanceHealth_T *health);
+
 /**
  *****************************************************************************
  * @ingroup qatZip
@@ -807,6 +1812,56 @@ int qzGetStatus(QzSession_T *sess, QzStatus_T *status);
 #define QZ_SKID_PAD_SZ 48
 unsigned int qzMaxCompressedLength(unsigned int src_sz);
 
+/**
+ *****************************************************************************
+ * @ingroup qatZip
+ *      Get the decompressed length of a QZ stream
+ *
+ * @description
+ *      This function returns the exact decompressed length and the number
+ *    of data members of the QZ stream src. Only the member headers are
+ *    read, the compressed data itself is neither touched nor verified.
+ *    When the stream carries a seek index the lengths are taken from it.
+ *    Index members are not counted.
+ *
+ * @context
+ *      This function may be called from any context.
+ * @assumptions
+ *      None
+ * @sideEffects
+ *      None
+ * @blocking
+ *      No
+ * @reentrant
+ *      Yes
+ * @threadSafe
+ *      Yes
+ *
+ * @param[in]     src                       point to QZ stream
+ * @param[in]     src_len                   length of QZ stream
+ * @param[out]    out_len                   decompressed length of the
+ *                                          complete members of src
+ * @param[out]    members                   number of complete members of src
+ *
+ * @retval QZ_OK          Function executed successfully.
+ * @retval QZ_FAIL        src does not start with a QZ member.
+ * @retval QZ_DATA_ERROR  src ends with a truncated or corrupt member, out_len
+ *                        and members cover the members before it.
+ * @retval QZ_PARAMS      src, out_len or members is NULL
+ * @pre
+ *      None
+ * @post
+ *      None
+ * @note
+ *      Only a synchronous version of this function is provided.
+ *
+ * @see
+ *      qzDecompress()
+ *
+ *****************************************************************************/
+int qzDecompressedLength(const unsigned char *src, unsigned int src_len,
+                         unsigned long *out_len, unsigned int *members);
+
 /**
  *****************************************************************************
  * @ingroup qatZip
@@ -41,12 +41,12 @@ extern"C" {
 #endif
 
 #include <zlib.h>
+#include "qz_utils.h"
 
 #define SUCCESS              1
 #define FAILURE              0
 
 #define NODE_0               0
-#define NUM_BUFF             (32)
 #define MAX_NUM_RETRY        ((int)500)
 #define MAX_BUFFERS          ((int)100)
 #define MAX_OPEN_RETRY       ((int)100)
@@ -56,14 +56,78 @@ extern"C" {
 #define GET_LOWER_16BITS(v)  ((v) & 0xFFFF)
 #define GET_LOWER_8BITS(v)   ((v) & 0xFF)
 
-/*For Sync mode, request counts must less than NUM_BUFF.
- *If then the request can't get adequate unused buffer and will be hanged
- * */
-#if QZ_REQ_THRESHOLD_MAXINUM > NUM_BUFF
-#error QZ_REQ_THRESHOLD_MAXINUM should not be larger than NUM_BUFF
+#define QAT_MAX_DEVICES     32
+
+#define QZ_INDEX_ENTRIES_PER_MEMBER  8000
+/*internal checkHeader code for a seek index member*/
+#define QZ_INDEX_MEMBER     (100)
+/*internal code of a request qzipd went away under*/
+#define QZ_SVC_LOST         (101)
+
+#define STD_GZIP_HDR_SZ     10
+#define ZLIB_HDR_SZ         2
+#define ZLIB_FTR_SZ         4
+#define DEFLATE_WINDOW_SZ   (32*1024)
+#define ZLIB_DICT_ID_SZ     4
+
+/*poorly compressed chunks in a row that start a bypass, chunks bypassed*/
+#define QZ_POOR_RUN_MAX     8
+#define QZ_BYPASS_CHUNKS    64
+
+/*instances bulk sessions leave to the others, times a waiter may be
+ *overtaken by higher priorities, chunks per slice of a bulk compression*/
+#define QZ_RESERVED_INST        1
+#define QZ_PRIORITY_WEIGHT      4
+#define QZ_BULK_SLICE_CHUNKS    64
+
+/*requests per health window, failed requests and average retries per
+ *request in a window that quarantine an instance, times the average
+ *latency of the other instances an instance may take, submit retries of
+ *a probe, first and longest time between probes of a quarantined
+ *instance in msec*/
+#define QZ_HEALTH_WINDOW        64
+#define QZ_HEALTH_ERR_MAX       4
+#define QZ_HEALTH_RETRY_AVG     32
+#define QZ_HEALTH_SLOW_FACTOR   8
+#define QZ_QUARANTINE_RETRY     16
+#define QZ_QUARANTINE_MS        100
+#define QZ_QUARANTINE_MAX_MS    (64 * 1000)
+
+/*config sections of a shared device, processes in the load table*/
+#define QZ_LOAD_SECTIONS        3
+#define QZ_LOAD_SLOTS           256
+
+/*smallest adaptive chunk, chunks a medium call is spread over, calls of
+ *more hw_buff_sz chunks than that keep them, average output per 256
+ *input bytes under which chunks are halved at most*/
+#define QZ_ADAPT_CHUNK_MIN      (16 * 1024)
+#define QZ_ADAPT_FANOUT         8
+#define QZ_ADAPT_BULK_CHUNKS    16
+#define QZ_ADAPT_GOOD_RATIO     64
+
+/*statistics counters are only summed up, readers need no ordering*/
+#define QZ_STAT_ADD(cnt, n)     __atomic_fetch_add(&(cnt), (n), __ATOMIC_RELAXED)
+#define QZ_STAT_GET(cnt)        __atomic_load_n(&(cnt), __ATOMIC_RELAXED)
+
+/*USDT probes of provider qatzip, a nop in the code when not traced and
+ *nothing at all without sys/sdt.h*/
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define QZ_PROBE1(n, a)             DTRACE_PROBE1(qatzip, n, a)
+#define QZ_PROBE2(n, a, b)          DTRACE_PROBE2(qatzip, n, a, b)
+#define QZ_PROBE3(n, a, b, c)       DTRACE_PROBE3(qatzip, n, a, b, c)
+#define QZ_PROBE4(n, a, b, c, d)    DTRACE_PROBE4(qatzip, n, a, b, c, d)
+#define QZ_PROBE5(n, a, b, c, d, e) DTRACE_PROBE5(qatzip, n, a, b, c, d, e)
+#else
+#define QZ_PROBE1(n, a)             do { } while (0)
+#define QZ_PROBE2(n, a, b)          do { } while (0)
+#define QZ_PROBE3(n, a, b, c)       do { } while (0)
+#define QZ_PROBE4(n, a, b, c, d)    do { } while (0)
+#define QZ_PROBE5(n, a, b, c, d, e) do { } while (0)
 #endif
 
-#define QAT_MAX_DEVICES     32
+/*usec between looks at an instance busy with a request during warm up*/
+#define QZ_WARMUP_POLL_US       100
 
 typedef struct QzCpaStream_S {
     signed long seq;
@@ -79,8 +143,26 @@ typedef struct QzCpaStream_S {
     int dest_pinned;
     unsigned int gzip_footer_checksum;
     unsigned int gzip_footer_orgdatalen;
+    int stored;  /*completed by the CPU as stored blocks*/
+    int cached;  /*completed from the compressed chunk cache*/
+    unsigned char *next_dest;  /*where the decompressed data goes*/
 } QzCpaStream_T;
 
+typedef struct QzInstHealth_S {
+    unsigned int win_reqs;    /*requests in the current window*/
+    unsigned int win_errs;
+    unsigned long win_retries;
+    unsigned long avg_us;     /*moving average usec per request buffer*/
+    unsigned long probe_at;   /*when a quarantined instance is probed*/
+    unsigned int backoff_ms;
+    unsigned char quarantined;
+    unsigned char faulted;    /*the device failed the current request*/
+    unsigned long requests;
+    unsigned long errors;
+    unsigned long retries;
+    unsigned long quarantines;
+} QzInstHealth_T;
+
 typedef struct QzInstance_S {
     CpaInstanceInfo2 instance_info;
     CpaDcInstanceCapabilities instance_cap;
@@ -93,6 +175,7 @@ typedef struct QzInstance_S {
     CpaBufferList **dest_buffers;
     Cpa16U src_count;
     Cpa16U dest_count;
+    unsigned int buff_sz;  /*bytes of each source buffer*/
     QzCpaStream_T *stream;
 
     unsigned int lock;
@@ -101,7 +184,14 @@ typedef struct QzInstance_S {
     unsigned char cpa_sess_setup;
     CpaStatus inst_start_status;
     unsigned int num_retries;
+    QzInstHealth_T health;
     CpaDcSessionHandle cpaSess;
+
+    /*always on statistics for qzGetStats*/
+    unsigned long calls;
+    unsigned long bytes_in;
+    unsigned long bytes_out;
+    unsigned long pinned_sz;
 } QzInstance_T;
 
 typedef struct QzInstanceList_S {
@@ -123,8 +213,25 @@ typedef struct ProccesData_S {
     CpaInstanceHandle *dc_inst_handle;
     QzInstance_T *qz_inst;
     Cpa16U num_instances;
+    unsigned int forks;       /*children forked while initialized*/
+    unsigned char inherited;  /*SAL state copied from the parent by fork*/
+    unsigned char warming;    /*qzInitBackground has not finished yet*/
+    unsigned int fail_submits; /*test hook: decompress submits to refuse*/
 } processData_T;
 
+typedef struct QzIndexEntry_S {
+    uint32_t c_sz;  /*member length including header and footer*/
+    uint32_t u_sz;  /*uncompressed member length*/
+} QzIndexEntry_T;
+
+typedef struct QzIndex_S {
+    unsigned long cnt;
+    unsigned long *c_off;  /*cnt + 1 compressed member offsets*/
+    unsigned long *u_off;  /*cnt + 1 uncompressed member offsets*/
+} QzIndex_T;
+
+typedef struct QzCache_S QzCache_T;
+
 typedef struct QzSess_S {
     int inst_hint;   /*which instance we last used*/
     QzSessionParams_T sess_params;
@@ -152,6 +259,49 @@ typedef struct QzSess_S {
     unsigned long qz_in_len;
     unsigned long qz_out_len;
     unsigned long *crc32;
+    unsigned int last;
+
+    /*CLOCK_MONOTONIC nsec the current call has to finish by, 0 if none,
+     *timed_out once submitting stopped for it*/
+    unsigned long deadline;
+    int timed_out;
+
+    unsigned long svc_sid;  /*session at qzipd, 0 if not served by it*/
+    unsigned char svc_open; /*a compressed stream is open at qzipd*/
+
+    /*state of the open gzip member, raw or zlib stream*/
+    int member_open;
+    unsigned long member_cksum;
+    unsigned long member_len;
+    unsigned char *win;
+    unsigned int win_len;
+
+    /*members of the QZ stream for the seek index*/
+    QzIndexEntry_T *idx_ent;
+    unsigned long idx_cnt;
+    unsigned long idx_cap;
+    int idx_fail;
+
+    /*incompressible data bypass, poor_run and poor_trips are written by
+     *the receiving side, trips_seen and bypass_left by the submitting one.
+     *poor_trips crosses threads, access it with QZ_STAT_ADD/QZ_STAT_GET*/
+    unsigned int poor_run;
+    unsigned long poor_trips;
+    unsigned long trips_seen;
+    unsigned int bypass_left;
+
+    /*chunk size of the current call, moving average of the output per
+     *256 input bytes of compressed chunks, 0 before the first*/
+    unsigned int chunk_sz;
+    unsigned int ratio_avg;
+
+    /*preset dictionary set by qzSetDictionary*/
+    unsigned char *dict;
+    unsigned int dict_len;
+    unsigned long dict_id;
+
+    /*compressed chunk cache, allocated on first use*/
+    QzCache_T *cache;
 } QzSess_T;
 
 typedef struct ThreadData_S {
@@ -184,20 +334,122 @@ typedef struct QzGzH_S {
     QzExtraField_T extra;
 } QzGzH_T;
 
+/*follows the QZ subfield of members compressed with a preset dictionary*/
+typedef struct QzDictField_S {
+    unsigned char st1;
+    unsigned char st2;
+    uint16_t x2_len;
+    uint32_t dict_id;  /*Adler-32 of the dictionary*/
+} QzDictField_T;
+
 typedef struct QzGzF_S {
     uint32_t crc32;
     uint32_t i_size;
 } QzGzF_T;
 
 void dumpAllCounters(void);
+void qzStatsHw(int i, Serv_T serv, unsigned long in, unsigned long out,
+               unsigned long begin);
+void qzStatsSw(Serv_T serv, QzFallback_T why, int rc, unsigned long in,
+               unsigned long out, unsigned long begin);
+void qzStatsFallback(QzFallback_T why);
+void qzStatsParallel(void);
 int qzSetupHW(QzSession_T *sess, int i);
 unsigned long qzGzipHeaderSz(void);
 unsigned long qzGzipFooterSz(void);
 void qzGzipHeaderGen(unsigned char *ptr, CpaDcRqResults *res);
 int qzGzipHeaderExt(const unsigned char *const ptr, QzGzH_T *hdr);
+unsigned long qzDictHeaderSz(void);
+void qzDictHeaderGen(unsigned char *ptr, CpaDcRqResults *res,
+                     unsigned long dict_id);
+int isQzDictHeader(const unsigned char *const ptr);
+unsigned long qzGzipMemberSz(const unsigned char *const ptr,
+                             unsigned long avail, unsigned long *u_sz);
 void qzGzipFooterGen(unsigned char *ptr, CpaDcRqResults *res);
 void qzGzipFooterExt(const unsigned char *const ptr, QzGzF_T *ftr);
 int isStdGzipHeader(const unsigned char *const ptr);
+unsigned long outputHeaderSz(QzDataFormat_T data_fmt);
+unsigned long outputFooterSz(QzDataFormat_T data_fmt);
+unsigned long streamHeaderSz(QzDataFormat_T data_fmt);
+unsigned long streamFooterSz(QzDataFormat_T data_fmt);
+void streamHeaderGen(unsigned char *ptr, QzSessionParams_T *params);
+void streamFooterGen(unsigned char *ptr, QzDataFormat_T data_fmt,
+                     unsigned long cksum, unsigned long len);
+unsigned long streamCksumInit(QzDataFormat_T data_fmt);
+unsigned long streamCksumCombine(QzDataFormat_T data_fmt, unsigned long cksum1,
+                                 unsigned long cksum2, unsigned long len2);
+void zlibDictHeaderGen(unsigned char *ptr, unsigned int comp_lvl,
+                       unsigned long dict_id);
+int zlibHeaderExt(const unsigned char *const ptr);
+
+unsigned long qzIndexSz(unsigned long cnt);
+unsigned long qzIndexGen(unsigned char *ptr, const QzIndexEntry_T *ent,
+                         unsigned long cnt);
+unsigned long qzIndexMemberSz(const unsigned char *ptr, unsigned long avail);
+void qzIndexAdd(QzSess_T *qz_sess, unsigned int c_sz, unsigned int u_sz);
+int qzIndexWrite(QzSess_T *qz_sess, unsigned char *dest,
+                 unsigned int *dest_len);
+int qzIndexLoad(const unsigned char *src, unsigned long src_len,
+                QzIndex_T *index);
+long qzIndexLookup(const QzIndex_T *index, unsigned long u_off);
+void qzIndexFree(QzIndex_T *index);
+
+int qzIsIncompressible(const unsigned char *src, unsigned int len);
+unsigned int qzStoredSz(unsigned int len);
+unsigned int qzStoredGen(unsigned char *dest, const unsigned char *src,
+                         unsigned int len, int final);
+int qzStoreChunk(QzSess_T *qz_sess, const unsigned char *src,
+                 unsigned int len);
+void qzRatioUpdate(QzSess_T *qz_sess, unsigned int consumed,
+                   unsigned int produced);
+
+unsigned int qzChunkSz(const QzSess_T *qz_sess, unsigned long len,
+                       unsigned int buff_sz, unsigned int slots,
+                       unsigned long busy);
+unsigned int qzChunkLen(const QzSessionParams_T *params, unsigned int max,
+                        const unsigned char *src, unsigned int len);
+unsigned long qzChunkCntMax(const QzSessionParams_T *params, unsigned int max,
+                            unsigned long len);
+
+unsigned long qzNowNsec(void);
+int qzDeadlinePassed(QzSess_T *qz_sess);
+
+int qzSvcAttach(void);
+unsigned long qzSvcNewSid(void);
+void qzSvcClose(QzSess_T *qz_sess);
+int qzSvcCompress(QzSession_T *sess, const unsigned char *src,
+                  unsigned int *src_len, unsigned char *dest,
+                  unsigned int *dest_len, unsigned int last,
+                  unsigned long *crc);
+int qzSvcDecompressible(QzSess_T *qz_sess, const unsigned char *src,
+                        unsigned int src_len, unsigned int dest_len);
+int qzSvcDecompress(QzSession_T *sess, const unsigned char *src,
+                    unsigned int *src_len, unsigned char *dest,
+                    unsigned int *dest_len, unsigned long *crc);
+int qzSvcStart(unsigned int threads);
+void qzSvcStop(void);
+void qzSvcAtFork(void);
+
+int qzLoadAttach(void);
+void qzLoadDetach(void);
+void qzLoadAtFork(void);
+int qzLoadPickSection(int first);
+void qzLoadSetSection(int section);
+void qzLoadInc(unsigned int dev);
+void qzLoadDec(unsigned int dev);
+unsigned long qzLoadDevice(unsigned int dev);
+
+QzCache_T *qzCacheCreate(const QzSessionParams_T *params);
+void qzCacheDestroy(QzCache_T *cache);
+int qzCacheLookup(QzCache_T *cache, const unsigned char *src,
+                  unsigned int src_len, unsigned char *dest,
+                  unsigned int dest_avail, unsigned int *comp_len,
+                  uint32_t *checksum);
+void qzCacheInsert(QzCache_T *cache, const unsigned char *src,
+                   unsigned int src_len, const unsigned char *comp,
+                   unsigned int comp_len, uint32_t checksum);
+void qzCacheStats(QzCache_T *cache, QzCacheStats_T *stats);
+QzCache_T *qzSessCache(QzSess_T *qz_sess);
 
 int qzSWCompress(QzSession_T *sess, const unsigned char *src,
                  unsigned int *src_len, unsigned char *dest,
@@ -207,6 +459,14 @@ int qzSWDecompress(QzSession_T *sess, const unsigned char *src,
                    unsigned int *uncompressed_buf_len, unsigned char *dest,
                    unsigned int *compressed_buffer_len);
 
+int qzSWDecompressParallel(QzSession_T *sess, const unsigned char *src,
+                           unsigned int *src_len, unsigned char *dest,
+                           unsigned int *dest_len);
+
+int qzSWDecompressStream(QzSession_T *sess, const unsigned char *src,
+                         unsigned int *src_len, unsigned char *dest,
+                         unsigned int *dest_len);
+
 int qzSWDecompressMultiGzip(QzSession_T *sess, const unsigned char *src,
                             unsigned int *uncompressed_buf_len, unsigned char *dest,
                             unsigned int *compressed_buffer_len);
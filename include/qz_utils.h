@@ -64,29 +64,52 @@ typedef enum ENGINE_E {
     SW
 } Engine_T;
 
-typedef struct ThreadList_S {
-    unsigned int thread_id;
-    unsigned int comp_hw_count;
-    unsigned int comp_sw_count;
-    unsigned int decomp_hw_count;
-    unsigned int decomp_sw_count;
-    struct ThreadList_S *next;
-} ThreadList_T;
+/* Latency histograms are log-linear: each power of two of nanoseconds is
+ * split into 1 << QZ_LAT_SUB_BITS buckets, so a bucket is within 12.5% of
+ * the times it holds. Times from 2^40 ns on share the last bucket.
+ */
+#define QZ_LAT_SUB_BITS     3
+#define QZ_LAT_MAX_BITS     40
+#define QZ_LAT_BUCKETS      ((QZ_LAT_MAX_BITS - QZ_LAT_SUB_BITS + 1) << \
+                             QZ_LAT_SUB_BITS)
+/*input size classes, QZ_LAT_SZ_MAX in qatzip.h*/
+#define QZ_LAT_SIZES        4
 
-typedef struct QatThread_S {
-    ThreadList_T *comp_th_list;
-    unsigned int num_comp_th;
-    pthread_mutex_t comp_lock;
-    ThreadList_T *decomp_th_list;
-    unsigned int num_decomp_th;
-    pthread_mutex_t decomp_lock;
-} QatThread_T;
+/* Counters of one thread. The thread owns the block and is its only
+ * writer, readers sum the blocks up without locking. Blocks are never
+ * freed: a block left by an exiting thread is taken by the next new one.
+ */
+typedef struct ThreadStats_S {
+    unsigned long thread_id;
+    unsigned int live;
+    unsigned long calls[2][2];     /*[Serv_T][Engine_T]*/
+    unsigned long bytes_in[2][2];
+    unsigned long bytes_out[2][2];
+    unsigned long nsec[2][2];
+    unsigned int lat_epoch;        /*histograms older than g_lat_epoch are void*/
+    unsigned long lat[2][2][QZ_LAT_SIZES][QZ_LAT_BUCKETS];
+    struct ThreadStats_S *next;
+} ThreadStats_T;
+
+/*blocks of all threads, and the sums of the threads that exited. The
+ *lock keeps the counts of an exiting thread from being seen both in its
+ *block and in the sums, and a reset from losing them*/
+extern ThreadStats_T *g_thread_stats;
+extern ThreadStats_T g_thread_retired;
+extern unsigned int g_lat_epoch;
+extern pthread_mutex_t g_thread_lock;
 
-extern void initDebugLock(void);
 extern void dumpThreadInfo(void);
-extern void insertThread(unsigned int th_id,
-                         Serv_T serv_type,
-                         Engine_T engine_type);
+extern void forkThreadStats(void);
+extern unsigned int latBucket(unsigned long nsec);
+extern unsigned long latValue(unsigned int bucket);
+extern unsigned int latSize(unsigned long len);
+extern void latClear(ThreadStats_T *ts);
+extern void countThread(Serv_T serv_type,
+                        Engine_T engine_type,
+                        unsigned long in,
+                        unsigned long out,
+                        unsigned long nsec);
 
 #ifdef QATZIP_DEBUG
 static inline void QZ_DEBUG(const char *format, ...)
@@ -40,8 +40,12 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <sys/time.h>
+#include <time.h>
 #include <bits/types.h>
 #include <numa.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
 
 #include "cpa.h"
 #include "cpa_dc.h"
@@ -86,13 +90,25 @@ QzSessionParams_T g_sess_params_default = {
     .sw_backup         = QZ_SW_BACKUP_DEFAULT,
     .hw_buff_sz        = QZ_HW_BUFF_SZ,
     .input_sz_thrshold = QZ_COMP_THRESHOLD_DEFAULT,
-    .req_cnt_thrshold  = QZ_REQ_THRESHOLD_DEFAULT
+    .req_cnt_thrshold  = QZ_REQ_THRESHOLD_DEFAULT,
+    .par_decomp_thrshold = QZ_PAR_DECOMP_THRESHOLD_DEFAULT,
+    .data_fmt          = QZ_DATA_FORMAT_DEFAULT,
+    .index_trailer     = QZ_INDEX_TRAILER_DEFAULT,
+    .store_incompressible = QZ_STORE_INCOMPRESSIBLE_DEFAULT,
+    .cache_sz          = QZ_CACHE_SZ_DEFAULT,
+    .rsyncable         = QZ_RSYNCABLE_DEFAULT,
+    .wait_timeout      = QZ_WAIT_TIMEOUT_DEFAULT,
+    .priority          = QZ_PRIORITY_DEFAULT,
+    .service           = QZ_SERVICE_DEFAULT,
+    .buff_cnt          = QZ_BUFF_CNT_DEFAULT,
+    .adaptive_chunk    = QZ_ADAPTIVE_CHUNK_DEFAULT
 };
 
 processData_T g_process = {
     .qz_init_called = 0,
 };
 pthread_mutex_t g_lock;
+static pthread_once_t g_fork_once = PTHREAD_ONCE_INIT;
 
 __thread ThreadData_T g_thread = {
     .ppid = 0,
@@ -184,6 +200,7 @@ static void dcCallback(void *cbtag, CpaStatus stat)
     tag = (long)cbtag;
     j = GET_LOWER_16BITS(tag);
     i = tag >> 16;
+    QZ_PROBE3(dc_callback, i, j, stat);
 
     if (g_process.qz_inst[i].stream[j].src1 !=
         g_process.qz_inst[i].stream[j].src2) {
@@ -210,32 +227,272 @@ done:
     return;
 }
 
-static int qzGrabInstance(int hint)
+/* An instance is quarantined when its requests fail, keep the submit
+ * retrying or take QZ_HEALTH_SLOW_FACTOR times longer than those of the
+ * other instances. Requests then go elsewhere until a probe is due, the
+ * next request to grab the instance is the probe and a successful one
+ * returns it to service. Failed probes double the time to the next one.
+ * The state only changes under the instance lock.
+ */
+static inline int instUsable(int i)
 {
-    int i, rc;
+    /*qzInitBackground hands out only the instances set up already*/
+    if (g_process.warming && (0 == g_process.qz_inst[i].mem_setup ||
+                              0 == g_process.qz_inst[i].cpa_sess_setup)) {
+        return 0;
+    }
+
+    return !g_process.qz_inst[i].health.quarantined ||
+           qzNowNsec() >= g_process.qz_inst[i].health.probe_at;
+}
+
+static inline unsigned int instDev(int i)
+{
+    return g_process.qz_inst[i].instance_info.physInstId.packageId;
+}
+
+static inline int tryInstance(int i)
+{
+    if (!instUsable(i) ||
+        0 != __sync_lock_test_and_set(&(g_process.qz_inst[i].lock), 1)) {
+        return 0;
+    }
+
+    qzLoadInc(instDev(i));
+    return 1;
+}
+
+static inline int qzRetryMax(int i)
+{
+    return g_process.qz_inst[i].health.quarantined ?
+           QZ_QUARANTINE_RETRY : MAX_NUM_RETRY;
+}
+
+static inline void countRetry(int i)
+{
+    QZ_PROBE2(cpa_retry, i, g_process.qz_inst[i].num_retries);
+    g_process.qz_inst[i].num_retries++;
+    g_process.qz_inst[i].health.retries++;
+    g_process.qz_inst[i].health.win_retries++;
+}
+
+/* Mark the request on instance i as failed by the device */
+static inline void instFault(int i)
+{
+    g_process.qz_inst[i].health.faulted = 1;
+}
+
+static int healthyInstances(void)
+{
+    int i, n = 0;
+
+    for (i = 0; i < g_process.num_instances; i++) {
+        n += !g_process.qz_inst[i].health.quarantined;
+    }
+    return n;
+}
+
+/* Average latency of the other instances in service */
+static unsigned long peerAvgUs(int i)
+{
+    int k, n = 0;
+    unsigned long sum = 0;
+
+    for (k = 0; k < g_process.num_instances; k++) {
+        QzInstHealth_T *h = &g_process.qz_inst[k].health;
+
+        if (k != i && !h->quarantined && h->avg_us &&
+            h->requests >= QZ_HEALTH_WINDOW) {
+            sum += h->avg_us;
+            n++;
+        }
+    }
+    return n ? sum / n : 0;
+}
+
+static void quarantineInstance(int i, const char *why)
+{
+    QzInstHealth_T *h = &g_process.qz_inst[i].health;
+
+    h->backoff_ms = h->backoff_ms ? h->backoff_ms * 2 : QZ_QUARANTINE_MS;
+    if (h->backoff_ms > QZ_QUARANTINE_MAX_MS) {
+        h->backoff_ms = QZ_QUARANTINE_MAX_MS;
+    }
+    h->probe_at = qzNowNsec() + h->backoff_ms * 1000000UL;
+    if (!h->quarantined) {
+        QZ_ERROR("instance %d quarantined: %s\n", i, why);
+        h->quarantines++;
+        h->quarantined = 1;
+    }
+}
+
+/* Account the request of chunks buffers instance i served since start,
+ * called before the instance is released
+ */
+static void qzInstHealthUpdate(int i, unsigned long chunks,
+                               unsigned long start)
+{
+    QzInstHealth_T *h = &g_process.qz_inst[i].health;
+    int ok = !h->faulted;
+    int exhausted = g_process.qz_inst[i].num_retries > qzRetryMax(i);
+    unsigned long us, peer;
+
+    us = (qzNowNsec() - start) / 1000 / (chunks ? chunks : 1);
+    g_process.qz_inst[i].num_retries = 0;
+    h->faulted = 0;
+    h->requests++;
+    h->win_reqs++;
+    if (ok) {
+        h->avg_us = h->avg_us ? (h->avg_us * 7 + us) / 8 : us;
+        g_process.qz_inst[i].heartbeat = time(NULL);
+    } else {
+        h->errors++;
+        h->win_errs++;
+    }
+
+    if (h->quarantined) {
+        if (ok) {
+            QZ_DEBUG("instance %d back in service\n", i);
+            h->quarantined = 0;
+            h->backoff_ms = 0;
+            h->avg_us = us;
+            h->win_reqs = 0;
+            h->win_errs = 0;
+            h->win_retries = 0;
+        } else {
+            quarantineInstance(i, "probe failed");
+        }
+        return;
+    }
+
+    if (exhausted) {
+        quarantineInstance(i, "submit retries exhausted");
+    } else if (h->win_errs >= QZ_HEALTH_ERR_MAX) {
+        quarantineInstance(i, "failed requests");
+    } else if (h->win_reqs >= QZ_HEALTH_WINDOW) {
+        peer = peerAvgUs(i);
+        if (h->win_retries >= QZ_HEALTH_RETRY_AVG * h->win_reqs) {
+            quarantineInstance(i, "submit retries");
+        } else if (peer && h->avg_us > QZ_HEALTH_SLOW_FACTOR * peer) {
+            quarantineInstance(i, "latency");
+        }
+    }
+
+    if (h->quarantined || h->win_reqs >= QZ_HEALTH_WINDOW) {
+        h->win_reqs = 0;
+        h->win_errs = 0;
+        h->win_retries = 0;
+    }
+}
+
+int qzGetInstanceHealth(unsigned int inst, QzInstanceHealth_T *health)
+{
+    QzInstHealth_T *h;
+
+    if (NULL == health) {
+        return QZ_PARAMS;
+    }
+    if (0 == g_process.qz_init_called) {
+        return QZ_FAIL;
+    }
+    if (inst >= g_process.num_instances) {
+        return QZ_PARAMS;
+    }
+
+    h = &g_process.qz_inst[inst].health;
+    health->requests = h->requests;
+    health->errors = h->errors;
+    health->retries = h->retries;
+    health->avg_us = h->avg_us;
+    health->quarantines = h->quarantines;
+    health->quarantined = h->quarantined;
+    health->heartbeat = (long)g_process.qz_inst[inst].heartbeat;
+    return QZ_OK;
+}
+
+/* Instances at the end of the list kept away from bulk sessions */
+static inline int reservedInstances(void)
+{
+    return (g_process.num_instances > QZ_RESERVED_INST) ? QZ_RESERVED_INST : 0;
+}
+
+/* The free instance of the device with the least requests in flight of
+ * all processes, hint when its device is as good as any
+ */
+static int leastLoaded(int hint, int end)
+{
+    int i, best = hint;
+    unsigned long load, min = qzLoadDevice(instDev(hint));
+
+    for (i = 0; i < end && min; i++) {
+        if (g_process.qz_inst[i].lock || !instUsable(i)) {
+            continue;
+        }
+        load = qzLoadDevice(instDev(i));
+        if (load < min) {
+            min = load;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+static int qzGrabInstance(int hint, QzPriority_T priority)
+{
+    int i;
+    int end = g_process.num_instances;
 
     if (0 == g_process.qz_init_called) {
         return -1;
     }
 
-    if (hint >= g_process.num_instances) {
-        hint = g_process.num_instances - 1;
+    if (QZ_PRIORITY_BULK == priority) {
+        end -= reservedInstances();
+    }
+
+    if (end <= 0) {
+        return -1;
+    }
+
+    if (hint >= end) {
+        hint = end - 1;
     }
 
     if (hint < 0) {
         hint = 0;
     }
 
-    /*check hint first*/
-    rc = __sync_lock_test_and_set(&(g_process.qz_inst[hint].lock), 1);
-    if (0 == rc) {
+    /*a due probe goes first, so a quarantined instance is not left idle*/
+    for (i = 0; i < end; i++) {
+        if (g_process.qz_inst[i].health.quarantined && tryInstance(i)) {
+            return i;
+        }
+    }
+
+    /*check hint first, unless a free instance has a less loaded device*/
+    hint = leastLoaded(hint, end);
+    if (tryInstance(hint)) {
         return hint;
     }
 
     /*otherwise loop through all of them*/
-    for (i = 0; i < g_process.num_instances; i++) {
-        rc = __sync_lock_test_and_set(&(g_process.qz_inst[i].lock), 1);
-        if (0 ==  rc) {
+    for (i = 0; i < end; i++) {
+        if (tryInstance(i)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int qzGrabReserved(void)
+{
+    int i;
+
+    for (i = g_process.num_instances - reservedInstances();
+         i < g_process.num_instances; i++) {
+        if (tryInstance(i)) {
             return i;
         }
     }
@@ -243,6 +500,238 @@ static int qzGrabInstance(int hint)
     return -1;
 }
 
+/* Requests finding every instance busy wait here for up to wait_timeout
+ * usec, by priority and in FIFO order within a priority. Only the head of
+ * the queue tries to grab any instance, qzReleaseInstance wakes it and a
+ * leaving head wakes the next. Waiters above bulk priority may also take
+ * a reserved instance from anywhere in the queue.
+ */
+typedef struct QzWaiter_S {
+    pthread_cond_t cond;
+    struct QzWaiter_S *next;
+    QzPriority_T priority;
+    unsigned int passed;  /*times overtaken by a higher priority*/
+} QzWaiter_T;
+
+static struct {
+    pthread_mutex_t lock;
+    QzWaiter_T *head;
+    QzWaiter_T *tail;
+    unsigned int cnt;
+    QzWaitStats_T stats;
+} g_wait = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static unsigned long elapsedUsec(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000UL +
+           now.tv_nsec / 1000 - start->tv_nsec / 1000;
+}
+
+unsigned long qzNowNsec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+int qzDeadlinePassed(QzSess_T *qz_sess)
+{
+    return qz_sess->deadline && qzNowNsec() >= qz_sess->deadline;
+}
+
+/* The instance wait of a request ends with its deadline */
+static unsigned int qzWaitBudget(QzSess_T *qz_sess)
+{
+    unsigned long now, left;
+
+    if (0 == qz_sess->deadline) {
+        return qz_sess->sess_params.wait_timeout;
+    }
+
+    now = qzNowNsec();
+    left = (qz_sess->deadline > now) ? (qz_sess->deadline - now) / 1000 : 0;
+    return (left < qz_sess->sess_params.wait_timeout) ?
+           (unsigned int)left : qz_sess->sess_params.wait_timeout;
+}
+
+static void waitStatsAdd(unsigned long usec, int timed_out)
+{
+    unsigned int k = 0;
+
+    while (k < QZ_WAIT_HIST_SZ - 1 && (usec >> k)) {
+        k++;
+    }
+    g_wait.stats.hist[k]++;
+    g_wait.stats.waits++;
+    g_wait.stats.total_us += usec;
+    if (usec > g_wait.stats.max_us) {
+        g_wait.stats.max_us = usec;
+    }
+    if (timed_out) {
+        g_wait.stats.timeouts++;
+    }
+}
+
+/* Signal the first waiter that may use instance i */
+static void qzWakeWaiter(int i)
+{
+    QzWaiter_T *w = g_wait.head;
+
+    if (i >= g_process.num_instances - reservedInstances()) {
+        while (w && QZ_PRIORITY_BULK == w->priority) {
+            w = w->next;
+        }
+        if (NULL == w) {
+            w = g_wait.head;
+        }
+    }
+
+    if (w) {
+        pthread_cond_signal(&w->cond);
+    }
+}
+
+static int qzGrabInstanceWait(int hint, unsigned int timeout,
+                              QzPriority_T priority)
+{
+    int i = -1, rc = 0;
+    unsigned long us;
+    QzWaiter_T self, *w, *prev = NULL;
+    pthread_condattr_t attr;
+    struct timespec start, deadline;
+
+    /*newcomers join the queue instead of overtaking it*/
+    if (0 == __sync_add_and_fetch(&g_wait.cnt, 0)) {
+        i = qzGrabInstance(hint, priority);
+    }
+    /*nothing to wait for while every instance is quarantined*/
+    if (-1 != i || 0 == timeout || 0 == g_process.qz_init_called ||
+        0 == healthyInstances()) {
+        QZ_PROBE3(inst_grab, i, hint, 0);
+        return i;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    deadline.tv_sec = start.tv_sec + timeout / 1000000;
+    deadline.tv_nsec = start.tv_nsec + (timeout % 1000000) * 1000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&self.cond, &attr);
+    pthread_condattr_destroy(&attr);
+    self.priority = priority;
+    self.passed = 0;
+
+    /*queue behind the waiters of the same or a higher priority and behind
+     *those already overtaken QZ_PRIORITY_WEIGHT times*/
+    pthread_mutex_lock(&g_wait.lock);
+    for (w = g_wait.head; NULL != w; w = w->next) {
+        if (w->priority >= priority || w->passed >= QZ_PRIORITY_WEIGHT) {
+            prev = w;
+        }
+    }
+    if (prev) {
+        self.next = prev->next;
+        prev->next = &self;
+    } else {
+        self.next = g_wait.head;
+        g_wait.head = &self;
+    }
+    if (g_wait.tail == prev) {
+        g_wait.tail = &self;
+    }
+    for (w = self.next; NULL != w; w = w->next) {
+        w->passed++;
+    }
+    prev = NULL;
+    __sync_fetch_and_add(&g_wait.cnt, 1);
+
+    while (1) {
+        if (g_wait.head == &self) {
+            i = qzGrabInstance(hint, priority);
+        } else if (QZ_PRIORITY_BULK != priority) {
+            i = qzGrabReserved();
+        }
+        if (-1 != i) {
+            break;
+        }
+        if (0 != rc) {
+            break;
+        }
+        rc = pthread_cond_timedwait(&self.cond, &g_wait.lock, &deadline);
+    }
+
+    /*leave the queue and hand the head over*/
+    for (w = g_wait.head; w != &self; w = w->next) {
+        prev = w;
+    }
+    if (prev) {
+        prev->next = self.next;
+    } else {
+        g_wait.head = self.next;
+    }
+    if (g_wait.tail == &self) {
+        g_wait.tail = prev;
+    }
+    __sync_fetch_and_sub(&g_wait.cnt, 1);
+    if (g_wait.head) {
+        pthread_cond_signal(&g_wait.head->cond);
+    }
+    us = elapsedUsec(&start);
+    waitStatsAdd(us, -1 == i);
+    pthread_mutex_unlock(&g_wait.lock);
+    QZ_PROBE3(inst_grab, i, hint, us);
+
+    pthread_cond_destroy(&self.cond);
+    return i;
+}
+
+/* Submitting every request before collecting any needs a free buffer
+ * for each of them, the count of instance i may come from a session
+ * other than qz_sess
+ */
+static inline int syncRequests(QzSess_T *qz_sess, int i, unsigned long reqcnt)
+{
+    return reqcnt <= qz_sess->sess_params.req_cnt_thrshold &&
+           reqcnt <= g_process.qz_inst[i].dest_count;
+}
+
+/* Requests decompressing the len bytes at src takes, counted up to max + 1
+ * from the member headers, small chunks compress to much less than the
+ * half buffer a count from len alone would assume
+ */
+static unsigned long memberCnt(const unsigned char *src, unsigned long len,
+                               unsigned long max)
+{
+    unsigned long pos, sz, u_sz, cnt = 0;
+
+    for (pos = 0; pos < len && cnt <= max; pos += sz) {
+        sz = qzIndexMemberSz(src + pos, len - pos);
+        if (sz) {
+            continue;
+        }
+
+        sz = qzGzipMemberSz(src + pos, len - pos, &u_sz);
+        if (0 == sz) {
+            /*checkHeader reports it once reached*/
+            return cnt + 1;
+        }
+        cnt++;
+    }
+
+    return cnt;
+}
+
 static int getUnusedBuffer(unsigned long i, int j)
 {
     int k;
@@ -282,7 +771,28 @@ static int getUnusedBuffer(unsigned long i, int j)
 
 static void qzReleaseInstance(int i)
 {
+    QZ_PROBE1(inst_release, i);
+    qzLoadDec(instDev(i));
     __sync_lock_release(&(g_process.qz_inst[i].lock));
+
+    /*a full barrier orders the release before the check of waiters*/
+    if (__sync_add_and_fetch(&g_wait.cnt, 0)) {
+        pthread_mutex_lock(&g_wait.lock);
+        qzWakeWaiter(i);
+        pthread_mutex_unlock(&g_wait.lock);
+    }
+}
+
+int qzGetWaitStats(QzWaitStats_T *stats)
+{
+    if (NULL == stats) {
+        return QZ_PARAMS;
+    }
+
+    pthread_mutex_lock(&g_wait.lock);
+    QZ_MEMCPY(stats, &g_wait.stats, sizeof(QzWaitStats_T), sizeof(QzWaitStats_T));
+    pthread_mutex_unlock(&g_wait.lock);
+    return QZ_OK;
 }
 
 static void init_timers(void)
@@ -314,7 +824,21 @@ static int qz_sessParamsCheck(QzSessionParams_T *params)
         params->input_sz_thrshold < QZ_COMP_THRESHOLD_MINIMUM ||
         params->input_sz_thrshold > QZ_HW_BUFF_MAX_SZ         ||
         params->req_cnt_thrshold < QZ_REQ_THRESHOLD_MINIMUM   ||
-        params->req_cnt_thrshold > QZ_REQ_THRESHOLD_MAXINUM) {
+        params->req_cnt_thrshold > QZ_REQ_THRESHOLD_MAXINUM   ||
+        (params->par_decomp_thrshold != 0 &&
+         params->par_decomp_thrshold < QZ_PAR_DECOMP_THRESHOLD_MINIMUM) ||
+        params->data_fmt > QZ_DEFLATE_ZLIB                    ||
+        params->index_trailer > 1                             ||
+        params->store_incompressible > 1                      ||
+        params->cache_sz > QZ_CACHE_SZ_MAX                    ||
+        params->rsyncable > 1                                 ||
+        params->wait_timeout > QZ_WAIT_TIMEOUT_MAX            ||
+        params->priority > QZ_PRIORITY_HIGH                   ||
+        params->service > 1                                   ||
+        params->buff_cnt < QZ_BUFF_CNT_MIN                    ||
+        params->buff_cnt > QZ_BUFF_CNT_MAX                    ||
+        params->req_cnt_thrshold > params->buff_cnt           ||
+        params->adaptive_chunk > 1) {
         return FAILURE;
     }
 
@@ -326,6 +850,7 @@ static void stopQat(void)
     int i;
     CpaStatus status = CPA_STATUS_SUCCESS;
 
+    qzLoadDetach();
     if (1 != g_process.qz_init_called) {
         return;
     }
@@ -345,7 +870,10 @@ static void stopQat(void)
         g_process.qz_inst = NULL;
     }
 
-    (void)icp_sal_userStop();
+    /*a child kept on sw never started the section it inherited*/
+    if (!g_process.inherited) {
+        (void)icp_sal_userStop();
+    }
     g_process.num_instances = (Cpa16U)0;
     g_process.qz_init_called = 0;
 }
@@ -358,6 +886,66 @@ static void exitFunc(void)
 #endif
 }
 
+/* fork() copies the instances, rings and pinned buffers of the parent
+ * into the child, where none of them may be used. The child forgets
+ * them and starts its own on the next qzInit, unless the parent has
+ * forked more than max_forks children, in which case it stays on sw.
+ */
+static void forkPrepare(void)
+{
+    pthread_mutex_lock(&g_lock);
+    if (1 == g_process.qz_init_called && QZ_OK == g_process.qz_init_status) {
+        g_process.forks++;
+    }
+}
+
+static void forkParent(void)
+{
+    pthread_mutex_unlock(&g_lock);
+}
+
+static void forkChild(void)
+{
+    unsigned int forks = g_process.forks;
+
+    pthread_mutex_init(&g_lock, NULL);
+    pthread_mutex_init(&g_wait.lock, NULL);
+    g_wait.head = NULL;
+    g_wait.tail = NULL;
+    g_wait.cnt = 0;
+    qzLoadAtFork();
+    qzSvcAtFork();
+    forkThreadStats();
+
+    g_process.forks = 0;
+    g_process.warming = 0;
+    if (1 != g_process.qz_init_called ||
+        QZ_OK != g_process.qz_init_status) {
+        return;
+    }
+
+    /*the pinned buffers stay mapped for the parent, only the lists go*/
+    free(g_process.dc_inst_handle);
+    g_process.dc_inst_handle = NULL;
+    free(g_process.qz_inst);
+    g_process.qz_inst = NULL;
+    g_process.num_instances = (Cpa16U)0;
+    g_process.inherited = 1;
+
+    if (forks > g_sess_params_default.max_forks) {
+        g_process.qz_init_status = g_process.sw_backup ?
+                                   QZ_NO_HW : QZ_NOSW_NO_HW;
+        return;
+    }
+    g_process.qz_init_called = 0;
+}
+
+static void forkRegister(void)
+{
+    if (0 != pthread_atfork(forkPrepare, forkParent, forkChild)) {
+        QZ_ERROR("Error in register fork handlers\n");
+    }
+}
 
 #define BACKOUT                                                    \
     stopQat();                                                     \
@@ -379,10 +967,8 @@ static void exitFunc(void)
     BACKOUT;
 
 
-/* Initialize the QAT hardware, get the QAT instance for current
- * process
- */
-int qzInit(QzSession_T *sess, unsigned char sw_backup)
+/* Start the user space driver and list the instances of the process */
+static int initQat(unsigned char sw_backup)
 {
     CpaStatus status;
     int rc = QZ_FAIL, i;
@@ -390,20 +976,6 @@ int qzInit(QzSession_T *sess, unsigned char sw_backup)
     QzHardware_T *qat_hw = NULL;
     unsigned int instance_found = 0;
 
-    if (sess == NULL) {
-        return QZ_PARAMS;
-    }
-
-    if (sw_backup > 1) {
-        return QZ_PARAMS;
-    }
-
-    __sync_synchronize();
-    if (1 == g_process.qz_init_called) {
-        /*hardware has already been inited*/
-        return QZ_DUPLICATE;
-    }
-
     if (0 != pthread_mutex_lock(&g_lock)) {
         return QZ_FAIL;
     }
@@ -421,10 +993,19 @@ int qzInit(QzSession_T *sess, unsigned char sw_backup)
     init_timers();
     g_process.sw_backup = sw_backup;
 
-    i = g_thread.pid % 3;
+    /*a forked child leaves the process section of its parent first*/
+    if (g_process.inherited) {
+        (void)icp_sal_userStop();
+        g_process.inherited = 0;
+    }
+
+    i = g_thread.pid % QZ_LOAD_SECTIONS;
+    if (QZ_OK == qzLoadAttach()) {
+        i = qzLoadPickSection(i);
+    }
     do {
 #ifdef DEVICE_SHARED
-        switch (i % 3) {
+        switch (i % QZ_LOAD_SECTIONS) {
         case 0:
             status = icp_sal_userStartMultiProcess(g_dev0_tag, CPA_FALSE);
             break;
@@ -443,6 +1024,7 @@ int qzInit(QzSession_T *sess, unsigned char sw_backup)
             break;
         }
     } while (i++ < MAX_OPEN_RETRY);
+    qzLoadSetSection(i % QZ_LOAD_SECTIONS);
 
     if (CPA_STATUS_SUCCESS != status) {
         QZ_ERROR("Error in start multi g_process QATZIP status = %d\n", status);
@@ -538,7 +1120,6 @@ int qzInit(QzSession_T *sess, unsigned char sw_backup)
     g_process.qz_init_called = 1;
 
 done:
-    initDebugLock();
     if (0 != pthread_mutex_unlock(&g_lock)) {
         return QZ_FAIL;
     }
@@ -546,30 +1127,188 @@ done:
     return rc;
 }
 
-#define QAE_FREE(ptr)                      \
-    if (NULL != (ptr)) {                   \
-        qaeMemFreeNUMA((void **)&(ptr));   \
-        (ptr)= NULL;                       \
-     }
-
-/* Free up the DMAable memory buffers used by QAT
- * internally, those buffers are source buffer,
- * intermeidate buffer and destination buffer
+/* Initialize the QAT hardware, get the QAT instance for current
+ * process
  */
-static void cleanUpInstMem(int i)
+int qzInit(QzSession_T *sess, unsigned char sw_backup)
 {
-    int j;
-
-    if (0 == g_process.qz_inst[i].mem_setup) {
-        return;
+    if (sess == NULL) {
+        return QZ_PARAMS;
     }
 
-    for (j = 0; j < g_process.qz_inst[i].intermediate_cnt; j++) {
-        QAE_FREE(g_process.qz_inst[i].intermediate_buffers[j]->pPrivateMetaData);
-        QAE_FREE(g_process.qz_inst[i].intermediate_buffers[j]->pBuffers->pData);
+    if (sw_backup > 1) {
+        return QZ_PARAMS;
     }
 
-    /*intermediate buffers*/
+    (void)pthread_once(&g_fork_once, forkRegister);
+
+    __sync_synchronize();
+    if (1 == g_process.qz_init_called) {
+        /*hardware has already been inited*/
+        return QZ_DUPLICATE;
+    }
+
+    /*processes served by qzipd leave the devices to it*/
+    if (g_sess_params_default.service && QZ_OK == qzSvcAttach()) {
+        return QZ_OK;
+    }
+
+    /*sw serves the callers that allow it until qzInitBackground is done*/
+    if (g_process.warming && 1 == sw_backup) {
+        return QZ_NO_HW;
+    }
+
+    return initQat(sw_backup);
+}
+
+/* Take instance i for set up, waiting for the request on it if any */
+static void warmGrab(int i)
+{
+    while (0 != __sync_lock_test_and_set(&(g_process.qz_inst[i].lock), 1)) {
+        usleep(QZ_WARMUP_POLL_US);
+    }
+    qzLoadInc(instDev(i));
+}
+
+typedef struct QzWarm_S {
+    pthread_t th;
+    int inst;
+    int rc;
+} QzWarm_T;
+
+static void *warmInstance(void *arg)
+{
+    QzWarm_T *warm = (QzWarm_T *)arg;
+    QzSession_T sess = {0};
+    int i = warm->inst;
+
+    warm->rc = qzSetupSession(&sess, NULL);
+    if (QZ_OK == warm->rc) {
+        warmGrab(i);
+        if (0 == g_process.qz_inst[i].mem_setup ||
+            0 == g_process.qz_inst[i].cpa_sess_setup) {
+            warm->rc = qzSetupHW(&sess, i);
+        }
+        qzReleaseInstance(i);
+    }
+
+    (void)qzTeardownSession(&sess);
+    return NULL;
+}
+
+int qzWarmup(void)
+{
+    QzWarm_T *warm;
+    int i, n, rc = QZ_OK;
+
+    __sync_synchronize();
+    if (1 != g_process.qz_init_called || QZ_OK != g_process.qz_init_status) {
+        return QZ_FAIL;
+    }
+
+    n = g_process.num_instances;
+    warm = calloc(n, sizeof(QzWarm_T));
+    if (NULL == warm) {
+        return QZ_LOW_MEM;
+    }
+
+    for (i = 0; i < n; i++) {
+        warm[i].inst = i;
+        if (0 != pthread_create(&warm[i].th, NULL, warmInstance, &warm[i])) {
+            /*set it up on this thread instead*/
+            warmInstance(&warm[i]);
+            warm[i].th = pthread_self();
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        if (!pthread_equal(warm[i].th, pthread_self())) {
+            pthread_join(warm[i].th, NULL);
+        }
+        if (QZ_OK == rc && QZ_OK != warm[i].rc) {
+            QZ_ERROR("Warm up of instance %d failed, rc = %d\n", i, warm[i].rc);
+            rc = warm[i].rc;
+        }
+    }
+
+    free(warm);
+    return rc;
+}
+
+static void *initThread(void *arg)
+{
+    int rc;
+
+    rc = initQat((unsigned char)(uintptr_t)arg);
+    if (QZ_OK == rc || QZ_DUPLICATE == rc) {
+        (void)qzWarmup();
+    }
+    __sync_lock_release(&g_process.warming);
+    return NULL;
+}
+
+int qzInitBackground(unsigned char sw_backup)
+{
+    pthread_t th;
+    pthread_attr_t attr;
+    int rc = QZ_OK;
+
+    if (sw_backup > 1) {
+        return QZ_PARAMS;
+    }
+
+    (void)pthread_once(&g_fork_once, forkRegister);
+
+    __sync_synchronize();
+    if (1 == g_process.qz_init_called ||
+        !__sync_bool_compare_and_swap(&g_process.warming, 0, 1)) {
+        return QZ_DUPLICATE;
+    }
+
+    if (g_sess_params_default.service && QZ_OK == qzSvcAttach()) {
+        __sync_lock_release(&g_process.warming);
+        return QZ_OK;
+    }
+
+    if (0 != pthread_attr_init(&attr)) {
+        __sync_lock_release(&g_process.warming);
+        return QZ_FAIL;
+    }
+    (void)pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (0 != pthread_create(&th, &attr, initThread,
+                            (void *)(uintptr_t)sw_backup)) {
+        __sync_lock_release(&g_process.warming);
+        rc = QZ_FAIL;
+    }
+    (void)pthread_attr_destroy(&attr);
+
+    return rc;
+}
+
+#define QAE_FREE(ptr)                      \
+    if (NULL != (ptr)) {                   \
+        qaeMemFreeNUMA((void **)&(ptr));   \
+        (ptr)= NULL;                       \
+     }
+
+/* Free up the DMAable memory buffers used by QAT
+ * internally, those buffers are source buffer,
+ * intermeidate buffer and destination buffer
+ */
+static void cleanUpInstMem(int i)
+{
+    int j;
+
+    if (0 == g_process.qz_inst[i].mem_setup) {
+        return;
+    }
+
+    for (j = 0; j < g_process.qz_inst[i].intermediate_cnt; j++) {
+        QAE_FREE(g_process.qz_inst[i].intermediate_buffers[j]->pPrivateMetaData);
+        QAE_FREE(g_process.qz_inst[i].intermediate_buffers[j]->pBuffers->pData);
+    }
+
+    /*intermediate buffers*/
     if (NULL != g_process.qz_inst[i].intermediate_buffers) {
         free(g_process.qz_inst[i].intermediate_buffers);
         g_process.qz_inst[i].intermediate_buffers = NULL;
@@ -605,6 +1344,7 @@ static void cleanUpInstMem(int i)
 
     QAE_FREE(g_process.qz_inst[i].cpaSess);
     g_process.qz_inst[i].mem_setup = 0;
+    g_process.qz_inst[i].pinned_sz = 0;
 }
 
 #define QZ_INST_MEM_CHECK(ptr, i)                                    \
@@ -620,6 +1360,17 @@ static void cleanUpInstMem(int i)
         goto done_inst;                                              \
     }
 
+/* Pinned memory of instance i, counted for qzGetStats */
+static void *instAlloc(int i, size_t sz)
+{
+    void *p = qaeMemAllocNUMA(sz, NODE_0, 64);
+
+    if (NULL != p) {
+        QZ_STAT_ADD(g_process.qz_inst[i].pinned_sz, sz);
+    }
+    return p;
+}
+
 /* Allocate the DMAable memory buffers used by QAT
  * internally, those buffers are source buffer,
  * intermeidate buffer and destination buffer
@@ -660,23 +1411,23 @@ static int getInstMem(int i, QzSessionParams_T *params)
 
     for (j = 0; j < g_process.qz_inst[i].intermediate_cnt; j++) {
         g_process.qz_inst[i].intermediate_buffers[j] = (CpaBufferList *)
-                qaeMemAllocNUMA(sizeof(CpaBufferList), NODE_0, 64);
+                instAlloc(i, sizeof(CpaBufferList));
         QZ_INST_MEM_CHECK(g_process.qz_inst[i].intermediate_buffers[j], i);
 
         if (0 != g_process.qz_inst[i].buff_meta_size) {
             g_process.qz_inst[i].intermediate_buffers[j]->pPrivateMetaData =
-                qaeMemAllocNUMA((size_t)(g_process.qz_inst[i].buff_meta_size), NODE_0, 64);
+                instAlloc(i, (size_t)(g_process.qz_inst[i].buff_meta_size));
             QZ_INST_MEM_CHECK(
                 g_process.qz_inst[i].intermediate_buffers[j]->pPrivateMetaData,
                 i);
         }
 
         g_process.qz_inst[i].intermediate_buffers[j]->pBuffers = (CpaFlatBuffer *)
-                qaeMemAllocNUMA(sizeof(CpaFlatBuffer), NODE_0, 64);
+                instAlloc(i, sizeof(CpaFlatBuffer));
         QZ_INST_MEM_CHECK(g_process.qz_inst[i].intermediate_buffers[j]->pBuffers, i);
 
         g_process.qz_inst[i].intermediate_buffers[j]->pBuffers->pData = (Cpa8U *)
-                qaeMemAllocNUMA(inter_sz, NODE_0, 64);
+                instAlloc(i, inter_sz);
         QZ_INST_MEM_CHECK(g_process.qz_inst[i].intermediate_buffers[j]->pBuffers->pData,
                           i);
 
@@ -685,8 +1436,9 @@ static int getInstMem(int i, QzSessionParams_T *params)
             inter_sz;
     }
 
-    g_process.qz_inst[i].src_count = NUM_BUFF;
-    g_process.qz_inst[i].dest_count = NUM_BUFF;
+    g_process.qz_inst[i].src_count = (Cpa16U)params->buff_cnt;
+    g_process.qz_inst[i].dest_count = (Cpa16U)params->buff_cnt;
+    g_process.qz_inst[i].buff_sz = src_sz;
 
     g_process.qz_inst[i].src_buffers = malloc((size_t)(
                                            g_process.qz_inst[i].src_count *
@@ -709,21 +1461,21 @@ static int getInstMem(int i, QzSessionParams_T *params)
         g_process.qz_inst[i].stream[j].sink2 = 0;
 
         g_process.qz_inst[i].src_buffers[j] = (CpaBufferList *)
-                                              qaeMemAllocNUMA(sizeof(CpaBufferList), NODE_0, 64);
+                                              instAlloc(i, sizeof(CpaBufferList));
         QZ_INST_MEM_CHECK(g_process.qz_inst[i].src_buffers[j], i);
 
         if (0 != g_process.qz_inst[i].buff_meta_size) {
             g_process.qz_inst[i].src_buffers[j]->pPrivateMetaData =
-                qaeMemAllocNUMA(g_process.qz_inst[i].buff_meta_size, NODE_0, 64);
+                instAlloc(i, g_process.qz_inst[i].buff_meta_size);
             QZ_INST_MEM_CHECK(g_process.qz_inst[i].src_buffers[j]->pPrivateMetaData, i);
         }
 
         g_process.qz_inst[i].src_buffers[j]->pBuffers = (CpaFlatBuffer *)
-                qaeMemAllocNUMA(sizeof(CpaFlatBuffer), NODE_0, 64);
+                instAlloc(i, sizeof(CpaFlatBuffer));
         QZ_INST_MEM_CHECK(g_process.qz_inst[i].src_buffers, i);
 
         g_process.qz_inst[i].src_buffers[j]->pBuffers->pData = (Cpa8U *)
-                qaeMemAllocNUMA(src_sz, NODE_0, 64);
+                instAlloc(i, src_sz);
         QZ_INST_MEM_CHECK(g_process.qz_inst[i].src_buffers[j]->pBuffers->pData, i);
 
         g_process.qz_inst[i].src_buffers[j]->numBuffers = (Cpa32U)1;
@@ -732,21 +1484,21 @@ static int getInstMem(int i, QzSessionParams_T *params)
 
     for (j = 0; j < g_process.qz_inst[i].dest_count; j++) {
         g_process.qz_inst[i].dest_buffers[j] = (CpaBufferList *)
-                                               qaeMemAllocNUMA(sizeof(CpaBufferList), NODE_0, 64);
+                                               instAlloc(i, sizeof(CpaBufferList));
         QZ_INST_MEM_CHECK(g_process.qz_inst[i].dest_buffers[j], i);
 
         if (0 != g_process.qz_inst[i].buff_meta_size) {
             g_process.qz_inst[i].dest_buffers[j]->pPrivateMetaData =
-                qaeMemAllocNUMA(g_process.qz_inst[i].buff_meta_size, NODE_0, 64);
+                instAlloc(i, g_process.qz_inst[i].buff_meta_size);
             QZ_INST_MEM_CHECK(g_process.qz_inst[i].dest_buffers[j]->pPrivateMetaData, i);
         }
 
         g_process.qz_inst[i].dest_buffers[j]->pBuffers = (CpaFlatBuffer *)
-                qaeMemAllocNUMA(sizeof(CpaFlatBuffer), NODE_0, 64);
+                instAlloc(i, sizeof(CpaFlatBuffer));
         QZ_INST_MEM_CHECK(g_process.qz_inst[i].dest_buffers, i);
 
         g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData = (Cpa8U *)
-                qaeMemAllocNUMA(dest_sz, NODE_0, 64);
+                instAlloc(i, dest_sz);
         QZ_INST_MEM_CHECK(g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData, i);
 
         g_process.qz_inst[i].dest_buffers[j]->numBuffers = (Cpa32U)1;
@@ -811,6 +1563,28 @@ int qzSetupSession(QzSession_T *sess, QzSessionParams_T *params)
 
     qz_sess->force_sw = 0;
     qz_sess->inflate_strm = NULL;
+    qz_sess->member_open = 0;
+    qz_sess->win_len = 0;
+    qz_sess->idx_cnt = 0;
+    qz_sess->idx_fail = 0;
+    qz_sess->poor_run = 0;
+    qz_sess->poor_trips = 0;
+    qz_sess->trips_seen = 0;
+    qz_sess->bypass_left = 0;
+    qz_sess->ratio_avg = 0;
+    free(qz_sess->dict);
+    qz_sess->dict = NULL;
+    qz_sess->dict_len = 0;
+    qzCacheDestroy(qz_sess->cache);
+    qz_sess->cache = NULL;
+
+    /*a session set up again starts a new stream at qzipd too*/
+    qzSvcClose(qz_sess);
+    if (qz_sess->sess_params.service && QZ_OK == qzSvcAttach()) {
+        qz_sess->svc_sid = qzSvcNewSid();
+        sess->hw_session_stat = QZ_OK;
+        return QZ_OK;
+    }
 
     /*set up cpaDc Session params*/
     qz_sess->session_setup_data.compLevel = qz_sess->sess_params.comp_lvl;
@@ -890,8 +1664,8 @@ int qzSetupHW(QzSession_T *sess, int i)
                                 &qz_sess->session_size,
                                 &qz_sess->ctx_size);
         if (CPA_STATUS_SUCCESS == qz_sess->sess_status) {
-            g_process.qz_inst[i].cpaSess = qaeMemAllocNUMA((size_t)(qz_sess->session_size),
-                                           NODE_0, 64);
+            g_process.qz_inst[i].cpaSess =
+                instAlloc(i, (size_t)(qz_sess->session_size));
             if (NULL ==  g_process.qz_inst[i].cpaSess) {
                 rc = qz_sess->sess_params.sw_backup ? QZ_LOW_MEM : QZ_NOSW_LOW_MEM;
                 goto done_sess;
@@ -921,6 +1695,38 @@ done_sess:
     return rc;
 }
 
+/* Complete slot j with output produced by the CPU, the way dcCallback
+ * completes a hardware request
+ */
+static void completeChunk(unsigned long i, int j, unsigned int consumed,
+                          unsigned int produced, unsigned long checksum)
+{
+    QzCpaStream_T *stream = &g_process.qz_inst[i].stream[j];
+
+    stream->res.consumed = consumed;
+    stream->res.produced = produced;
+    stream->res.checksum = checksum;
+    stream->res.status = CPA_DC_OK;
+    stream->job_status = CPA_STATUS_SUCCESS;
+    __sync_synchronize();
+    stream->sink1++;
+}
+
+/* Complete slot j with the chunk written as stored blocks */
+static void storeChunk(unsigned long i, int j, const unsigned char *src,
+                       unsigned int len, CpaDcFlush flush,
+                       QzDataFormat_T data_fmt)
+{
+    unsigned int produced;
+
+    produced =
+        qzStoredGen(g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData,
+                    src, len, CPA_DC_FLUSH_FINAL == flush);
+    /*zlib chunks get their Adler-32 in doCompressOut*/
+    completeChunk(i, j, len, produced,
+                  (QZ_DEFLATE_ZLIB == data_fmt) ? 0 : crc32(0, src, len));
+}
+
 /* The internal function to send the comrpession request
  * to the QAT hardware
  */
@@ -932,11 +1738,16 @@ static void *doCompressIn(void *in)
     unsigned int remaining;
     unsigned int src_send_sz;
     unsigned char *src_ptr, *dest_ptr;
-    unsigned int src_sz;
     CpaStatus rc;
+    CpaDcFlush flush;
     int src_pinned, dest_pinned;
     QzSession_T *sess = (QzSession_T *)in;
     QzSess_T *qz_sess = (QzSess_T *)sess->internal;
+    QzDataFormat_T data_fmt = qz_sess->sess_params.data_fmt;
+    QzCache_T *cache = qzSessCache(qz_sess);
+    unsigned int comp_len, chunk_avail;
+    unsigned int ovh_sz = outputHeaderSz(data_fmt) + outputFooterSz(data_fmt);
+    uint32_t cksum;
 
     i = qz_sess->inst_hint;
     src_ptr = qz_sess->src;
@@ -944,7 +1755,6 @@ static void *doCompressIn(void *in)
     src_pinned = qzMemFindAddr(src_ptr);
     dest_pinned = qzMemFindAddr(dest_ptr);
     remaining = *(qz_sess->src_sz);
-    src_sz = qz_sess->sess_params.hw_buff_sz;
     QZ_DEBUG("doCompressIn: Need to g_process %ld bytes\n", remaining);
 
     done = 1;
@@ -962,7 +1772,8 @@ static void *doCompressIn(void *in)
         QZ_DEBUG("getUnusedBuffer returned %d\n", j);
 
         g_process.qz_inst[i].stream[j].src1++; /*this buffer is in use*/
-        src_send_sz = (remaining < src_sz) ? remaining : src_sz;
+        src_send_sz = qzChunkLen(&qz_sess->sess_params, qz_sess->chunk_sz,
+                                 src_ptr, remaining);
         g_process.qz_inst[i].stream[j].seq = qz_sess->seq; /*this buffer is in use*/
         qz_sess->seq++;
         QZ_DEBUG("sending seq number %d %d %ld\n", i, j, qz_sess->seq);
@@ -971,10 +1782,37 @@ static void *doCompressIn(void *in)
         g_process.qz_inst[i].stream[j].src2++; /*this buffer is in use*/
         /*set up src dest buffers*/
         g_process.qz_inst[i].src_buffers[j]->pBuffers->dataLenInBytes = src_send_sz;
-        g_process.qz_inst[i].dest_buffers[j]->pBuffers->dataLenInBytes
-            = *(qz_sess->dest_sz);
+        /*the chunk goes to the instance buffer or, zero copied, right after
+         *its header in dest, neither is written past*/
+        chunk_avail = *(qz_sess->dest_sz) > ovh_sz ?
+                      MIN(*(qz_sess->dest_sz) - ovh_sz,
+                          DEST_SZ(g_process.qz_inst[i].buff_sz)) : 0;
+        g_process.qz_inst[i].dest_buffers[j]->pBuffers->dataLenInBytes =
+            chunk_avail;
+
+        /*using zerocopy for the first request while dest buffer is pinned*/
+        if (dest_pinned && (0 == g_process.qz_inst[i].stream[j].seq)) {
+            g_process.qz_inst[i].stream[j].orig_dest =
+                g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData;
+            g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData =
+                dest_ptr + outputHeaderSz(data_fmt);
+        }
 
-        if (0 == src_pinned) {
+        /*stored and cached chunks never reach the accelerator*/
+        g_process.qz_inst[i].stream[j].stored =
+            qzStoredSz(src_send_sz) <= chunk_avail &&
+            qzStoreChunk(qz_sess, src_ptr, src_send_sz);
+        /*an entry larger than the chunk has room for is a miss*/
+        g_process.qz_inst[i].stream[j].cached =
+            !g_process.qz_inst[i].stream[j].stored && NULL != cache &&
+            QZ_OK == qzCacheLookup(cache, src_ptr, src_send_sz,
+                                   g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData,
+                                   chunk_avail, &comp_len, &cksum);
+
+        if (g_process.qz_inst[i].stream[j].stored ||
+            g_process.qz_inst[i].stream[j].cached) {
+            g_process.qz_inst[i].stream[j].src_pinned = 0;
+        } else if (0 == src_pinned) {
             QZ_DEBUG("memory copy in doCompressIn\n");
             QZ_MEMCPY(g_process.qz_inst[i].src_buffers[j]->pBuffers->pData,
                       src_ptr,
@@ -989,36 +1827,46 @@ static void *doCompressIn(void *in)
             g_process.qz_inst[i].src_buffers[j]->pBuffers->pData = src_ptr;
         }
 
-        /*using zerocopy for the first request while dest buffer is pinned*/
-        if (dest_pinned && (0 == g_process.qz_inst[i].stream[j].seq)) {
-            g_process.qz_inst[i].stream[j].orig_dest =
-                g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData;
-            g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData =
-                dest_ptr + qzGzipHeaderSz();
-        }
-
-        do {
-            tag = (i << 16) | j;
-            QZ_DEBUG("Comp Sending i = %ld j = %d seq = %ld tag = %ld\n",
-                     i, j, g_process.qz_inst[i].stream[j].seq, tag);
-            rc = cpaDcCompressData(g_process.dc_inst_handle[i],
-                                   g_process.qz_inst[i].cpaSess,
-                                   g_process.qz_inst[i].src_buffers[j],
-                                   g_process.qz_inst[i].dest_buffers[j],
-                                   &g_process.qz_inst[i].stream[j].res,
-                                   CPA_DC_FLUSH_FINAL,
-                                   (void *)(tag));
-            if (CPA_STATUS_RETRY == rc) {
-                g_process.qz_inst[i].num_retries++;
-                usleep(qz_sess->sess_params.poll_sleep);
-            }
+        /*a single member stream only ends with the last chunk*/
+        if (QZ_DEFLATE_GZIP_EXT == data_fmt ||
+            (qz_sess->last && remaining == src_send_sz)) {
+            flush = CPA_DC_FLUSH_FINAL;
+        } else {
+            flush = CPA_DC_FLUSH_FULL;
+        }
 
-            if (g_process.qz_inst[i].num_retries > MAX_NUM_RETRY) {
-                QZ_ERROR("instance %d retry count:%d exceed the max count: %d\n",
-                         i, g_process.qz_inst[i].num_retries, MAX_NUM_RETRY);
-                goto err_exit;
-            }
-        } while (rc == CPA_STATUS_RETRY);
+        if (g_process.qz_inst[i].stream[j].stored) {
+            storeChunk(i, j, src_ptr, src_send_sz, flush, data_fmt);
+            rc = CPA_STATUS_SUCCESS;
+        } else if (g_process.qz_inst[i].stream[j].cached) {
+            completeChunk(i, j, src_send_sz, comp_len, cksum);
+            rc = CPA_STATUS_SUCCESS;
+        } else {
+            QZ_PROBE4(comp_submit, i, j, g_process.qz_inst[i].stream[j].seq,
+                      src_send_sz);
+            do {
+                tag = (i << 16) | j;
+                QZ_DEBUG("Comp Sending i = %ld j = %d seq = %ld tag = %ld\n",
+                         i, j, g_process.qz_inst[i].stream[j].seq, tag);
+                rc = cpaDcCompressData(g_process.dc_inst_handle[i],
+                                       g_process.qz_inst[i].cpaSess,
+                                       g_process.qz_inst[i].src_buffers[j],
+                                       g_process.qz_inst[i].dest_buffers[j],
+                                       &g_process.qz_inst[i].stream[j].res,
+                                       flush,
+                                       (void *)(tag));
+                if (CPA_STATUS_RETRY == rc) {
+                    countRetry(i);
+                    usleep(qz_sess->sess_params.poll_sleep);
+                }
+
+                if (g_process.qz_inst[i].num_retries > qzRetryMax(i)) {
+                    QZ_ERROR("instance %d retry count:%d exceed the max count: %d\n",
+                             i, g_process.qz_inst[i].num_retries, qzRetryMax(i));
+                    goto err_exit;
+                }
+            } while (rc == CPA_STATUS_RETRY);
+        }
 
         if (CPA_STATUS_SUCCESS != rc) {
             QZ_ERROR("Error in cpaDcCompressData: %d\n", rc);
@@ -1031,6 +1879,11 @@ static void *doCompressIn(void *in)
         src_ptr += src_send_sz;
         remaining -= src_send_sz;
 
+        if (remaining && qzDeadlinePassed(qz_sess)) {
+            qz_sess->timed_out = 1;
+            remaining = 0;
+        }
+
         if (qz_sess->stop_submitting) {
             remaining = 0;
         }
@@ -1045,6 +1898,7 @@ static void *doCompressIn(void *in)
 
 err_exit:
     /*roll back last submit*/
+    instFault(i);
     qz_sess->last_submitted = 1;
     qz_sess->submitted -= 1;
     g_process.qz_inst[i].stream[j].src1 -= 1;
@@ -1072,6 +1926,10 @@ static void *doCompressOut(void *in)
     QzSess_T *qz_sess = (QzSess_T *) sess->internal;
     long dest_avail_len = (long)(*qz_sess->dest_sz);
     int dest_pinned = qzMemFindAddr(qz_sess->next_dest);
+    QzDataFormat_T data_fmt = qz_sess->sess_params.data_fmt;
+    unsigned long hdr_sz = outputHeaderSz(data_fmt);
+    unsigned long ftr_sz = outputFooterSz(data_fmt);
+    unsigned long cksum;
 
     i = qz_sess->inst_hint;
     while ((qz_sess->last_submitted == 0) ||
@@ -1082,6 +1940,7 @@ static void *doCompressOut(void *in)
         sts = icp_sal_DcPollInstance(g_process.dc_inst_handle[i], 1);
         if (CPA_STATUS_FAIL == sts) {
             QZ_ERROR("Error in DcPoll: %d\n", sts);
+            instFault(i);
             sess->thd_sess_stat = QZ_FAIL;
             goto err_exit;
         }
@@ -1106,6 +1965,7 @@ static void *doCompressOut(void *in)
                 if (CPA_STATUS_SUCCESS != g_process.qz_inst[i].stream[j].job_status) {
                     QZ_ERROR("Error(%d) in callback: %ld, %ld\n",
                              g_process.qz_inst[i].stream[j].job_status, i, j);
+                    instFault(i);
                     qz_sess->processed++;
                     sess->thd_sess_stat = QZ_FAIL;
                     g_process.qz_inst[i].stream[j].sink2++;
@@ -1117,8 +1977,10 @@ static void *doCompressOut(void *in)
                 resl = &g_process.qz_inst[i].stream[j].res;
                 QZ_DEBUG("\tconsumed = %d, produced = %d, seq_in = %ld\n",
                          resl->consumed, resl->produced, g_process.qz_inst[i].stream[j].seq);
+                QZ_PROBE5(comp_retire, i, j, g_process.qz_inst[i].stream[j].seq,
+                          resl->consumed, resl->produced);
 
-                dest_avail_len -= (qzGzipHeaderSz() + resl->produced + qzGzipFooterSz());
+                dest_avail_len -= (hdr_sz + resl->produced + ftr_sz);
                 if (dest_avail_len < 0) {
                     QZ_DEBUG("doCompressOut: inadequate output buffer length: %ld\n",
                              (long)(*qz_sess->dest_sz));
@@ -1129,8 +1991,10 @@ static void *doCompressOut(void *in)
                     continue;
                 }
 
-                qzGzipHeaderGen(qz_sess->next_dest, resl);
-                qz_sess->next_dest += qzGzipHeaderSz();
+                if (QZ_DEFLATE_GZIP_EXT == data_fmt) {
+                    qzGzipHeaderGen(qz_sess->next_dest, resl);
+                }
+                qz_sess->next_dest += hdr_sz;
 
                 if (dest_pinned && (0 == g_process.qz_inst[i].stream[j].seq)) {
                     g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData =
@@ -1142,11 +2006,42 @@ static void *doCompressOut(void *in)
                               resl->produced);
                 }
                 qz_sess->next_dest += resl->produced;
-                qzGzipFooterGen(qz_sess->next_dest, resl);
-                qz_sess->next_dest += qzGzipFooterSz();
+
+                /*the hardware session checksum is CRC32*/
+                cksum = resl->checksum;
+                if (QZ_DEFLATE_ZLIB == data_fmt) {
+                    cksum = adler32(adler32(0, NULL, 0),
+                                    qz_sess->src + qz_sess->qz_in_len,
+                                    resl->consumed);
+                }
+
+                if (QZ_DEFLATE_GZIP_EXT == data_fmt) {
+                    qzGzipFooterGen(qz_sess->next_dest, resl);
+                    qzIndexAdd(qz_sess, hdr_sz + resl->produced + ftr_sz,
+                               resl->consumed);
+                } else {
+                    qz_sess->member_cksum = streamCksumCombine(data_fmt,
+                                                               qz_sess->member_cksum,
+                                                               cksum,
+                                                               resl->consumed);
+                    qz_sess->member_len += resl->consumed;
+                }
+                qz_sess->next_dest += ftr_sz;
+
+                if (!g_process.qz_inst[i].stream[j].stored &&
+                    !g_process.qz_inst[i].stream[j].cached) {
+                    qzRatioUpdate(qz_sess, resl->consumed, resl->produced);
+                    if (NULL != qz_sess->cache) {
+                        qzCacheInsert(qz_sess->cache,
+                                      qz_sess->src + qz_sess->qz_in_len,
+                                      resl->consumed,
+                                      qz_sess->next_dest - ftr_sz - resl->produced,
+                                      resl->produced, resl->checksum);
+                    }
+                }
 
                 qz_sess->qz_in_len += resl->consumed;
-                qz_sess->qz_out_len += (qzGzipHeaderSz() + resl->produced + qzGzipFooterSz());
+                qz_sess->qz_out_len += (hdr_sz + resl->produced + ftr_sz);
 
                 if (1 == g_process.qz_inst[i].stream[j].src_pinned) {
                     g_process.qz_inst[i].src_buffers[j]->pBuffers->pData =
@@ -1156,12 +2051,10 @@ static void *doCompressOut(void *in)
                 g_process.qz_inst[i].stream[j].sink2++;
                 qz_sess->processed++;
                 if (NULL != qz_sess->crc32) {
-                    if (0 == *(qz_sess->crc32)) {
-                        *(qz_sess->crc32) = resl->checksum;
-                    } else {
-                        *(qz_sess->crc32) =
-                            crc32_combine(*(qz_sess->crc32), resl->checksum, resl->consumed);
-                    }
+                    *(qz_sess->crc32) = streamCksumCombine(data_fmt,
+                                                           *(qz_sess->crc32),
+                                                           cksum,
+                                                           resl->consumed);
                 }
 
                 break;
@@ -1230,6 +2123,134 @@ unsigned char getSwBackup(QzSession_T *sess)
     }
 }
 
+/* Close the open gzip member, raw or zlib stream with an empty
+ * final block and the stream footer, with none open write an empty one
+ */
+static int qzCloseMember(QzSess_T *qz_sess, unsigned char *dest,
+                         unsigned int *dest_len)
+{
+    static const unsigned char empty_final_blk[] = {0x03, 0x00};
+    QzDataFormat_T data_fmt = qz_sess->sess_params.data_fmt;
+    unsigned int hdr_sz = qz_sess->member_open ? 0 : streamHeaderSz(data_fmt);
+    unsigned int out_len = hdr_sz + sizeof(empty_final_blk) +
+                           streamFooterSz(data_fmt);
+
+    if (*dest_len < out_len) {
+        return QZ_BUF_ERROR;
+    }
+
+    /*an empty stream still has its header*/
+    if (!qz_sess->member_open) {
+        streamHeaderGen(dest, &qz_sess->sess_params);
+        qz_sess->member_cksum = streamCksumInit(data_fmt);
+        qz_sess->member_len = 0;
+    }
+    memcpy(dest + hdr_sz, empty_final_blk, sizeof(empty_final_blk));
+    streamFooterGen(dest + hdr_sz + sizeof(empty_final_blk), data_fmt,
+                    qz_sess->member_cksum, qz_sess->member_len);
+    qz_sess->member_open = 0;
+    qz_sess->win_len = 0;
+    *dest_len = out_len;
+    return QZ_OK;
+}
+
+/* Compress a large bulk request slice by slice, the instance is given
+ * back between slices so that waiting requests of a higher priority get
+ * in at slice granularity
+ */
+static int qzCompressSlices(QzSession_T *sess, const unsigned char *src,
+                            unsigned int *src_len, unsigned char *dest,
+                            unsigned int *dest_len, unsigned int last,
+                            unsigned long *crc)
+{
+    int rc = QZ_OK;
+    QzSess_T *qz_sess = (QzSess_T *)sess->internal;
+    QzDataFormat_T data_fmt = qz_sess->sess_params.data_fmt;
+    unsigned int slice = QZ_BULK_SLICE_CHUNKS * qz_sess->sess_params.hw_buff_sz;
+    unsigned int in_left = *src_len, out_left = *dest_len;
+    unsigned int in_sz, out_sz, total_in = 0, total_out = 0;
+    unsigned long slice_crc;
+
+    if (NULL != crc) {
+        *crc = streamCksumInit(data_fmt);
+    }
+
+    while (in_left) {
+        in_sz = (in_left > slice) ? slice : in_left;
+        out_sz = out_left;
+        rc = qzCompressCrc(sess, src + total_in, &in_sz, dest + total_out,
+                           &out_sz, last && in_sz == in_left,
+                           crc ? &slice_crc : NULL);
+        total_in += in_sz;
+        total_out += out_sz;
+        in_left -= in_sz;
+        out_left -= out_sz;
+        if (NULL != crc) {
+            *crc = streamCksumCombine(data_fmt, *crc, slice_crc, in_sz);
+        }
+        if (QZ_OK != rc || 0 == in_sz) {
+            break;
+        }
+    }
+
+    *src_len = total_in;
+    *dest_len = total_out;
+    sess->total_in = total_in;
+    sess->total_out = total_out;
+    return rc;
+}
+
+/* Requests of sessions served by qzipd, a dictionary is only known
+ * to the process
+ */
+static inline int svcSession(QzSess_T *qz_sess)
+{
+    return NULL != qz_sess && qz_sess->svc_sid && NULL == qz_sess->dict;
+}
+
+/* qzipd went away under the session, set it up again to be served by
+ * the process as sw_backup allows
+ */
+static int svcFallback(QzSession_T *sess, unsigned int *src_len,
+                       unsigned int *dest_len, int rc)
+{
+    QzSess_T *qz_sess = (QzSess_T *)sess->internal;
+    QzSessionParams_T params;
+
+    if (QZ_SVC_LOST == rc) {
+        QZ_MEMCPY(&params, &qz_sess->sess_params, sizeof(params),
+                  sizeof(params));
+        rc = qzInit(sess, params.sw_backup);
+        if (!QZ_INIT_FAIL(rc)) {
+            rc = qzSetupSession(sess, &params);
+            rc = QZ_SETUP_SESSION_FAIL(rc) ? rc : QZ_SVC_LOST;
+        }
+    }
+
+    if (QZ_SVC_LOST != rc) {
+        *src_len = 0;
+        *dest_len = 0;
+    }
+    return rc;
+}
+
+/* Why a call of len bytes that the hardware path turned down goes to
+ * software
+ */
+static QzFallback_T fallbackReason(QzSession_T *sess, unsigned long len)
+{
+    QzSess_T *qz_sess = (QzSess_T *)sess->internal;
+
+    if (g_process.qz_init_status != QZ_OK ||
+        sess->hw_session_stat == QZ_NO_HW) {
+        return QZ_FALLBACK_NO_HW;
+    }
+    if (len < qz_sess->sess_params.input_sz_thrshold) {
+        return QZ_FALLBACK_SMALL;
+    }
+    return QZ_FALLBACK_UNSUPPORTED;
+}
+
 /* The QATzip compression API */
 int qzCompress(QzSession_T *sess, const unsigned char *src,
                unsigned int *src_len, unsigned char *dest,
@@ -1244,6 +2265,12 @@ int qzCompressCrc(QzSession_T *sess, const unsigned char *src,
 {
     int i, reqcnt;
     unsigned int out_len;
+    unsigned int out_avail;
+    unsigned int idx_len;
+    unsigned long hdr_sz = 0, ftr_sz = 0, idx_sz = 0;
+    unsigned long start, begin;
+    unsigned char faulted;
+    QzFallback_T why;
     QzSess_T *qz_sess;
     int rc;
 
@@ -1255,8 +2282,30 @@ int qzCompressCrc(QzSession_T *sess, const unsigned char *src,
         (last != 0 && last != 1)) {
         return QZ_PARAMS;
     }
+    begin = qzNowNsec();
+
+    if (svcSession(sess->internal)) {
+        rc = qzSvcCompress(sess, src, src_len, dest, dest_len, last, crc);
+        if (QZ_SVC_LOST != rc ||
+            QZ_SVC_LOST != (rc = svcFallback(sess, src_len, dest_len, rc))) {
+            return rc;
+        }
+    }
 
     if (0 == *src_len) {
+        qz_sess = (QzSess_T *)(sess->internal);
+        if (NULL != crc) {
+            *crc = streamCksumInit(qz_sess ? qz_sess->sess_params.data_fmt :
+                                   QZ_DATA_FORMAT_DEFAULT);
+        }
+        if (1 == last && NULL != qz_sess &&
+            (qz_sess->member_open ||
+             QZ_DEFLATE_GZIP_EXT != qz_sess->sess_params.data_fmt)) {
+            return qzCloseMember(qz_sess, dest, dest_len);
+        }
+        if (1 == last && NULL != qz_sess && qz_sess->idx_cnt) {
+            return qzIndexWrite(qz_sess, dest, dest_len);
+        }
         *dest_len = 0;
         return QZ_OK;
     }
@@ -1276,29 +2325,58 @@ int qzCompressCrc(QzSession_T *sess, const unsigned char *src,
     }
 
     qz_sess = (QzSess_T *)(sess->internal);
+    if (svcSession(qz_sess)) {
+        rc = qzSvcCompress(sess, src, src_len, dest, dest_len, last, crc);
+        if (QZ_SVC_LOST != rc ||
+            QZ_SVC_LOST != (rc = svcFallback(sess, src_len, dest_len, rc))) {
+            return rc;
+        }
+        qz_sess = (QzSess_T *)(sess->internal);
+    }
+    if (QZ_PRIORITY_BULK == qz_sess->sess_params.priority &&
+        *src_len > QZ_BULK_SLICE_CHUNKS * qz_sess->sess_params.hw_buff_sz) {
+        return qzCompressSlices(sess, src, src_len, dest, dest_len, last, crc);
+    }
+
     if (NULL != crc) {
-        *crc = 0;
+        *crc = streamCksumInit(qz_sess->sess_params.data_fmt);
     }
     qz_sess->crc32 = crc;
+    qz_sess->last = last;
+    qz_sess->timed_out = 0;
+    if (qzDeadlinePassed(qz_sess)) {
+        *src_len = 0;
+        *dest_len = 0;
+        return QZ_TIMEOUT;
+    }
     if (*src_len < qz_sess->sess_params.input_sz_thrshold ||
         g_process.qz_init_status == QZ_NO_HW              ||
         sess->hw_session_stat == QZ_NO_HW                 ||
-        qz_sess->sess_params.comp_lvl == 9) {
+        qz_sess->sess_params.comp_lvl == 9                ||
+        NULL != qz_sess->dict) {
         QZ_DEBUG("compression src_len=%u, sess_params.input_sz_thrshold = %u, "
                  "process.qz_init_status = %d, sess->hw_session_stat = %d, "
-                 "qz_sess->sess_params.comp_lvl = %d, switch to software.\n",
+                 "qz_sess->sess_params.comp_lvl = %d, dict_len = %u, "
+                 "switch to software.\n",
                  *src_len, qz_sess->sess_params.input_sz_thrshold,
                  g_process.qz_init_status, sess->hw_session_stat,
-                 qz_sess->sess_params.comp_lvl);
+                 qz_sess->sess_params.comp_lvl, qz_sess->dict_len);
+        why = fallbackReason(sess, *src_len);
         goto sw_compression;
+    } else if (g_process.qz_init_status == QZ_NOSW_NO_HW) {
+        /*sessions set up before a fork past max_forks lose hw as well*/
+        sess->hw_session_stat = QZ_NOSW_NO_HW;
+        return QZ_NOSW_NO_HW;
     } else if (sess->hw_session_stat != QZ_OK &&
                sess->hw_session_stat != QZ_NO_INST_ATTACH) {
         return sess->hw_session_stat;
     }
 
-    i = qzGrabInstance(qz_sess->inst_hint);
+    i = qzGrabInstanceWait(qz_sess->inst_hint, qzWaitBudget(qz_sess),
+                           qz_sess->sess_params.priority);
     if (i == -1) {
         if (qz_sess->sess_params.sw_backup == 1) {
+            why = QZ_FALLBACK_BUSY;
             goto sw_compression;
         } else {
             sess->hw_session_stat = QZ_NO_INST_ATTACH;
@@ -1317,6 +2395,7 @@ int qzCompressCrc(QzSession_T *sess, const unsigned char *src,
         if (QZ_OK != rc) {
             qzReleaseInstance(i);
             if (QZ_LOW_MEM == rc || QZ_NO_INST_ATTACH == rc) {
+                why = QZ_FALLBACK_SETUP;
                 goto sw_compression;
             } else {
                 return rc;
@@ -1324,9 +2403,6 @@ int qzCompressCrc(QzSession_T *sess, const unsigned char *src,
         }
     }
 
-#ifdef QATZIP_DEBUG
-    insertThread((unsigned int)pthread_self(), COMPRESSION, HW);
-#endif
     sess->total_in = 0;
     sess->total_out = 0;
     sess->thd_sess_stat = QZ_OK;
@@ -1342,24 +2418,95 @@ int qzCompressCrc(QzSession_T *sess, const unsigned char *src,
     qz_sess->seq_in = 0;
     qz_sess->src = (unsigned char *)src;
     qz_sess->src_sz = src_len;
-    qz_sess->dest_sz = dest_len;
     qz_sess->next_dest = (unsigned char *)dest;
 
-    reqcnt = *src_len / qz_sess->sess_params.hw_buff_sz;
-    if (*src_len % qz_sess->sess_params.hw_buff_sz) {
-        reqcnt++;
+    /*reserve the header and footer of a single stream*/
+    out_avail = *dest_len;
+    if (QZ_DEFLATE_GZIP_EXT != qz_sess->sess_params.data_fmt) {
+        hdr_sz = qz_sess->member_open ?
+                 0 : streamHeaderSz(qz_sess->sess_params.data_fmt);
+        ftr_sz = last ? streamFooterSz(qz_sess->sess_params.data_fmt) : 0;
+        if (out_avail <= hdr_sz + ftr_sz) {
+            qzReleaseInstance(i);
+            return QZ_BUF_ERROR;
+        }
+
+        out_avail -= hdr_sz + ftr_sz;
+        if (!qz_sess->member_open) {
+            streamHeaderGen(qz_sess->next_dest, &qz_sess->sess_params);
+            qz_sess->next_dest += hdr_sz;
+            qz_sess->qz_out_len += hdr_sz;
+            qz_sess->member_open = 1;
+            qz_sess->member_cksum =
+                streamCksumInit(qz_sess->sess_params.data_fmt);
+            qz_sess->member_len = 0;
+        }
+        /*hardware chunks are not primed, drop the software window*/
+        qz_sess->win_len = 0;
+    }
+    qz_sess->dest_sz = &out_avail;
+
+    qz_sess->chunk_sz = qzChunkSz(qz_sess, *src_len,
+                                  g_process.qz_inst[i].buff_sz,
+                                  g_process.qz_inst[i].dest_count,
+                                  qzLoadDevice(instDev(i)));
+    reqcnt = qzChunkCntMax(&qz_sess->sess_params, qz_sess->chunk_sz, *src_len);
+
+    /*reserve the seek index written after the last member*/
+    if (last && qz_sess->sess_params.index_trailer &&
+        QZ_DEFLATE_GZIP_EXT == qz_sess->sess_params.data_fmt) {
+        idx_sz = qzIndexSz(qz_sess->idx_cnt + reqcnt);
+        if (out_avail <= idx_sz) {
+            qzReleaseInstance(i);
+            return QZ_BUF_ERROR;
+        }
+        out_avail -= idx_sz;
     }
 
-    if (reqcnt > qz_sess->sess_params.req_cnt_thrshold) {
-        pthread_create(&(qz_sess->c_th_i), NULL, doCompressIn, (void *)sess);
+    start = qzNowNsec();
+    if (syncRequests(qz_sess, i, reqcnt)) {
+        doCompressIn((void *)sess);
         doCompressOut((void *)sess);
-        pthread_join(qz_sess->c_th_i, NULL);
     } else {
-        doCompressIn((void *)sess);
+        pthread_create(&(qz_sess->c_th_i), NULL, doCompressIn, (void *)sess);
         doCompressOut((void *)sess);
+        pthread_join(qz_sess->c_th_i, NULL);
     }
 
+    faulted = g_process.qz_inst[i].health.faulted;
+    qzInstHealthUpdate(i, qz_sess->submitted, start);
     qzReleaseInstance(i);
+
+    /*software takes over from an instance that failed before any output*/
+    if (faulted && 0 == qz_sess->qz_in_len &&
+        qz_sess->sess_params.sw_backup == 1) {
+        if (hdr_sz) {
+            qz_sess->member_open = 0;
+        }
+        why = QZ_FALLBACK_FAULT;
+        goto sw_compression;
+    }
+
+    if (last &&
+        QZ_DEFLATE_GZIP_EXT != qz_sess->sess_params.data_fmt &&
+        QZ_OK == sess->thd_sess_stat &&
+        qz_sess->qz_in_len == *src_len) {
+        streamFooterGen(qz_sess->next_dest, qz_sess->sess_params.data_fmt,
+                        qz_sess->member_cksum, qz_sess->member_len);
+        qz_sess->next_dest += ftr_sz;
+        qz_sess->qz_out_len += ftr_sz;
+        qz_sess->member_open = 0;
+    }
+
+    if (idx_sz &&
+        QZ_OK == sess->thd_sess_stat &&
+        qz_sess->qz_in_len == *src_len) {
+        idx_len = GET_LOWER_32BITS(idx_sz);
+        (void)qzIndexWrite(qz_sess, qz_sess->next_dest, &idx_len);
+        qz_sess->next_dest += idx_len;
+        qz_sess->qz_out_len += idx_len;
+    }
+
     out_len = qz_sess->next_dest - dest;
     QZ_DEBUG("PRoduced %d bytes\n", out_len);
     *dest_len = out_len;
@@ -1368,22 +2515,73 @@ int qzCompressCrc(QzSession_T *sess, const unsigned char *src,
     sess->total_out = qz_sess->qz_out_len;
     *src_len = GET_LOWER_32BITS(sess->total_in);
     assert(*dest_len == sess->total_out);
+    qzStatsHw(i, COMPRESSION, *src_len, *dest_len, begin);
 
 
+    if (QZ_OK == sess->thd_sess_stat && qz_sess->timed_out) {
+        return QZ_TIMEOUT;
+    }
     return sess->thd_sess_stat;
 
 sw_compression:
-    return qzSWCompress(sess, src, src_len, dest, dest_len, last);
+    QZ_PROBE3(sw_fallback, COMPRESSION, why, *src_len);
+    rc = qzSWCompress(sess, src, src_len, dest, dest_len, last);
+    qzStatsSw(COMPRESSION, why, rc, *src_len, *dest_len, begin);
+    return rc;
 }
 
-/*To handle compression expansion*/
-static void swapDataBuffer(unsigned long i, int j)
+/* Set up the session if needed and give the next call budget usec */
+static int qzSetDeadline(QzSession_T *sess, unsigned long budget)
 {
-    Cpa8U *p_tmp_data;
+    int rc;
 
-    p_tmp_data = g_process.qz_inst[i].src_buffers[j]->pBuffers->pData;
-    g_process.qz_inst[i].src_buffers[j]->pBuffers->pData =
-        g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData;
+    if (NULL == sess) {
+        return QZ_PARAMS;
+    }
+
+    /*check if init called*/
+    rc = qzInit(sess, getSwBackup(sess));
+    if (QZ_INIT_FAIL(rc)) {
+        return rc;
+    }
+
+    /*check if setupSession called*/
+    if (NULL == sess->internal) {
+        rc = qzSetupSession(sess, NULL);
+        if (QZ_SETUP_SESSION_FAIL(rc)) {
+            return rc;
+        }
+    }
+
+    ((QzSess_T *)sess->internal)->deadline = qzNowNsec() + budget * 1000;
+    return QZ_OK;
+}
+
+int qzCompressDeadline(QzSession_T *sess, const unsigned char *src,
+                       unsigned int *src_len, unsigned char *dest,
+                       unsigned int *dest_len, unsigned int last,
+                       unsigned long budget)
+{
+    int rc;
+
+    rc = qzSetDeadline(sess, budget);
+    if (QZ_OK != rc) {
+        return rc;
+    }
+
+    rc = qzCompressCrc(sess, src, src_len, dest, dest_len, last, NULL);
+    ((QzSess_T *)sess->internal)->deadline = 0;
+    return rc;
+}
+
+/*To handle compression expansion*/
+static void swapDataBuffer(unsigned long i, int j)
+{
+    Cpa8U *p_tmp_data;
+
+    p_tmp_data = g_process.qz_inst[i].src_buffers[j]->pBuffers->pData;
+    g_process.qz_inst[i].src_buffers[j]->pBuffers->pData =
+        g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData;
     g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData = p_tmp_data;
 }
 
@@ -1394,12 +2592,22 @@ static int checkHeader(QzSess_T *qz_sess, unsigned char *src,
     unsigned char *src_ptr = src;
     long src_send_sz, dest_recv_sz;
 
+    if (src_avail_len > 0 &&
+        qzIndexMemberSz(src_ptr, (unsigned long)src_avail_len)) {
+        return QZ_INDEX_MEMBER;
+    }
+
     if ((src_avail_len <= 0) || (dest_avail_len <= 0)) {
         QZ_DEBUG("doDecompressOut: insufficient %s buffer length\n",
                  (dest_avail_len <= 0) ? "destation" : "source");
         return QZ_BUF_ERROR;
     }
 
+    /*the hardware has no preset dictionary*/
+    if (src_avail_len >= qzDictHeaderSz() && isQzDictHeader(src_ptr)) {
+        return QZ_FORCE_SW;
+    }
+
     if (QZ_OK != qzGzipHeaderExt(src_ptr, hdr)) {
         return QZ_FAIL;
     }
@@ -1453,6 +2661,7 @@ static void *doDecompressIn(void *in)
     QzSession_T *sess = (QzSession_T *)in;
     QzSess_T *qz_sess = (QzSess_T *)sess->internal;
     QzGzF_T *qzFooter = NULL;
+    unsigned long idx_len;
 
     i = qz_sess->inst_hint;
     src_ptr = qz_sess->src;
@@ -1482,8 +2691,22 @@ static void *doDecompressIn(void *in)
             remaining = 0;
             break;
 
+        case QZ_INDEX_MEMBER:
+            /*the seek index carries no data*/
+            idx_len = qzIndexMemberSz(src_ptr, (unsigned long)src_avail_len);
+            sess->thd_sess_stat = QZ_OK;
+            sess->total_in  += idx_len;
+            src_ptr         += idx_len;
+            src_avail_len   -= idx_len;
+            remaining       -= idx_len;
+            break;
+
         case QZ_LOW_MEM:
         case QZ_FORCE_SW:
+            /*a member too large for the buffers or with a dictionary*/
+            QZ_PROBE3(sw_fallback, DECOMPRESSION, QZ_FALLBACK_UNSUPPORTED,
+                      src_avail_len);
+            qzStatsFallback(QZ_FALLBACK_UNSUPPORTED);
             tmp_src_avail_len = src_avail_len;
             tmp_dest_avail_len = dest_avail_len;
             rc = qzSWDecompress(sess,
@@ -1497,6 +2720,13 @@ static void *doDecompressIn(void *in)
                 break;
             }
 
+            /*the member checksum is combined in output order here*/
+            if (NULL != qz_sess->crc32) {
+                *(qz_sess->crc32) = crc32_combine(*(qz_sess->crc32),
+                                                  qz_sess->inflate_strm->adler,
+                                                  qz_sess->inflate_strm->total_out);
+            }
+
             sess->total_in  += qz_sess->inflate_strm->total_in;
             sess->total_out += qz_sess->inflate_strm->total_out;
             src_ptr         += qz_sess->inflate_strm->total_in;
@@ -1542,6 +2772,11 @@ static void *doDecompressIn(void *in)
             qzFooter = (QzGzF_T *)(src_ptr + src_send_sz);
             g_process.qz_inst[i].stream[j].gzip_footer_checksum = qzFooter->crc32;
             g_process.qz_inst[i].stream[j].gzip_footer_orgdatalen = qzFooter->i_size;
+            if (NULL != qz_sess->crc32) {
+                *(qz_sess->crc32) = crc32_combine(*(qz_sess->crc32),
+                                                  qzFooter->crc32,
+                                                  qzFooter->i_size);
+            }
             qz_sess->submitted++;
             /*send to compression engine here*/
             g_process.qz_inst[i].stream[j].src2++;/*this buffer is in use*/
@@ -1561,6 +2796,7 @@ static void *doDecompressIn(void *in)
                 g_process.qz_inst[i].src_buffers[j]->pBuffers->pData = src_ptr;
             }
 
+            g_process.qz_inst[i].stream[j].next_dest = dest_ptr;
             if (0 == dest_pinned) {
                 g_process.qz_inst[i].stream[j].dest_pinned = 0;
             } else {
@@ -1570,6 +2806,13 @@ static void *doDecompressIn(void *in)
                 g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData = dest_ptr;
             }
 
+            QZ_PROBE4(decomp_submit, i, j, g_process.qz_inst[i].stream[j].seq,
+                      g_process.qz_inst[i].src_buffers[j]->pBuffers->dataLenInBytes);
+            if (g_process.fail_submits) {
+                g_process.fail_submits--;
+                QZ_ERROR("Error in cpaDcDecompressData: injected\n");
+                goto err_exit;
+            }
             do {
                 tag = (i << 16) | j;
                 QZ_DEBUG("Decomp Sending i = %ld j = %d seq = %ld tag = %ld\n",
@@ -1584,13 +2827,13 @@ static void *doDecompressIn(void *in)
                                          (void *)(tag));
                 QZ_DEBUG("mw>> %s():  DcDecompressData() rc = %d\n", __func__, rc);
                 if (CPA_STATUS_RETRY == rc) {
-                    g_process.qz_inst[i].num_retries++;
+                    countRetry(i);
                     usleep(qz_sess->sess_params.poll_sleep);
                 }
 
-                if (g_process.qz_inst[i].num_retries > MAX_NUM_RETRY) {
+                if (g_process.qz_inst[i].num_retries > qzRetryMax(i)) {
                     QZ_ERROR("instance %d retry count:%d exceed the max count: %d\n",
-                             i, g_process.qz_inst[i].num_retries, MAX_NUM_RETRY);
+                             i, g_process.qz_inst[i].num_retries, qzRetryMax(i));
                     goto err_exit;
                 }
             } while (rc == CPA_STATUS_RETRY);
@@ -1604,9 +2847,8 @@ static void *doDecompressIn(void *in)
             src_avail_len -= (qzGzipHeaderSz() + src_send_sz + qzGzipFooterSz());
             dest_avail_len -= dest_receive_sz;
 
-            if (dest_pinned) {
-                dest_ptr += dest_receive_sz;
-            }
+            /*members decompressed in software land after this one*/
+            dest_ptr += dest_receive_sz;
 
             src_ptr += (src_send_sz + qzGzipFooterSz());
             remaining -= (src_send_sz + qzGzipFooterSz());
@@ -1618,6 +2860,11 @@ static void *doDecompressIn(void *in)
             break;
         }
 
+        if (remaining && qzDeadlinePassed(qz_sess)) {
+            qz_sess->timed_out = 1;
+            remaining = 0;
+        }
+
         if (qz_sess->stop_submitting) {
             remaining = 0;
         }
@@ -1633,10 +2880,20 @@ static void *doDecompressIn(void *in)
 
 err_exit:
     /*roll back last submit*/
+    instFault(i);
     qz_sess->last_submitted = 1;
     qz_sess->submitted -= 1;
     g_process.qz_inst[i].stream[j].src1 -= 1;
     g_process.qz_inst[i].stream[j].src2 -= 1;
+    if (1 == g_process.qz_inst[i].stream[j].src_pinned) {
+        g_process.qz_inst[i].src_buffers[j]->pBuffers->pData =
+            g_process.qz_inst[i].stream[j].orig_src;
+    }
+    if (1 == g_process.qz_inst[i].stream[j].dest_pinned) {
+        g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData =
+            g_process.qz_inst[i].stream[j].orig_dest;
+    }
+    swapDataBuffer(i, j);
     qz_sess->seq -= 1;
     sess->thd_sess_stat = QZ_FAIL;
     return ((void *)NULL);
@@ -1666,6 +2923,7 @@ static void *doDecompressOut(void *in)
         sts = icp_sal_DcPollInstance(g_process.dc_inst_handle[i], 1);
         if (CPA_STATUS_FAIL == sts) {
             QZ_ERROR("Error in DcPoll: %d\n", sts);
+            instFault(i);
             sess->thd_sess_stat = QZ_FAIL;
             qz_sess->stop_submitting = 1;
             return NULL;
@@ -1697,7 +2955,10 @@ static void *doDecompressOut(void *in)
                 resl = &g_process.qz_inst[i].stream[j].res;
                 QZ_DEBUG("\tconsumed = %d, produced = %d, seq_in = %ld\n",
                          resl->consumed, resl->produced, g_process.qz_inst[i].stream[j].seq);
+                QZ_PROBE5(decomp_retire, i, j, g_process.qz_inst[i].stream[j].seq,
+                          resl->consumed, resl->produced);
 
+                qz_sess->next_dest = g_process.qz_inst[i].stream[j].next_dest;
                 if (0 == g_process.qz_inst[i].stream[j].dest_pinned) {
                     QZ_DEBUG("memory copy in doDecompressOut\n");
                     QZ_MEMCPY(qz_sess->next_dest,
@@ -1756,13 +3017,217 @@ err_checkfooter:
     return ((void *)NULL);
 }
 
+/* Decompress a raw deflate body with a single hardware request, the
+ * output must fit in one hardware buffer. Any failure is reported as
+ * QZ_FAIL and left to the software path
+ */
+static int doDecompressSingle(QzSession_T *sess, int i,
+                              const unsigned char *src, unsigned int *src_len,
+                              unsigned char *dest, unsigned int *dest_len)
+{
+    int j = -1;
+    int rc = QZ_FAIL;
+    unsigned long tag;
+    CpaStatus sts;
+    CpaDcRqResults *resl;
+    QzSess_T *qz_sess = (QzSess_T *)sess->internal;
+
+    while (-1 == j) {
+        struct timespec my_time;
+        my_time.tv_sec = 0;
+        my_time.tv_nsec = 10;
+        j = getUnusedBuffer(i, j);
+        if (-1 == j) {
+            nanosleep(&my_time, NULL);
+        }
+    }
+
+    g_process.qz_inst[i].stream[j].src1++;/*this buffer is in use*/
+    swapDataBuffer(i, j);
+    QZ_MEMCPY(g_process.qz_inst[i].src_buffers[j]->pBuffers->pData,
+              src,
+              DEST_SZ(qz_sess->sess_params.hw_buff_sz),
+              *src_len);
+    g_process.qz_inst[i].src_buffers[j]->pBuffers->dataLenInBytes = *src_len;
+    g_process.qz_inst[i].dest_buffers[j]->pBuffers->dataLenInBytes =
+        qz_sess->sess_params.hw_buff_sz;
+    g_process.qz_inst[i].stream[j].src_pinned = 0;
+    g_process.qz_inst[i].stream[j].dest_pinned = 0;
+    g_process.qz_inst[i].stream[j].src2++;
+
+    tag = ((unsigned long)i << 16) | j;
+    QZ_PROBE4(decomp_submit, i, j, g_process.qz_inst[i].stream[j].seq,
+              g_process.qz_inst[i].src_buffers[j]->pBuffers->dataLenInBytes);
+    do {
+        sts = cpaDcDecompressData(g_process.dc_inst_handle[i],
+                                  g_process.qz_inst[i].cpaSess,
+                                  g_process.qz_inst[i].src_buffers[j],
+                                  g_process.qz_inst[i].dest_buffers[j],
+                                  &g_process.qz_inst[i].stream[j].res,
+                                  CPA_DC_FLUSH_FINAL,
+                                  (void *)(tag));
+        if (CPA_STATUS_RETRY == sts) {
+            countRetry(i);
+            usleep(qz_sess->sess_params.poll_sleep);
+        }
+    } while (CPA_STATUS_RETRY == sts &&
+             g_process.qz_inst[i].num_retries <= qzRetryMax(i));
+
+    if (CPA_STATUS_SUCCESS != sts) {
+        QZ_DEBUG("doDecompressSingle: cpaDcDecompressData returned %d\n", sts);
+        goto err_exit;
+    }
+
+    /*poll for the response*/
+    while (g_process.qz_inst[i].stream[j].sink1 ==
+           g_process.qz_inst[i].stream[j].sink2) {
+        sts = icp_sal_DcPollInstance(g_process.dc_inst_handle[i], 1);
+        if (CPA_STATUS_FAIL == sts) {
+            QZ_ERROR("Error in DcPoll: %d\n", sts);
+            goto err_exit;
+        }
+
+        if (g_process.qz_inst[i].stream[j].sink1 ==
+            g_process.qz_inst[i].stream[j].sink2) {
+            usleep(qz_sess->sess_params.poll_sleep);
+        }
+    }
+
+    resl = &g_process.qz_inst[i].stream[j].res;
+    if (CPA_STATUS_SUCCESS == g_process.qz_inst[i].stream[j].job_status &&
+        CPA_TRUE == resl->endOfLastBlock &&
+        resl->produced <= *dest_len) {
+        QZ_MEMCPY(dest,
+                  g_process.qz_inst[i].dest_buffers[j]->pBuffers->pData,
+                  *dest_len,
+                  resl->produced);
+        *src_len = resl->consumed;
+        *dest_len = resl->produced;
+        rc = QZ_OK;
+    }
+
+    swapDataBuffer(i, j); /*swap pdata back after decompress*/
+    g_process.qz_inst[i].stream[j].sink2++;
+    return rc;
+
+err_exit:
+    /*roll back the submit, the slot is free again*/
+    instFault(i);
+    g_process.qz_inst[i].stream[j].src1 -= 1;
+    g_process.qz_inst[i].stream[j].src2 -= 1;
+    swapDataBuffer(i, j);
+    return QZ_FAIL;
+}
+
+/* Decompress one raw deflate or zlib stream. A stream that fits in one
+ * hardware buffer goes to QAT as a single request, the rest and every
+ * hardware failure is decompressed by software
+ */
+static int qzDecompressStream(QzSession_T *sess, const unsigned char *src,
+                              unsigned int *src_len, unsigned char *dest,
+                              unsigned int *dest_len, unsigned long begin)
+{
+    int i, rc;
+    unsigned int hdr_sz = 0, ftr_sz = 0;
+    unsigned int body_len, out_len;
+    const unsigned char *ftr;
+    unsigned long cksum, start;
+    QzFallback_T why;
+    QzSess_T *qz_sess = (QzSess_T *)sess->internal;
+
+    if (QZ_DEFLATE_ZLIB == qz_sess->sess_params.data_fmt) {
+        hdr_sz = ZLIB_HDR_SZ;
+        ftr_sz = ZLIB_FTR_SZ;
+    }
+
+    if (*src_len < qz_sess->sess_params.input_sz_thrshold              ||
+        *src_len <= hdr_sz + ftr_sz                                     ||
+        *src_len - hdr_sz > DEST_SZ(qz_sess->sess_params.hw_buff_sz)    ||
+        g_process.qz_init_status != QZ_OK                               ||
+        sess->hw_session_stat == QZ_NO_HW                               ||
+        NULL != qz_sess->dict                                           ||
+        (hdr_sz && QZ_OK != zlibHeaderExt(src))) {
+        why = fallbackReason(sess, *src_len);
+        goto sw_decompression;
+    }
+
+    i = qzGrabInstanceWait(qz_sess->inst_hint, qzWaitBudget(qz_sess),
+                           qz_sess->sess_params.priority);
+    if (i == -1) {
+        why = QZ_FALLBACK_BUSY;
+        goto sw_decompression;
+    }
+    qz_sess->inst_hint = i;
+
+    if (0 ==  g_process.qz_inst[i].mem_setup ||
+        0 ==  g_process.qz_inst[i].cpa_sess_setup) {
+        rc = qzSetupHW(sess, i);
+        if (QZ_OK != rc) {
+            qzReleaseInstance(i);
+            why = QZ_FALLBACK_SETUP;
+            goto sw_decompression;
+        }
+    }
+
+    body_len = *src_len - hdr_sz;
+    out_len = *dest_len;
+    start = qzNowNsec();
+    rc = doDecompressSingle(sess, i, src + hdr_sz, &body_len, dest, &out_len);
+    qzInstHealthUpdate(i, 1, start);
+    qzReleaseInstance(i);
+    if (QZ_OK != rc || hdr_sz + body_len + ftr_sz > *src_len) {
+        why = QZ_FALLBACK_FAULT;
+        goto sw_decompression;
+    }
+
+    if (ftr_sz) {
+        ftr = src + hdr_sz + body_len;
+        cksum = adler32(adler32(0, NULL, 0), dest, out_len);
+        if (cksum != (((unsigned long)ftr[0] << 24) | (ftr[1] << 16) |
+                      (ftr[2] << 8) | ftr[3])) {
+            why = QZ_FALLBACK_FAULT;
+            goto sw_decompression;
+        }
+    } else if (NULL != qz_sess->crc32) {
+        /*raw deflate carries no checksum*/
+        cksum = crc32(0, dest, out_len);
+    }
+
+    if (NULL != qz_sess->crc32) {
+        *(qz_sess->crc32) = cksum;
+    }
+
+    *src_len = hdr_sz + body_len + ftr_sz;
+    *dest_len = out_len;
+    sess->total_in = *src_len;
+    sess->total_out = *dest_len;
+    qzStatsHw(i, DECOMPRESSION, *src_len, *dest_len, begin);
+    return QZ_OK;
+
+sw_decompression:
+    QZ_PROBE3(sw_fallback, DECOMPRESSION, why, *src_len);
+    rc = qzSWDecompressStream(sess, src, src_len, dest, dest_len);
+    qzStatsSw(DECOMPRESSION, why, rc, *src_len, *dest_len, begin);
+    return rc;
+}
+
 /* The QATzip decompression API */
 int qzDecompress(QzSession_T *sess, const unsigned char *src,
                  unsigned int *src_len, unsigned char *dest,
                  unsigned int *dest_len)
+{
+    return qzDecompressCrc(sess, src, src_len, dest, dest_len, NULL);
+}
+
+int qzDecompressCrc(QzSession_T *sess, const unsigned char *src,
+                    unsigned int *src_len, unsigned char *dest,
+                    unsigned int *dest_len, unsigned long *crc)
 {
     int rc;
     int i, reqcnt;
+    unsigned long start, begin;
+    unsigned char faulted;
+    QzFallback_T why;
     QzSess_T *qz_sess;
     QzGzH_T *hdr = (QzGzH_T *)src;
 
@@ -1773,8 +3238,14 @@ int qzDecompress(QzSession_T *sess, const unsigned char *src,
         NULL == dest_len) {
         return QZ_PARAMS;
     }
+    begin = qzNowNsec();
 
     if (0 == *src_len) {
+        if (NULL != crc) {
+            qz_sess = (QzSess_T *)(sess->internal);
+            *crc = streamCksumInit(qz_sess ? qz_sess->sess_params.data_fmt :
+                                   QZ_DATA_FORMAT_DEFAULT);
+        }
         *dest_len = 0;
         return QZ_OK;
     }
@@ -1794,25 +3265,55 @@ int qzDecompress(QzSession_T *sess, const unsigned char *src,
     }
 
     qz_sess = (QzSess_T *)(sess->internal);
+    if (svcSession(qz_sess) && qzSvcDecompressible(qz_sess, src, *src_len, *dest_len)) {
+        rc = qzSvcDecompress(sess, src, src_len, dest, dest_len, crc);
+        if (QZ_SVC_LOST != rc ||
+            QZ_SVC_LOST != (rc = svcFallback(sess, src_len, dest_len, rc))) {
+            return rc;
+        }
+    }
+    if (NULL != crc) {
+        *crc = streamCksumInit(qz_sess->sess_params.data_fmt);
+    }
+    qz_sess->crc32 = crc;
+    qz_sess->timed_out = 0;
+    if (qzDeadlinePassed(qz_sess)) {
+        *src_len = 0;
+        *dest_len = 0;
+        return QZ_TIMEOUT;
+    }
+    if (QZ_DEFLATE_RAW == qz_sess->sess_params.data_fmt ||
+        QZ_DEFLATE_ZLIB == qz_sess->sess_params.data_fmt) {
+        return qzDecompressStream(sess, src, src_len, dest, dest_len, begin);
+    }
+
     if (hdr->extra.qz_e.src_sz < qz_sess->sess_params.input_sz_thrshold ||
         g_process.qz_init_status == QZ_NO_HW                            ||
         sess->hw_session_stat == QZ_NO_HW                               ||
-        isStdGzipHeader(src)) {
+        isStdGzipHeader(src)                                            ||
+        (*src_len >= qzDictHeaderSz() && isQzDictHeader(src))) {
         QZ_DEBUG("decompression src_len=%u, hdr->extra.qz_e.src_sz = %u, "
                  "g_process.qz_init_status = %d, sess->hw_session_stat = %d, "
                  "isStdGzipHeader = %d, switch to software.\n",
                  *src_len,  hdr->extra.qz_e.src_sz,
                  g_process.qz_init_status, sess->hw_session_stat,
                  isStdGzipHeader(src));
+        why = fallbackReason(sess, hdr->extra.qz_e.src_sz);
         goto sw_decompression;
+    } else if (g_process.qz_init_status == QZ_NOSW_NO_HW) {
+        /*sessions set up before a fork past max_forks lose hw as well*/
+        sess->hw_session_stat = QZ_NOSW_NO_HW;
+        return QZ_NOSW_NO_HW;
     } else if (sess->hw_session_stat != QZ_OK &&
                sess->hw_session_stat != QZ_NO_INST_ATTACH) {
         return sess->hw_session_stat;
     }
 
-    i = qzGrabInstance(qz_sess->inst_hint);
+    i = qzGrabInstanceWait(qz_sess->inst_hint, qzWaitBudget(qz_sess),
+                           qz_sess->sess_params.priority);
     if (i == -1) {
         if (qz_sess->sess_params.sw_backup == 1) {
+            why = QZ_FALLBACK_BUSY;
             goto sw_decompression;
         } else {
             sess->hw_session_stat = QZ_NO_INST_ATTACH;
@@ -1830,6 +3331,7 @@ int qzDecompress(QzSession_T *sess, const unsigned char *src,
         if (QZ_OK != rc) {
             qzReleaseInstance(i);
             if (QZ_LOW_MEM == rc || QZ_NO_INST_ATTACH == rc) {
+                why = QZ_FALLBACK_SETUP;
                 goto sw_decompression;
             } else {
                 return rc;
@@ -1837,9 +3339,6 @@ int qzDecompress(QzSession_T *sess, const unsigned char *src,
         }
     }
 
-#ifdef QATZIP_DEBUG
-    insertThread((unsigned int)pthread_self(), DECOMPRESSION, HW);
-#endif
     sess->total_in = 0;
     sess->total_out = 0;
     sess->thd_sess_stat = QZ_OK;
@@ -1856,33 +3355,196 @@ int qzDecompress(QzSession_T *sess, const unsigned char *src,
     qz_sess->dest_sz = dest_len;
     qz_sess->next_dest = (unsigned char *)dest;
 
-    reqcnt = *src_len / (qz_sess->sess_params.hw_buff_sz / 2);
-    if (*src_len % (qz_sess->sess_params.hw_buff_sz / 2)) {
-        reqcnt++;
-    }
+    reqcnt = memberCnt(src, *src_len, qz_sess->sess_params.req_cnt_thrshold);
 
-    if (reqcnt > qz_sess->sess_params.req_cnt_thrshold) {
-        pthread_create(&(qz_sess->c_th_i), NULL, doDecompressIn, (void *)sess);
+    start = qzNowNsec();
+    if (syncRequests(qz_sess, i, reqcnt)) {
+        doDecompressIn((void *)sess);
         doDecompressOut((void *)sess);
-        pthread_join(qz_sess->c_th_i, NULL);
     } else {
-        doDecompressIn((void *)sess);
+        pthread_create(&(qz_sess->c_th_i), NULL, doDecompressIn, (void *)sess);
         doDecompressOut((void *)sess);
+        pthread_join(qz_sess->c_th_i, NULL);
     }
 
+    faulted = g_process.qz_inst[i].health.faulted;
+    qzInstHealthUpdate(i, qz_sess->submitted, start);
     qzReleaseInstance(i);
 
+    /*software takes over from an instance that failed before any output*/
+    if (faulted && 0 == qz_sess->qz_in_len &&
+        qz_sess->sess_params.sw_backup == 1) {
+        /*forget the members folded in at submit, software folds them all*/
+        if (NULL != crc) {
+            *crc = streamCksumInit(qz_sess->sess_params.data_fmt);
+        }
+        why = QZ_FALLBACK_FAULT;
+        goto sw_decompression;
+    }
+
     QZ_DEBUG("PRoduced %d bytes\n", sess->total_out);
     sess->total_in += qz_sess->qz_in_len;
     sess->total_out += qz_sess->qz_out_len;
     *src_len = GET_LOWER_32BITS(sess->total_in);
     *dest_len = GET_LOWER_32BITS(sess->total_out);
+    qzStatsHw(i, DECOMPRESSION, *src_len, *dest_len, begin);
 
     rc = checkSessionState(sess);
+    if (QZ_OK == rc && qz_sess->timed_out) {
+        rc = QZ_TIMEOUT;
+    }
     return rc;
 
 sw_decompression:
-    return qzSWDecompressMultiGzip(sess, src, src_len, dest, dest_len);
+    QZ_PROBE3(sw_fallback, DECOMPRESSION, why, *src_len);
+    rc = qzSWDecompressMultiGzip(sess, src, src_len, dest, dest_len);
+    qzStatsSw(DECOMPRESSION, why, rc, *src_len, *dest_len, begin);
+    return rc;
+}
+
+int qzDecompressDeadline(QzSession_T *sess, const unsigned char *src,
+                         unsigned int *src_len, unsigned char *dest,
+                         unsigned int *dest_len, unsigned long budget)
+{
+    int rc;
+
+    rc = qzSetDeadline(sess, budget);
+    if (QZ_OK != rc) {
+        return rc;
+    }
+
+    rc = qzDecompressCrc(sess, src, src_len, dest, dest_len, NULL);
+    ((QzSess_T *)sess->internal)->deadline = 0;
+    return rc;
+}
+
+/* Find the members holding [off, end) from the seek index when the stream
+ * carries one, else by walking the member headers. Leaves an empty span
+ * when off is past the end of the stream.
+ */
+static int qzFindSpan(const unsigned char *src, unsigned long src_len,
+                      unsigned long off, unsigned long end,
+                      unsigned long *c_start, unsigned long *c_end,
+                      unsigned long *u_start, unsigned long *u_end)
+{
+    QzIndex_T index;
+    unsigned long pos, len, u_off, u_sz;
+    long k0, k1;
+    int found = 0;
+
+    *c_start = *c_end = *u_start = *u_end = 0;
+
+    if (QZ_OK == qzIndexLoad(src, src_len, &index)) {
+        k0 = qzIndexLookup(&index, off);
+        if (k0 >= 0) {
+            if (end > index.u_off[index.cnt]) {
+                end = index.u_off[index.cnt];
+            }
+            k1 = qzIndexLookup(&index, end - 1);
+            *c_start = index.c_off[k0];
+            *c_end = index.c_off[k1 + 1];
+            *u_start = index.u_off[k0];
+            *u_end = index.u_off[k1 + 1];
+        }
+        qzIndexFree(&index);
+        return QZ_OK;
+    }
+
+    for (pos = 0, u_off = 0; pos < src_len && u_off < end; pos += len) {
+        len = qzIndexMemberSz(src + pos, src_len - pos);
+        if (len) {
+            continue;
+        }
+
+        len = qzGzipMemberSz(src + pos, src_len - pos, &u_sz);
+        if (0 == len) {
+            QZ_DEBUG("qzFindSpan: no QZ member at %lu\n", pos);
+            return (0 == pos) ? QZ_FAIL : QZ_DATA_ERROR;
+        }
+
+        if (!found && u_off + u_sz > off) {
+            *c_start = pos;
+            *u_start = u_off;
+            found = 1;
+        }
+        u_off += u_sz;
+        if (found) {
+            *c_end = pos + len;
+            *u_end = u_off;
+        }
+    }
+
+    return QZ_OK;
+}
+
+int qzDecompressRange(QzSession_T *sess, const unsigned char *src,
+                      unsigned int src_len, unsigned long off,
+                      unsigned int *len, unsigned char *dest)
+{
+    int rc;
+    QzSess_T *qz_sess;
+    unsigned long c_start, c_end, u_start, u_end, end;
+    unsigned int in_len, out_len;
+    unsigned char *out = dest;
+
+    if (NULL == sess                 || \
+        NULL == src                  || \
+        NULL == len                  || \
+        NULL == dest) {
+        return QZ_PARAMS;
+    }
+
+    qz_sess = (QzSess_T *)(sess->internal);
+    if (NULL != qz_sess &&
+        (QZ_DEFLATE_RAW == qz_sess->sess_params.data_fmt ||
+         QZ_DEFLATE_ZLIB == qz_sess->sess_params.data_fmt)) {
+        return QZ_PARAMS;
+    }
+
+    end = off + *len;
+    if (0 == *len || 0 == src_len) {
+        *len = 0;
+        return QZ_OK;
+    }
+
+    rc = qzFindSpan(src, src_len, off, end, &c_start, &c_end, &u_start, &u_end);
+    if (QZ_OK != rc) {
+        return rc;
+    }
+    if (u_end <= off) {
+        *len = 0;
+        return QZ_OK;
+    }
+    if (end > u_end) {
+        end = u_end;
+    }
+
+    /*members straddling the range are inflated aside*/
+    if (u_start != off || u_end != end) {
+        out = malloc(u_end - u_start);
+        if (NULL == out) {
+            return QZ_FAIL;
+        }
+    }
+
+    in_len = GET_LOWER_32BITS(c_end - c_start);
+    out_len = GET_LOWER_32BITS(u_end - u_start);
+    rc = qzDecompress(sess, src + c_start, &in_len, out, &out_len);
+    if (QZ_OK == rc && out_len != u_end - u_start) {
+        rc = QZ_DATA_ERROR;
+    }
+
+    if (QZ_OK == rc) {
+        if (out != dest) {
+            QZ_MEMCPY(dest, out + (off - u_start), end - off, end - off);
+        }
+        *len = GET_LOWER_32BITS(end - off);
+    }
+
+    if (out != dest) {
+        free(out);
+    }
+    return rc;
 }
 
 int qzTeardownSession(QzSession_T *sess)
@@ -1898,6 +3560,16 @@ int qzTeardownSession(QzSession_T *sess)
             qz_sess->inflate_strm = NULL;
         }
 
+        free(qz_sess->win);
+        qz_sess->win = NULL;
+        free(qz_sess->idx_ent);
+        qz_sess->idx_ent = NULL;
+        free(qz_sess->dict);
+        qz_sess->dict = NULL;
+        qzCacheDestroy(qz_sess->cache);
+        qz_sess->cache = NULL;
+        qzSvcClose(qz_sess);
+
         free(sess->internal);
         sess->internal = NULL;
     }
@@ -1905,6 +3577,53 @@ int qzTeardownSession(QzSession_T *sess)
     return QZ_OK;
 }
 
+int qzSetDictionary(QzSession_T *sess, const unsigned char *dict,
+                    unsigned int dict_len)
+{
+    QzSess_T *qz_sess;
+    unsigned char *copy = NULL;
+
+    if (NULL == sess || NULL == sess->internal || (NULL == dict && dict_len)) {
+        return QZ_PARAMS;
+    }
+
+    qz_sess = (QzSess_T *)sess->internal;
+    if (qz_sess->member_open ||
+        (dict_len && QZ_DEFLATE_GZIP == qz_sess->sess_params.data_fmt)) {
+        return QZ_PARAMS;
+    }
+
+    if (dict_len) {
+        copy = malloc(dict_len);
+        if (NULL == copy) {
+            return QZ_FAIL;
+        }
+        memcpy(copy, dict, dict_len);
+    }
+
+    free(qz_sess->dict);
+    qz_sess->dict = copy;
+    qz_sess->dict_len = dict_len;
+    qz_sess->dict_id = dict_len ? adler32(adler32(0, NULL, 0), dict, dict_len) : 0;
+    return QZ_OK;
+}
+
+int qzGetCacheStats(QzSession_T *sess, QzCacheStats_T *stats)
+{
+    QzSess_T *qz_sess;
+
+    if (NULL == sess || NULL == sess->internal || NULL == stats) {
+        return QZ_PARAMS;
+    }
+
+    qz_sess = (QzSess_T *)sess->internal;
+    memset(stats, 0, sizeof(QzCacheStats_T));
+    if (NULL != qz_sess->cache) {
+        qzCacheStats(qz_sess->cache, stats);
+    }
+    return QZ_OK;
+}
+
 void removeSession(int i)
 {
     CpaStatus status = CPA_STATUS_SUCCESS;
@@ -1953,12 +3672,116 @@ int qzClose(QzSession_T *sess)
     return QZ_OK;
 }
 
+/* PCI device ids of the QAT physical functions */
+static const unsigned int g_qat_pci_ids[] = {
+    0x0435, 0x37c8, 0x19e2, 0x18ee, 0x4940, 0x4942
+};
+
+static unsigned long readSysfsHex(const char *path)
+{
+    FILE *fp;
+    long val = 0;
+
+    fp = fopen(path, "r");
+    if (NULL == fp) {
+        return 0;
+    }
+    if (1 != fscanf(fp, "%li", &val) || val < 0) {
+        val = 0;
+    }
+    fclose(fp);
+    return (unsigned long)val;
+}
+
+/* Count QAT physical functions on the PCI bus */
+static unsigned int qatPciCount(void)
+{
+    DIR *dir;
+    struct dirent *ent;
+    char path[PATH_MAX];
+    unsigned long dev;
+    unsigned int i, cnt = 0;
+
+    dir = opendir("/sys/bus/pci/devices");
+    if (NULL == dir) {
+        return 0;
+    }
+
+    while (NULL != (ent = readdir(dir))) {
+        if ('.' == ent->d_name[0]) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/vendor",
+                 ent->d_name);
+        if (0x8086 != readSysfsHex(path)) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/device",
+                 ent->d_name);
+        dev = readSysfsHex(path);
+        for (i = 0; i < sizeof(g_qat_pci_ids) / sizeof(g_qat_pci_ids[0]); i++) {
+            if (dev == g_qat_pci_ids[i]) {
+                cnt++;
+                break;
+            }
+        }
+    }
+
+    closedir(dir);
+    return cnt;
+}
+
 int qzGetStatus(QzSession_T *sess, QzStatus_T *status)
 {
+    unsigned char seen[QAT_MAX_DEVICES + 1] = {0};
+    unsigned char deflate[QAT_MAX_DEVICES + 1] = {0};
+    unsigned int i, dev, devices = 0;
+    unsigned long pinned = 0;
+    QzSess_T *qz_sess;
+
     if (sess == NULL || status == NULL) {
         return QZ_PARAMS;
     }
 
+    memset(status, 0, sizeof(QzStatus_T));
+    qz_sess = (QzSess_T *)sess->internal;
+
+    __sync_synchronize();
+    if (1 == g_process.qz_init_called && NULL != g_process.qz_inst) {
+        status->qat_service_stated = (QZ_OK == g_process.qz_init_status);
+        for (i = 0; i < g_process.num_instances; i++) {
+            dev = instDev(i);
+            dev = dev > QAT_MAX_DEVICES ? QAT_MAX_DEVICES : dev;
+            if (!seen[dev]) {
+                seen[dev] = 1;
+                devices++;
+            }
+            if (g_process.qz_inst[i].instance_cap.statelessDeflateCompression &&
+                !deflate[dev]) {
+                deflate[dev] = 1;
+                status->algo_hw[QZ_DEFLATE]++;
+            }
+            pinned += QZ_STAT_GET(g_process.qz_inst[i].pinned_sz);
+        }
+    }
+
+    status->qat_hw_count = qatPciCount();
+    if (devices > status->qat_hw_count) {
+        status->qat_hw_count = devices;
+    }
+    if (pinned) {
+        status->qat_mem_drvr = 2;
+    } else if (0 == access("/dev/usdm_drv", F_OK) ||
+               0 == access("/dev/qat_mem", F_OK)) {
+        status->qat_mem_drvr = 1;
+    }
+    status->qat_instance_attach = (NULL != qz_sess && qz_sess->inst_hint >= 0);
+    status->memory_alloced = pinned / 1024;
+    status->using_huge_pages =
+        (readSysfsHex("/sys/module/usdm_drv/parameters/max_huge_pages") > 0);
+    status->hw_session_status = sess->hw_session_stat;
+    status->algo_sw[QZ_DEFLATE] = 1;
+
     return QZ_OK;
 }
 
@@ -2008,3 +3831,43 @@ unsigned int qzMaxCompressedLength(unsigned int src_sz)
 
     return dest_sz;
 }
+
+int qzDecompressedLength(const unsigned char *src, unsigned int src_len,
+                         unsigned long *out_len, unsigned int *members)
+{
+    QzIndex_T index;
+    unsigned long pos, len, u_sz;
+
+    if (NULL == src                  || \
+        NULL == out_len              || \
+        NULL == members) {
+        return QZ_PARAMS;
+    }
+
+    *out_len = 0;
+    *members = 0;
+
+    if (QZ_OK == qzIndexLoad(src, src_len, &index)) {
+        *out_len = index.u_off[index.cnt];
+        *members = GET_LOWER_32BITS(index.cnt);
+        qzIndexFree(&index);
+        return QZ_OK;
+    }
+
+    for (pos = 0; pos < src_len; pos += len) {
+        len = qzIndexMemberSz(src + pos, src_len - pos);
+        if (len) {
+            continue;
+        }
+
+        len = qzGzipMemberSz(src + pos, src_len - pos, &u_sz);
+        if (0 == len) {
+            QZ_DEBUG("qzDecompressedLength: no QZ member at %lu\n", pos);
+            return (0 == pos) ? QZ_FAIL : QZ_DATA_ERROR;
+        }
+        *out_len += u_sz;
+        (*members)++;
+    }
+
+    return QZ_OK;
+}
@@ -0,0 +1,288 @@
+/***************************************************************************
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2007-2017 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+
+
+/* Compressed output cache.
+ *
+ * Identical input chunks of a QZ_DEFLATE_GZIP_EXT session produce
+ * interchangeable members, so the deflate data of recent chunks is kept
+ * together with the chunk itself and reused instead of compressing the
+ * chunk again. Entries are found by a hash of the chunk seeded with the
+ * session parameters, confirmed by comparing the chunk and evicted least
+ * recently used first once the cache holds cache_sz bytes.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "cpa.h"
+#include "cpa_dc.h"
+#include "qatzip.h"
+#include "qatzipP.h"
+#include "qz_utils.h"
+
+#define CACHE_MIN_BUCKETS   64
+
+typedef struct QzCacheEntry_S {
+    struct QzCacheEntry_S *prev;   /*LRU list, most recent first*/
+    struct QzCacheEntry_S *next;
+    struct QzCacheEntry_S *chain;  /*hash bucket chain*/
+    uint64_t hash;
+    unsigned int src_len;
+    unsigned int comp_len;
+    uint32_t checksum;
+    unsigned char data[];          /*chunk followed by its deflate data*/
+} QzCacheEntry_T;
+
+struct QzCache_S {
+    pthread_mutex_t lock;
+    QzCacheEntry_T **bucket;
+    unsigned long bucket_mask;
+    QzCacheEntry_T *head;
+    QzCacheEntry_T *tail;
+    unsigned long seed;
+    unsigned long cap;
+    unsigned long used;
+    unsigned long entries;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+static inline uint64_t cacheHash(uint64_t seed, const unsigned char *src,
+                                 unsigned int len)
+{
+    const uint64_t mul = 0x9e3779b97f4a7c15ULL;
+    uint64_t h = seed ^ (len * mul), v;
+    unsigned int k;
+
+    for (k = 0; k + 8 <= len; k += 8) {
+        memcpy(&v, src + k, 8);
+        h = (h ^ v) * mul;
+        h ^= h >> 29;
+    }
+    for (; k < len; k++) {
+        h = (h ^ src[k]) * mul;
+    }
+
+    return h ^ (h >> 32);
+}
+
+QzCache_T *qzCacheCreate(const QzSessionParams_T *params)
+{
+    QzCache_T *cache;
+    unsigned long cnt = CACHE_MIN_BUCKETS;
+
+    /*about one bucket per cached chunk*/
+    while (cnt < params->cache_sz / params->hw_buff_sz) {
+        cnt <<= 1;
+    }
+
+    cache = calloc(1, sizeof(QzCache_T));
+    if (NULL == cache) {
+        return NULL;
+    }
+
+    cache->bucket = calloc(cnt, sizeof(QzCacheEntry_T *));
+    if (NULL == cache->bucket) {
+        free(cache);
+        return NULL;
+    }
+
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->bucket_mask = cnt - 1;
+    cache->cap = params->cache_sz;
+    cache->seed = ((unsigned long)params->comp_lvl << 16) |
+                  ((unsigned long)params->huffman_hdr << 8) |
+                  (unsigned long)params->data_fmt;
+    return cache;
+}
+
+void qzCacheDestroy(QzCache_T *cache)
+{
+    QzCacheEntry_T *ent, *next;
+
+    if (NULL == cache) {
+        return;
+    }
+
+    for (ent = cache->head; NULL != ent; ent = next) {
+        next = ent->next;
+        free(ent);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->bucket);
+    free(cache);
+}
+
+static void cacheUnlink(QzCache_T *cache, QzCacheEntry_T *ent)
+{
+    if (ent->prev) {
+        ent->prev->next = ent->next;
+    } else {
+        cache->head = ent->next;
+    }
+    if (ent->next) {
+        ent->next->prev = ent->prev;
+    } else {
+        cache->tail = ent->prev;
+    }
+}
+
+static void cachePushFront(QzCache_T *cache, QzCacheEntry_T *ent)
+{
+    ent->prev = NULL;
+    ent->next = cache->head;
+    if (cache->head) {
+        cache->head->prev = ent;
+    } else {
+        cache->tail = ent;
+    }
+    cache->head = ent;
+}
+
+static void cacheEvict(QzCache_T *cache, QzCacheEntry_T *ent)
+{
+    QzCacheEntry_T **pp = &cache->bucket[ent->hash & cache->bucket_mask];
+
+    while (*pp != ent) {
+        pp = &(*pp)->chain;
+    }
+    *pp = ent->chain;
+    cacheUnlink(cache, ent);
+    cache->used -= sizeof(*ent) + ent->src_len + ent->comp_len;
+    cache->entries--;
+    free(ent);
+}
+
+/* Copy the deflate data cached for the chunk src to dest. Returns QZ_OK
+ * on a hit with comp_len and checksum set, QZ_FAIL on a miss.
+ */
+int qzCacheLookup(QzCache_T *cache, const unsigned char *src,
+                  unsigned int src_len, unsigned char *dest,
+                  unsigned int dest_avail, unsigned int *comp_len,
+                  uint32_t *checksum)
+{
+    QzCacheEntry_T *ent;
+    uint64_t hash = cacheHash(cache->seed, src, src_len);
+    int rc = QZ_FAIL;
+
+    pthread_mutex_lock(&cache->lock);
+    for (ent = cache->bucket[hash & cache->bucket_mask]; ent; ent = ent->chain) {
+        if (ent->hash == hash && ent->src_len == src_len &&
+            ent->comp_len <= dest_avail && !memcmp(ent->data, src, src_len)) {
+            memcpy(dest, ent->data + src_len, ent->comp_len);
+            *comp_len = ent->comp_len;
+            *checksum = ent->checksum;
+            cacheUnlink(cache, ent);
+            cachePushFront(cache, ent);
+            rc = QZ_OK;
+            break;
+        }
+    }
+
+    if (QZ_OK == rc) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return rc;
+}
+
+/* Keep the deflate data comp of the chunk src */
+void qzCacheInsert(QzCache_T *cache, const unsigned char *src,
+                   unsigned int src_len, const unsigned char *comp,
+                   unsigned int comp_len, uint32_t checksum)
+{
+    QzCacheEntry_T *ent, **bucket;
+    unsigned long sz = sizeof(*ent) + src_len + comp_len;
+    uint64_t hash;
+
+    if (sz > cache->cap) {
+        return;
+    }
+
+    hash = cacheHash(cache->seed, src, src_len);
+    ent = malloc(sz);
+    if (NULL == ent) {
+        return;
+    }
+    ent->hash = hash;
+    ent->src_len = src_len;
+    ent->comp_len = comp_len;
+    ent->checksum = checksum;
+    memcpy(ent->data, src, src_len);
+    memcpy(ent->data + src_len, comp, comp_len);
+
+    pthread_mutex_lock(&cache->lock);
+    while (cache->used + sz > cache->cap) {
+        cacheEvict(cache, cache->tail);
+    }
+
+    bucket = &cache->bucket[hash & cache->bucket_mask];
+    ent->chain = *bucket;
+    *bucket = ent;
+    cachePushFront(cache, ent);
+    cache->used += sz;
+    cache->entries++;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void qzCacheStats(QzCache_T *cache, QzCacheStats_T *stats)
+{
+    pthread_mutex_lock(&cache->lock);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->entries = cache->entries;
+    stats->bytes = cache->used;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/* The cache of the session, NULL when it does not apply */
+QzCache_T *qzSessCache(QzSess_T *qz_sess)
+{
+    if (0 == qz_sess->sess_params.cache_sz ||
+        QZ_DEFLATE_GZIP_EXT != qz_sess->sess_params.data_fmt ||
+        NULL != qz_sess->dict) {
+        return NULL;
+    }
+
+    if (NULL == qz_sess->cache) {
+        qz_sess->cache = qzCacheCreate(&qz_sess->sess_params);
+    }
+    return qz_sess->cache;
+}
@@ -0,0 +1,170 @@
+/***************************************************************************
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2007-2017 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+
+
+/* Chunk sizes and content defined chunk boundaries.
+ *
+ * With adaptive_chunk set, each call picks its chunk size. Calls of many
+ * hw_buff_sz chunks, and all calls while other requests keep the device
+ * busy, use hw_buff_sz chunks for throughput and ratio. A medium call is
+ * cut into about QZ_ADAPT_FANOUT chunks, as small as QZ_ADAPT_CHUNK_MIN,
+ * so the instance works on them in parallel and the call returns sooner.
+ * Data that compressed well so far loses more ratio to small chunks and
+ * keeps at least half of hw_buff_sz. Chunks never exceed hw_buff_sz, so
+ * sessions with the same hw_buff_sz decompress them on the accelerator.
+ *
+ * With rsyncable set, QZ_DEFLATE_GZIP_EXT chunks end where a gear hash of
+ * the last 64 input bytes has its top bits clear instead of every
+ * hw_buff_sz bytes. An insertion or deletion then only changes the members
+ * around it, the boundaries realign right after and the members of
+ * unchanged data stay byte identical. Chunks are between a quarter of
+ * hw_buff_sz and hw_buff_sz long, about half of hw_buff_sz on average.
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "cpa.h"
+#include "cpa_dc.h"
+#include "qatzip.h"
+#include "qatzipP.h"
+#include "qz_utils.h"
+
+#define CDC_MIN_DIV     4
+
+static uint64_t g_gear[256];
+static pthread_once_t g_gear_once = PTHREAD_ONCE_INIT;
+
+/*fixed pseudo random values, boundaries must not change across runs*/
+static void gearInit(void)
+{
+    uint64_t x = 0x5153435243444331ULL, z;
+    int k;
+
+    for (k = 0; k < 256; k++) {
+        z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        g_gear[k] = z ^ (z >> 31);
+    }
+}
+
+static inline int rsyncable(const QzSessionParams_T *params)
+{
+    return params->rsyncable && QZ_DEFLATE_GZIP_EXT == params->data_fmt;
+}
+
+/* Chunk size of a call of len bytes on an instance with slots source
+ * buffers of buff_sz bytes and a device with busy requests in flight,
+ * the call included
+ */
+unsigned int qzChunkSz(const QzSess_T *qz_sess, unsigned long len,
+                       unsigned int buff_sz, unsigned int slots,
+                       unsigned long busy)
+{
+    const QzSessionParams_T *params = &qz_sess->sess_params;
+    unsigned int max = params->hw_buff_sz, sz, fan;
+
+    if (buff_sz && buff_sz < max) {
+        max = buff_sz;
+    }
+
+    if (!params->adaptive_chunk || rsyncable(params) || busy > 1 ||
+        len >= (unsigned long)max * QZ_ADAPT_BULK_CHUNKS) {
+        return max;
+    }
+
+    sz = QZ_ADAPT_CHUNK_MIN;
+    if (qz_sess->ratio_avg && qz_sess->ratio_avg < QZ_ADAPT_GOOD_RATIO) {
+        sz = max / 2;
+    }
+    if (sz >= max) {
+        return max;
+    }
+
+    fan = (slots < QZ_ADAPT_FANOUT) ? slots : QZ_ADAPT_FANOUT;
+    while (sz < max && (unsigned long)sz * fan < len) {
+        sz <<= 1;
+    }
+    return sz;
+}
+
+/* Length of the next chunk of the len bytes at src, max bytes at most */
+unsigned int qzChunkLen(const QzSessionParams_T *params, unsigned int max,
+                        const unsigned char *src, unsigned int len)
+{
+    unsigned int min = max / CDC_MIN_DIV;
+    unsigned int bits = 0, k;
+    uint64_t h = 0;
+
+    if (!rsyncable(params) || len <= min) {
+        return (len < max) ? len : max;
+    }
+
+    /*cut after about min more bytes past the minimum*/
+    while ((2U << bits) <= min) {
+        bits++;
+    }
+
+    pthread_once(&g_gear_once, gearInit);
+    if (len > max) {
+        len = max;
+    }
+
+    /*the hash covers 64 bytes, start it before the minimum*/
+    for (k = (min > 64) ? min - 64 : 0; k < min; k++) {
+        h = (h << 1) + g_gear[src[k]];
+    }
+    for (; k < len; k++) {
+        h = (h << 1) + g_gear[src[k]];
+        if (0 == (h >> (64 - bits))) {
+            return k + 1;
+        }
+    }
+
+    return len;
+}
+
+/* Upper bound of the chunks qzChunkLen splits len bytes into */
+unsigned long qzChunkCntMax(const QzSessionParams_T *params, unsigned int max,
+                            unsigned long len)
+{
+    unsigned long sz = max;
+
+    if (rsyncable(params)) {
+        sz /= CDC_MIN_DIV;
+    }
+    return (len + sz - 1) / sz;
+}
@@ -48,6 +48,122 @@
 
 extern processData_T g_process;
 
+static struct {
+    unsigned long hw_calls;
+    unsigned long hw_bytes_in;
+    unsigned long hw_bytes_out;
+    unsigned long sw_calls;
+    unsigned long sw_bytes_in;
+    unsigned long sw_bytes_out;
+    unsigned long fallback[QZ_FALLBACK_MAX];
+    unsigned long par_members;
+} g_stats;
+
+/* Count a call served by instance i, started at begin */
+void qzStatsHw(int i, Serv_T serv, unsigned long in, unsigned long out,
+               unsigned long begin)
+{
+    QZ_STAT_ADD(g_stats.hw_calls, 1);
+    QZ_STAT_ADD(g_stats.hw_bytes_in, in);
+    QZ_STAT_ADD(g_stats.hw_bytes_out, out);
+    QZ_STAT_ADD(g_process.qz_inst[i].calls, 1);
+    QZ_STAT_ADD(g_process.qz_inst[i].bytes_in, in);
+    QZ_STAT_ADD(g_process.qz_inst[i].bytes_out, out);
+    countThread(serv, HW, in, out, qzNowNsec() - begin);
+}
+
+/* Count a call served by software, its bytes if it succeeded */
+void qzStatsSw(Serv_T serv, QzFallback_T why, int rc, unsigned long in,
+               unsigned long out, unsigned long begin)
+{
+    QZ_STAT_ADD(g_stats.sw_calls, 1);
+    QZ_STAT_ADD(g_stats.fallback[why], 1);
+    if (QZ_OK != rc) {
+        in = out = 0;
+    }
+    QZ_STAT_ADD(g_stats.sw_bytes_in, in);
+    QZ_STAT_ADD(g_stats.sw_bytes_out, out);
+    countThread(serv, SW, in, out, qzNowNsec() - begin);
+}
+
+/* Count a member of a hardware call that software decompressed */
+void qzStatsFallback(QzFallback_T why)
+{
+    QZ_STAT_ADD(g_stats.fallback[why], 1);
+}
+
+/* Count a member the parallel software inflate decompressed */
+void qzStatsParallel(void)
+{
+    QZ_STAT_ADD(g_stats.par_members, 1);
+}
+
+static unsigned int busySlots(QzInstance_T *inst)
+{
+    unsigned int j, n = 0;
+
+    if (0 == inst->mem_setup || NULL == inst->stream) {
+        return 0;
+    }
+
+    for (j = 0; j < inst->dest_count; j++) {
+        n += !(inst->stream[j].src1 == inst->stream[j].src2 &&
+               inst->stream[j].src1 == inst->stream[j].sink1 &&
+               inst->stream[j].src1 == inst->stream[j].sink2);
+    }
+    return n;
+}
+
+int qzGetStats(QzStats_T *stats, QzInstanceStats_T *inst,
+               unsigned int inst_cnt)
+{
+    unsigned int i, k;
+    QzInstance_T *qz_inst;
+
+    if (NULL == stats || (NULL == inst && inst_cnt)) {
+        return QZ_PARAMS;
+    }
+
+    memset(stats, 0, sizeof(QzStats_T));
+    stats->hw_calls = QZ_STAT_GET(g_stats.hw_calls);
+    stats->hw_bytes_in = QZ_STAT_GET(g_stats.hw_bytes_in);
+    stats->hw_bytes_out = QZ_STAT_GET(g_stats.hw_bytes_out);
+    stats->sw_calls = QZ_STAT_GET(g_stats.sw_calls);
+    stats->sw_bytes_in = QZ_STAT_GET(g_stats.sw_bytes_in);
+    stats->sw_bytes_out = QZ_STAT_GET(g_stats.sw_bytes_out);
+    for (k = 0; k < QZ_FALLBACK_MAX; k++) {
+        stats->fallback[k] = QZ_STAT_GET(g_stats.fallback[k]);
+    }
+    stats->par_members = QZ_STAT_GET(g_stats.par_members);
+    if (inst_cnt) {
+        memset(inst, 0, inst_cnt * sizeof(QzInstanceStats_T));
+    }
+
+    __sync_synchronize();
+    if (1 != g_process.qz_init_called || NULL == g_process.qz_inst) {
+        return QZ_OK;
+    }
+
+    stats->num_instances = g_process.num_instances;
+    for (i = 0; i < g_process.num_instances; i++) {
+        qz_inst = &g_process.qz_inst[i];
+        stats->pinned_sz += QZ_STAT_GET(qz_inst->pinned_sz);
+        if (i >= inst_cnt) {
+            continue;
+        }
+
+        inst[i].calls = QZ_STAT_GET(qz_inst->calls);
+        inst[i].bytes_in = QZ_STAT_GET(qz_inst->bytes_in);
+        inst[i].bytes_out = QZ_STAT_GET(qz_inst->bytes_out);
+        inst[i].retries = qz_inst->health.retries;
+        inst[i].slots = qz_inst->mem_setup ? qz_inst->dest_count : 0;
+        inst[i].slots_busy = busySlots(qz_inst);
+        inst[i].pinned_sz = QZ_STAT_GET(qz_inst->pinned_sz);
+    }
+
+    return QZ_OK;
+}
+
 void dumpCounters(QzInstance_T *inst)
 {
     int i;
@@ -75,3 +191,130 @@ void dumpAllCounters(void)
         QZ_PRINT("\n");
     }
 }
+
+static int threadStatsFill(QzThreadStats_T *st, ThreadStats_T *ts)
+{
+    memset(st, 0, sizeof(QzThreadStats_T));
+    st->thread_id = QZ_STAT_GET(ts->thread_id);
+    st->comp_hw_calls = QZ_STAT_GET(ts->calls[COMPRESSION][HW]);
+    st->comp_sw_calls = QZ_STAT_GET(ts->calls[COMPRESSION][SW]);
+    st->decomp_hw_calls = QZ_STAT_GET(ts->calls[DECOMPRESSION][HW]);
+    st->decomp_sw_calls = QZ_STAT_GET(ts->calls[DECOMPRESSION][SW]);
+    st->hw_bytes_in = QZ_STAT_GET(ts->bytes_in[COMPRESSION][HW]) +
+                      QZ_STAT_GET(ts->bytes_in[DECOMPRESSION][HW]);
+    st->hw_bytes_out = QZ_STAT_GET(ts->bytes_out[COMPRESSION][HW]) +
+                       QZ_STAT_GET(ts->bytes_out[DECOMPRESSION][HW]);
+    st->sw_bytes_in = QZ_STAT_GET(ts->bytes_in[COMPRESSION][SW]) +
+                      QZ_STAT_GET(ts->bytes_in[DECOMPRESSION][SW]);
+    st->sw_bytes_out = QZ_STAT_GET(ts->bytes_out[COMPRESSION][SW]) +
+                       QZ_STAT_GET(ts->bytes_out[DECOMPRESSION][SW]);
+    st->hw_nsec = QZ_STAT_GET(ts->nsec[COMPRESSION][HW]) +
+                  QZ_STAT_GET(ts->nsec[DECOMPRESSION][HW]);
+    st->sw_nsec = QZ_STAT_GET(ts->nsec[COMPRESSION][SW]) +
+                  QZ_STAT_GET(ts->nsec[DECOMPRESSION][SW]);
+
+    return st->comp_hw_calls || st->comp_sw_calls ||
+           st->decomp_hw_calls || st->decomp_sw_calls;
+}
+
+int qzGetThreadStats(QzThreadStats_T *stats, unsigned int *cnt)
+{
+    unsigned int n = 0;
+    ThreadStats_T *ts;
+
+    if (NULL == stats || NULL == cnt) {
+        return QZ_PARAMS;
+    }
+
+    pthread_mutex_lock(&g_thread_lock);
+    for (ts = __atomic_load_n(&g_thread_stats, __ATOMIC_ACQUIRE);
+         ts && n < *cnt; ts = ts->next) {
+        if (__atomic_load_n(&ts->live, __ATOMIC_ACQUIRE) &&
+            threadStatsFill(&stats[n], ts)) {
+            n++;
+        }
+    }
+    if (n < *cnt && threadStatsFill(&stats[n], &g_thread_retired)) {
+        stats[n].thread_id = 0;
+        n++;
+    }
+    pthread_mutex_unlock(&g_thread_lock);
+
+    *cnt = n;
+    return QZ_OK;
+}
+
+/* Add the histogram of op and size of one block to hist */
+static void latMerge(unsigned long *hist, ThreadStats_T *ts,
+                     QzLatOp_T op, QzLatSize_T size)
+{
+    unsigned int serv = op >> 1, engine = op & 1, sz, b;
+
+    for (sz = 0; sz < QZ_LAT_SIZES; sz++) {
+        if (QZ_LAT_SZ_MAX != size && sz != size) {
+            continue;
+        }
+        for (b = 0; b < QZ_LAT_BUCKETS; b++) {
+            hist[b] += QZ_STAT_GET(ts->lat[serv][engine][sz][b]);
+        }
+    }
+}
+
+int qzGetLatency(QzLatOp_T op, QzLatSize_T size, QzLatency_T *lat)
+{
+    unsigned long hist[QZ_LAT_BUCKETS] = {0};
+    unsigned long seen = 0, prev;
+    unsigned int epoch, b;
+    ThreadStats_T *ts;
+
+    if (NULL == lat || op >= QZ_LAT_OP_MAX || size > QZ_LAT_SZ_MAX) {
+        return QZ_PARAMS;
+    }
+
+    pthread_mutex_lock(&g_thread_lock);
+    epoch = __atomic_load_n(&g_lat_epoch, __ATOMIC_ACQUIRE);
+    for (ts = __atomic_load_n(&g_thread_stats, __ATOMIC_ACQUIRE);
+         ts; ts = ts->next) {
+        if (__atomic_load_n(&ts->live, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&ts->lat_epoch, __ATOMIC_ACQUIRE) == epoch) {
+            latMerge(hist, ts, op, size);
+        }
+    }
+    latMerge(hist, &g_thread_retired, op, size);
+    pthread_mutex_unlock(&g_thread_lock);
+
+    memset(lat, 0, sizeof(QzLatency_T));
+    for (b = 0; b < QZ_LAT_BUCKETS; b++) {
+        lat->count += hist[b];
+    }
+
+    /*the percentile is the bucket where the running count reaches its rank*/
+    for (b = 0; b < QZ_LAT_BUCKETS && lat->count; b++) {
+        if (0 == hist[b]) {
+            continue;
+        }
+        prev = seen;
+        seen += hist[b];
+        if (prev * 2 < lat->count && seen * 2 >= lat->count) {
+            lat->p50 = latValue(b);
+        }
+        if (prev * 100 < lat->count * 99 && seen * 100 >= lat->count * 99) {
+            lat->p99 = latValue(b);
+        }
+        if (prev * 1000 < lat->count * 999 && seen * 1000 >= lat->count * 999) {
+            lat->p999 = latValue(b);
+        }
+        lat->max = latValue(b);
+    }
+
+    return QZ_OK;
+}
+
+void qzResetLatency(void)
+{
+    /*threads see the new epoch and clear their own histograms*/
+    pthread_mutex_lock(&g_thread_lock);
+    latClear(&g_thread_retired);
+    (void)__atomic_add_fetch(&g_lat_epoch, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_thread_lock);
+}
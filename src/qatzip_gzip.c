@@ -95,11 +95,215 @@ int isStdGzipHeader(const unsigned char *const ptr)
 {
     QzGzH_T *h = (QzGzH_T *)ptr;
 
+    /*the extra field is only valid when FEXTRA is set*/
     return (h->id1 == 0x1f       && \
             h->id2 == 0x8b       && \
             h->cm  == QZ_DEFLATE && \
-            h->extra.st1 != 'Q'  && \
-            h->extra.st2 != 'Z');
+            (!(h->flag & 0x04)   || \
+             h->extra.st1 != 'Q' || \
+             h->extra.st2 != 'Z'));
+}
+
+/*header and footer size around every compressed chunk*/
+unsigned long outputHeaderSz(QzDataFormat_T data_fmt)
+{
+    return (QZ_DEFLATE_GZIP_EXT == data_fmt) ? qzGzipHeaderSz() : 0;
+}
+
+unsigned long outputFooterSz(QzDataFormat_T data_fmt)
+{
+    return (QZ_DEFLATE_GZIP_EXT == data_fmt) ? qzGzipFooterSz() : 0;
+}
+
+static void stdGzipHeaderGen(unsigned char *ptr)
+{
+    QzGzH_T *hdr;
+
+    hdr = (QzGzH_T *)ptr;
+    hdr->id1      = 0x1f;
+    hdr->id2      = 0x8b;
+    hdr->cm       = QZ_DEFLATE;
+    hdr->flag     = 0x00;
+    hdr->mtime[0] = (char)0;
+    hdr->mtime[1] = (char)0;
+    hdr->mtime[2] = (char)0;
+    hdr->mtime[3] = (char)0;
+    hdr->xfl      = 0;
+    hdr->os       = 255;
+}
+
+static void zlibHeaderGen(unsigned char *ptr, unsigned int comp_lvl)
+{
+    /*32K window deflate, FLEVEL hint, FCHECK makes it a multiple of 31*/
+    ptr[0] = 0x78;
+    if (comp_lvl <= 1) {
+        ptr[1] = 0x01;
+    } else if (comp_lvl >= 9) {
+        ptr[1] = 0xda;
+    } else {
+        ptr[1] = 0x9c;
+    }
+}
+
+/*header and footer size of a whole gzip member, raw or zlib stream*/
+unsigned long streamHeaderSz(QzDataFormat_T data_fmt)
+{
+    switch (data_fmt) {
+    case QZ_DEFLATE_GZIP:
+        return STD_GZIP_HDR_SZ;
+    case QZ_DEFLATE_ZLIB:
+        return ZLIB_HDR_SZ;
+    default:
+        return 0;
+    }
+}
+
+unsigned long streamFooterSz(QzDataFormat_T data_fmt)
+{
+    switch (data_fmt) {
+    case QZ_DEFLATE_GZIP:
+        return sizeof(QzGzF_T);
+    case QZ_DEFLATE_ZLIB:
+        return ZLIB_FTR_SZ;
+    default:
+        return 0;
+    }
+}
+
+void streamHeaderGen(unsigned char *ptr, QzSessionParams_T *params)
+{
+    assert(ptr != NULL);
+    assert(params != NULL);
+
+    switch (params->data_fmt) {
+    case QZ_DEFLATE_GZIP:
+        stdGzipHeaderGen(ptr);
+        break;
+    case QZ_DEFLATE_ZLIB:
+        zlibHeaderGen(ptr, params->comp_lvl);
+        break;
+    default:
+        break;
+    }
+}
+
+void streamFooterGen(unsigned char *ptr, QzDataFormat_T data_fmt,
+                     unsigned long cksum, unsigned long len)
+{
+    assert(ptr != NULL);
+    QzGzF_T *ftr;
+
+    switch (data_fmt) {
+    case QZ_DEFLATE_GZIP:
+        ftr = (QzGzF_T *)ptr;
+        ftr->crc32 = (uint32_t)GET_LOWER_32BITS(cksum);
+        ftr->i_size = (uint32_t)GET_LOWER_32BITS(len);
+        break;
+    case QZ_DEFLATE_ZLIB:
+        /*Adler-32 in network byte order*/
+        ptr[0] = GET_LOWER_8BITS(cksum >> 24);
+        ptr[1] = GET_LOWER_8BITS(cksum >> 16);
+        ptr[2] = GET_LOWER_8BITS(cksum >> 8);
+        ptr[3] = GET_LOWER_8BITS(cksum);
+        break;
+    default:
+        break;
+    }
+}
+
+unsigned long streamCksumInit(QzDataFormat_T data_fmt)
+{
+    return (QZ_DEFLATE_ZLIB == data_fmt) ? adler32(0, NULL, 0) :
+           crc32(0, NULL, 0);
+}
+
+unsigned long streamCksumCombine(QzDataFormat_T data_fmt, unsigned long cksum1,
+                                 unsigned long cksum2, unsigned long len2)
+{
+    if (QZ_DEFLATE_ZLIB == data_fmt) {
+        return adler32_combine(cksum1, cksum2, (z_off_t)len2);
+    }
+
+    return crc32_combine(cksum1, cksum2, (z_off_t)len2);
+}
+
+/*returns QZ_OK for a zlib header without preset dictionary*/
+int zlibHeaderExt(const unsigned char *const ptr)
+{
+    if ((ptr[0] & 0x0f) != QZ_DEFLATE ||
+        (ptr[0] >> 4) > 7            ||
+        (ptr[1] & 0x20)              ||
+        ((ptr[0] << 8) | ptr[1]) % 31) {
+        return QZ_FAIL;
+    }
+
+    return QZ_OK;
+}
+
+/* zlib header with FDICT set and the dictionary ID, only written by
+ * the software path
+ */
+void zlibDictHeaderGen(unsigned char *ptr, unsigned int comp_lvl,
+                       unsigned long dict_id)
+{
+    unsigned int flg;
+
+    zlibHeaderGen(ptr, comp_lvl);
+    /*keep FLEVEL, set FDICT and recompute FCHECK*/
+    flg = (ptr[1] & 0xc0) | 0x20;
+    flg += (31 - (((ptr[0] << 8) | flg) % 31)) % 31;
+    ptr[1] = GET_LOWER_8BITS(flg);
+    ptr[2] = GET_LOWER_8BITS(dict_id >> 24);
+    ptr[3] = GET_LOWER_8BITS(dict_id >> 16);
+    ptr[4] = GET_LOWER_8BITS(dict_id >> 8);
+    ptr[5] = GET_LOWER_8BITS(dict_id);
+}
+
+static inline int isQzGzipHeader(const QzGzH_T *h, uint16_t x_len)
+{
+    return (h->id1          == 0x1f             && \
+            h->id2          == 0x8b             && \
+            h->extra.st1    == 'Q'              && \
+            h->extra.st2    == 'Z'              && \
+            h->cm           == QZ_DEFLATE       && \
+            h->flag         == 0x04             && \
+            h->xfl          == 0                && \
+            h->os           == 255              && \
+            h->x_len        == x_len            && \
+            h->extra.x2_len == sizeof(h->extra.qz_e));
+}
+
+/* Members compressed with a preset dictionary carry a 'Q','D' subfield
+ * after the QZ one, the hardware cannot decompress them
+ */
+unsigned long qzDictHeaderSz(void)
+{
+    return sizeof(QzGzH_T) + sizeof(QzDictField_T);
+}
+
+void qzDictHeaderGen(unsigned char *ptr, CpaDcRqResults *res,
+                     unsigned long dict_id)
+{
+    QzGzH_T *hdr = (QzGzH_T *)ptr;
+    QzDictField_T *dict = (QzDictField_T *)(ptr + sizeof(QzGzH_T));
+
+    qzGzipHeaderGen(ptr, res);
+    hdr->x_len      = (uint16_t)(sizeof(hdr->extra) + sizeof(*dict));
+    dict->st1       = 'Q';
+    dict->st2       = 'D';
+    dict->x2_len    = (uint16_t)sizeof(dict->dict_id);
+    dict->dict_id   = (uint32_t)dict_id;
+}
+
+int isQzDictHeader(const unsigned char *const ptr)
+{
+    QzGzH_T *h = (QzGzH_T *)ptr;
+    QzDictField_T *dict = (QzDictField_T *)(ptr + sizeof(QzGzH_T));
+
+    return (isQzGzipHeader(h, sizeof(h->extra) + sizeof(*dict)) && \
+            dict->st1    == 'Q'                                 && \
+            dict->st2    == 'D'                                 && \
+            dict->x2_len == sizeof(dict->dict_id));
 }
 
 int qzGzipHeaderExt(const unsigned char *const ptr, QzGzH_T *hdr)
@@ -107,16 +311,7 @@ int qzGzipHeaderExt(const unsigned char *const ptr, QzGzH_T *hdr)
     QzGzH_T *h;
 
     h = (QzGzH_T *)ptr;
-    if (h->id1          != 0x1f             || \
-        h->id2          != 0x8b             || \
-        h->extra.st1    != 'Q'              || \
-        h->extra.st2    != 'Z'              || \
-        h->cm           != QZ_DEFLATE       || \
-        h->flag         != 0x04             || \
-        h->xfl          != 0                || \
-        h->os           != 255              || \
-        h->x_len        != sizeof(h->extra) || \
-        h->extra.x2_len != sizeof(h->extra.qz_e)) {
+    if (!isQzGzipHeader(h, sizeof(h->extra))) {
         QZ_ERROR("id1: %x, id2: %x, st1: %c, st2: %c, cm: %d, flag: %d,"
                  "xfl: %d, os: %d, x_len: %d, x2_len: %d\n",
                  h->id1, h->id2, h->extra.st1, h->extra.st2, h->cm, h->flag,
@@ -128,6 +323,33 @@ int qzGzipHeaderExt(const unsigned char *const ptr, QzGzH_T *hdr)
     return QZ_OK;
 }
 
+/* Returns the length of the QZ member at ptr and its uncompressed size in
+ * u_sz, reading the header only. 0 if ptr does not hold a whole QZ member.
+ */
+unsigned long qzGzipMemberSz(const unsigned char *const ptr,
+                             unsigned long avail, unsigned long *u_sz)
+{
+    QzGzH_T *h = (QzGzH_T *)ptr;
+    unsigned long hdr_sz, len;
+
+    if (avail >= qzDictHeaderSz() + qzGzipFooterSz() && isQzDictHeader(ptr)) {
+        hdr_sz = qzDictHeaderSz();
+    } else if (avail >= qzGzipHeaderSz() + qzGzipFooterSz() &&
+               isQzGzipHeader(h, sizeof(h->extra))) {
+        hdr_sz = qzGzipHeaderSz();
+    } else {
+        return 0;
+    }
+
+    len = hdr_sz + h->extra.qz_e.dest_sz + qzGzipFooterSz();
+    if (len > avail) {
+        return 0;
+    }
+
+    *u_sz = h->extra.qz_e.src_sz;
+    return len;
+}
+
 void qzGzipFooterGen(unsigned char *ptr, CpaDcRqResults *res)
 {
     assert(ptr != NULL);
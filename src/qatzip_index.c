@@ -0,0 +1,318 @@
+/***************************************************************************
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2007-2017 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+
+
+/* Seek index trailer of QZ streams.
+ *
+ * The index is written after the last data member as one or more empty
+ * gzip members, so gunzip simply skips it. The extra field of every index
+ * member starts with a 'Q','I' subfield holding the compressed and
+ * uncompressed size of each data member, the extra field of the last one
+ * ends with a 'Q','L' subfield holding the total index length. The
+ * locator sits at a fixed distance from the end of the stream, so the
+ * index can be found without walking the data members.
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+#include "cpa.h"
+#include "cpa_dc.h"
+#include "qatzip.h"
+#include "qatzipP.h"
+#include "qz_utils.h"
+
+#define IDX_HDR_SZ         12 /*gzip header and XLEN*/
+#define IDX_SUB_HDR_SZ     4
+#define IDX_LOC_SZ         8
+#define IDX_TAIL_SZ        10 /*empty final block and gzip footer*/
+#define IDX_ENTRY_SZ       8
+#define IDX_MEMBER_MIN_SZ  (IDX_HDR_SZ + IDX_SUB_HDR_SZ + IDX_TAIL_SZ)
+
+static const unsigned char g_idx_hdr[] = {
+    0x1f, 0x8b, QZ_DEFLATE, 0x04, 0, 0, 0, 0, 0, 255
+};
+
+static inline void putLe16(unsigned char *p, unsigned int v)
+{
+    p[0] = GET_LOWER_8BITS(v);
+    p[1] = GET_LOWER_8BITS(v >> 8);
+}
+
+static inline void putLe32(unsigned char *p, unsigned long v)
+{
+    putLe16(p, GET_LOWER_16BITS(v));
+    putLe16(p + 2, GET_LOWER_16BITS(v >> 16));
+}
+
+static inline unsigned int getLe16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline unsigned long getLe32(const unsigned char *p)
+{
+    return getLe16(p) | ((unsigned long)getLe16(p + 2) << 16);
+}
+
+unsigned long qzIndexSz(unsigned long cnt)
+{
+    unsigned long members;
+
+    if (0 == cnt) {
+        return 0;
+    }
+
+    members = (cnt + QZ_INDEX_ENTRIES_PER_MEMBER - 1) /
+              QZ_INDEX_ENTRIES_PER_MEMBER;
+    return members * IDX_MEMBER_MIN_SZ + cnt * IDX_ENTRY_SZ + IDX_LOC_SZ;
+}
+
+/* Write the index members for cnt entries, returns the bytes written */
+unsigned long qzIndexGen(unsigned char *ptr, const QzIndexEntry_T *ent,
+                         unsigned long cnt)
+{
+    unsigned long total = qzIndexSz(cnt);
+    unsigned long n, k;
+    unsigned int x_len;
+    unsigned char *p = ptr;
+
+    while (cnt) {
+        n = MIN(cnt, QZ_INDEX_ENTRIES_PER_MEMBER);
+        x_len = IDX_SUB_HDR_SZ + n * IDX_ENTRY_SZ + ((n == cnt) ? IDX_LOC_SZ : 0);
+
+        memcpy(p, g_idx_hdr, sizeof(g_idx_hdr));
+        putLe16(p + sizeof(g_idx_hdr), x_len);
+        p += IDX_HDR_SZ;
+
+        p[0] = 'Q';
+        p[1] = 'I';
+        putLe16(p + 2, n * IDX_ENTRY_SZ);
+        p += IDX_SUB_HDR_SZ;
+        for (k = 0; k < n; k++) {
+            putLe32(p, ent[k].c_sz);
+            putLe32(p + 4, ent[k].u_sz);
+            p += IDX_ENTRY_SZ;
+        }
+
+        if (n == cnt) {
+            p[0] = 'Q';
+            p[1] = 'L';
+            putLe16(p + 2, 4);
+            putLe32(p + 4, total);
+            p += IDX_LOC_SZ;
+        }
+
+        /*empty final fixed block, CRC32 and ISIZE of no data*/
+        memset(p, 0, IDX_TAIL_SZ);
+        p[0] = 0x03;
+        p += IDX_TAIL_SZ;
+
+        ent += n;
+        cnt -= n;
+    }
+
+    return (unsigned long)(p - ptr);
+}
+
+/* Returns the length of the index member at ptr, 0 if it is not one */
+unsigned long qzIndexMemberSz(const unsigned char *ptr, unsigned long avail)
+{
+    unsigned int x_len, sub_len;
+
+    if (avail < IDX_MEMBER_MIN_SZ ||
+        memcmp(ptr, g_idx_hdr, sizeof(g_idx_hdr)) ||
+        ptr[IDX_HDR_SZ] != 'Q' ||
+        ptr[IDX_HDR_SZ + 1] != 'I') {
+        return 0;
+    }
+
+    x_len = getLe16(ptr + sizeof(g_idx_hdr));
+    sub_len = getLe16(ptr + IDX_HDR_SZ + 2);
+    if ((sub_len % IDX_ENTRY_SZ) ||
+        (x_len != IDX_SUB_HDR_SZ + sub_len &&
+         x_len != IDX_SUB_HDR_SZ + sub_len + IDX_LOC_SZ) ||
+        IDX_HDR_SZ + x_len + IDX_TAIL_SZ > avail ||
+        ptr[IDX_HDR_SZ + x_len] != 0x03 ||
+        ptr[IDX_HDR_SZ + x_len + 1] != 0x00) {
+        return 0;
+    }
+
+    return IDX_HDR_SZ + x_len + IDX_TAIL_SZ;
+}
+
+/* Record a data member of the stream being compressed */
+void qzIndexAdd(QzSess_T *qz_sess, unsigned int c_sz, unsigned int u_sz)
+{
+    QzIndexEntry_T *ent;
+    unsigned long cap;
+
+    if (0 == qz_sess->sess_params.index_trailer || qz_sess->idx_fail) {
+        return;
+    }
+
+    if (qz_sess->idx_cnt == qz_sess->idx_cap) {
+        cap = qz_sess->idx_cap ? 2 * qz_sess->idx_cap : 256;
+        ent = realloc(qz_sess->idx_ent, cap * sizeof(QzIndexEntry_T));
+        if (NULL == ent) {
+            /*the stream stays valid, it just goes without an index*/
+            qz_sess->idx_fail = 1;
+            return;
+        }
+        qz_sess->idx_ent = ent;
+        qz_sess->idx_cap = cap;
+    }
+
+    qz_sess->idx_ent[qz_sess->idx_cnt].c_sz = c_sz;
+    qz_sess->idx_ent[qz_sess->idx_cnt].u_sz = u_sz;
+    qz_sess->idx_cnt++;
+}
+
+/* Append the index of the members recorded since the last stream end,
+ * dest_len is set to the bytes written
+ */
+int qzIndexWrite(QzSess_T *qz_sess, unsigned char *dest,
+                 unsigned int *dest_len)
+{
+    unsigned long idx_sz = 0;
+
+    if (!qz_sess->idx_fail) {
+        idx_sz = qzIndexSz(qz_sess->idx_cnt);
+        if (idx_sz > *dest_len) {
+            return QZ_BUF_ERROR;
+        }
+        (void)qzIndexGen(dest, qz_sess->idx_ent, qz_sess->idx_cnt);
+    }
+
+    qz_sess->idx_cnt = 0;
+    qz_sess->idx_fail = 0;
+    *dest_len = GET_LOWER_32BITS(idx_sz);
+    return QZ_OK;
+}
+
+/* Locate the index from the end of src and build the member offsets */
+int qzIndexLoad(const unsigned char *src, unsigned long src_len,
+                QzIndex_T *index)
+{
+    const unsigned char *loc;
+    unsigned long idx_len, idx_start, pos, len, cnt, n, k;
+    const unsigned char *ent;
+
+    memset(index, 0, sizeof(*index));
+    if (src_len < IDX_MEMBER_MIN_SZ + IDX_LOC_SZ) {
+        return QZ_FAIL;
+    }
+
+    loc = src + src_len - IDX_TAIL_SZ - IDX_LOC_SZ;
+    if (loc[0] != 'Q' || loc[1] != 'L' || getLe16(loc + 2) != 4) {
+        return QZ_FAIL;
+    }
+
+    idx_len = getLe32(loc + 4);
+    if (idx_len > src_len) {
+        return QZ_FAIL;
+    }
+    idx_start = src_len - idx_len;
+
+    for (pos = idx_start, cnt = 0; pos < src_len; pos += len) {
+        len = qzIndexMemberSz(src + pos, src_len - pos);
+        if (0 == len) {
+            return QZ_FAIL;
+        }
+        cnt += getLe16(src + pos + IDX_HDR_SZ + 2) / IDX_ENTRY_SZ;
+    }
+
+    index->c_off = malloc((cnt + 1) * sizeof(unsigned long));
+    index->u_off = malloc((cnt + 1) * sizeof(unsigned long));
+    if (NULL == index->c_off || NULL == index->u_off) {
+        qzIndexFree(index);
+        return QZ_FAIL;
+    }
+
+    index->c_off[0] = 0;
+    index->u_off[0] = 0;
+    for (pos = idx_start, k = 0; pos < src_len; pos += len) {
+        len = qzIndexMemberSz(src + pos, src_len - pos);
+        n = getLe16(src + pos + IDX_HDR_SZ + 2) / IDX_ENTRY_SZ;
+        ent = src + pos + IDX_HDR_SZ + IDX_SUB_HDR_SZ;
+        for (; n > 0; n--, k++, ent += IDX_ENTRY_SZ) {
+            index->c_off[k + 1] = index->c_off[k] + getLe32(ent);
+            index->u_off[k + 1] = index->u_off[k] + getLe32(ent + 4);
+        }
+    }
+
+    if (index->c_off[cnt] != idx_start) {
+        QZ_DEBUG("qzIndexLoad: index covers %lu bytes, data is %lu bytes\n",
+                 index->c_off[cnt], idx_start);
+        qzIndexFree(index);
+        return QZ_FAIL;
+    }
+
+    index->cnt = cnt;
+    return QZ_OK;
+}
+
+/* Returns the member holding uncompressed offset u_off, -1 past the end */
+long qzIndexLookup(const QzIndex_T *index, unsigned long u_off)
+{
+    unsigned long lo = 0, hi = index->cnt, mid;
+
+    if (0 == index->cnt || u_off >= index->u_off[index->cnt]) {
+        return -1;
+    }
+
+    /*last member starting at or before u_off*/
+    while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (index->u_off[mid] <= u_off) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return (long)lo;
+}
+
+void qzIndexFree(QzIndex_T *index)
+{
+    free(index->c_off);
+    free(index->u_off);
+    index->c_off = NULL;
+    index->u_off = NULL;
+    index->cnt = 0;
+}
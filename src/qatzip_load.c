@@ -0,0 +1,264 @@
+/***************************************************************************
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2007-2017 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+
+
+/* Device load table shared by the processes of a user.
+ *
+ * Every process using QAT claims a slot in a small table in /dev/shm and
+ * publishes the config section it started and its requests in flight per
+ * device. qzInit starts the section with the least processes and work,
+ * qzGrabInstance prefers the instances of the least loaded device. The
+ * slots of processes that are gone are reclaimed by the next process to
+ * attach, which hands their share back to the other sections. Without the
+ * table, e.g. when /dev/shm is not available, the library picks as before.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "cpa.h"
+#include "cpa_dc.h"
+#include "qatzip.h"
+#include "qatzipP.h"
+#include "qz_utils.h"
+
+#define LOAD_MAGIC          0x515a4c31  /*"QZL1"*/
+#define LOAD_SLOT_FREE      0
+#define LOAD_SLOT_BUSY      (-1)  /*being reclaimed*/
+
+typedef struct QzLoadSlot_S {
+    pid_t pid;
+    int section;
+    unsigned int dev[QAT_MAX_DEVICES];  /*requests in flight*/
+} QzLoadSlot_T;
+
+typedef struct QzLoadTable_S {
+    unsigned int magic;
+    unsigned int dev[QAT_MAX_DEVICES];  /*requests in flight of all slots*/
+    QzLoadSlot_T slot[QZ_LOAD_SLOTS];
+} QzLoadTable_T;
+
+static QzLoadTable_T *g_load = NULL;
+static QzLoadSlot_T *g_slot = NULL;
+
+static int slotLive(pid_t pid)
+{
+    return pid > 0 && (0 == kill(pid, 0) || EPERM == errno);
+}
+
+/* Return the work of a dead process to the table */
+static void reclaimSlot(QzLoadSlot_T *slot, pid_t pid)
+{
+    int d;
+
+    if (!__sync_bool_compare_and_swap(&slot->pid, pid, LOAD_SLOT_BUSY)) {
+        return;
+    }
+
+    for (d = 0; d < QAT_MAX_DEVICES; d++) {
+        if (slot->dev[d]) {
+            __sync_fetch_and_sub(&g_load->dev[d], slot->dev[d]);
+            slot->dev[d] = 0;
+        }
+    }
+    slot->section = -1;
+    __sync_lock_release(&slot->pid);
+}
+
+int qzLoadAttach(void)
+{
+    char name[64];
+    int fd, k;
+    pid_t pid, me = getpid();
+    struct stat st;
+    QzLoadTable_T *table;
+
+    if (NULL != g_load) {
+        return QZ_OK;
+    }
+
+    snprintf(name, sizeof(name), "/qatzip_load.%u", (unsigned int)getuid());
+    fd = shm_open(name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        QZ_DEBUG("shm_open %s: %s\n", name, strerror(errno));
+        return QZ_FAIL;
+    }
+
+    /*growing to the same size is harmless when processes race*/
+    if (0 != fstat(fd, &st) ||
+        ((size_t)st.st_size < sizeof(QzLoadTable_T) &&
+         0 != ftruncate(fd, sizeof(QzLoadTable_T)))) {
+        close(fd);
+        return QZ_FAIL;
+    }
+
+    table = mmap(NULL, sizeof(QzLoadTable_T), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == table) {
+        return QZ_FAIL;
+    }
+
+    if (!__sync_bool_compare_and_swap(&table->magic, 0, LOAD_MAGIC) &&
+        LOAD_MAGIC != table->magic) {
+        QZ_DEBUG("%s has an unknown layout\n", name);
+        munmap(table, sizeof(QzLoadTable_T));
+        return QZ_FAIL;
+    }
+    g_load = table;
+
+    for (k = 0; k < QZ_LOAD_SLOTS; k++) {
+        pid = g_load->slot[k].pid;
+        if (pid > 0 && !slotLive(pid)) {
+            reclaimSlot(&g_load->slot[k], pid);
+        }
+    }
+
+    for (k = 0; k < QZ_LOAD_SLOTS && NULL == g_slot; k++) {
+        if (__sync_bool_compare_and_swap(&g_load->slot[k].pid,
+                                         LOAD_SLOT_FREE, me)) {
+            g_slot = &g_load->slot[k];
+            g_slot->section = -1;
+        }
+    }
+
+    if (NULL == g_slot) {
+        QZ_DEBUG("%s is full\n", name);
+        munmap(g_load, sizeof(QzLoadTable_T));
+        g_load = NULL;
+        return QZ_FAIL;
+    }
+
+    return QZ_OK;
+}
+
+void qzLoadDetach(void)
+{
+    if (NULL == g_load) {
+        return;
+    }
+
+    reclaimSlot(g_slot, g_slot->pid);
+    munmap(g_load, sizeof(QzLoadTable_T));
+    g_load = NULL;
+    g_slot = NULL;
+}
+
+/* The child of a fork must not touch the slot of its parent, it takes
+ * one of its own when it initializes again
+ */
+void qzLoadAtFork(void)
+{
+    if (NULL == g_load) {
+        return;
+    }
+
+    munmap(g_load, sizeof(QzLoadTable_T));
+    g_load = NULL;
+    g_slot = NULL;
+}
+
+/* Pick the config section with the fewest processes and requests of
+ * other processes, ties go to first and then to the sections after it
+ */
+int qzLoadPickSection(int first)
+{
+    int k, d, s, best = first % QZ_LOAD_SECTIONS;
+    unsigned long load[QZ_LOAD_SECTIONS] = {0};
+    QzLoadSlot_T *slot;
+
+    if (NULL == g_load) {
+        return best;
+    }
+
+    for (k = 0; k < QZ_LOAD_SLOTS; k++) {
+        slot = &g_load->slot[k];
+        s = slot->section;
+        if (slot == g_slot || s < 0 || s >= QZ_LOAD_SECTIONS ||
+            !slotLive(slot->pid)) {
+            continue;
+        }
+        load[s]++;
+        for (d = 0; d < QAT_MAX_DEVICES; d++) {
+            load[s] += slot->dev[d];
+        }
+    }
+
+    for (k = 1; k < QZ_LOAD_SECTIONS; k++) {
+        s = (first + k) % QZ_LOAD_SECTIONS;
+        if (load[s] < load[best]) {
+            best = s;
+        }
+    }
+
+    return best;
+}
+
+void qzLoadSetSection(int section)
+{
+    if (NULL != g_slot) {
+        g_slot->section = section;
+    }
+}
+
+void qzLoadInc(unsigned int dev)
+{
+    if (NULL != g_slot) {
+        dev %= QAT_MAX_DEVICES;
+        __sync_fetch_and_add(&g_slot->dev[dev], 1);
+        __sync_fetch_and_add(&g_load->dev[dev], 1);
+    }
+}
+
+void qzLoadDec(unsigned int dev)
+{
+    if (NULL != g_slot) {
+        dev %= QAT_MAX_DEVICES;
+        __sync_fetch_and_sub(&g_slot->dev[dev], 1);
+        __sync_fetch_and_sub(&g_load->dev[dev], 1);
+    }
+}
+
+unsigned long qzLoadDevice(unsigned int dev)
+{
+    return (NULL != g_load) ? g_load->dev[dev % QAT_MAX_DEVICES] : 0;
+}
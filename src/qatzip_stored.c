@@ -0,0 +1,177 @@
+/***************************************************************************
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2007-2017 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+
+
+/* Incompressible data detection and stored deflate blocks.
+ *
+ * Random or already compressed data only grows when deflated. A byte
+ * histogram over a few samples of a chunk estimates its order-2 entropy,
+ * chunks close to 8 bits per byte are written as stored blocks by the
+ * CPU instead of going through the accelerator. A run of chunks that
+ * compress poorly anyway stores the next chunks of the session without
+ * sampling them.
+ */
+
+#include <string.h>
+#include <zlib.h>
+
+#include "cpa.h"
+#include "cpa_dc.h"
+#include "qatzip.h"
+#include "qatzipP.h"
+#include "qz_utils.h"
+
+#define SAMPLE_CNT          16
+#define SAMPLE_SZ           256
+/*sum of p^2 below 1/240, about 7.9 bits per byte*/
+#define ENTROPY_DIV         240
+#define STORED_BLK_MAX      65535
+#define STORED_HDR_SZ       5
+
+/* Returns 1 if the sampled byte distribution of src is close to uniform */
+int qzIsIncompressible(const unsigned char *src, unsigned int len)
+{
+    unsigned int hist[256] = {0};
+    unsigned long n = SAMPLE_CNT * SAMPLE_SZ, sq = 0;
+    unsigned int k, m, step;
+    const unsigned char *p;
+
+    /*small chunks are cheap to compress*/
+    if (len < SAMPLE_CNT * SAMPLE_SZ) {
+        return 0;
+    }
+
+    step = (len - SAMPLE_SZ) / (SAMPLE_CNT - 1);
+    for (k = 0; k < SAMPLE_CNT; k++) {
+        p = src + k * step;
+        for (m = 0; m < SAMPLE_SZ; m++) {
+            hist[p[m]]++;
+        }
+    }
+
+    /*unbiased count of equal byte pairs*/
+    for (k = 0; k < 256; k++) {
+        if (hist[k] > 1) {
+            sq += (unsigned long)hist[k] * (hist[k] - 1);
+        }
+    }
+
+    return sq * ENTROPY_DIV < n * (n - 1);
+}
+
+unsigned int qzStoredSz(unsigned int len)
+{
+    unsigned int blk_cnt = (len + STORED_BLK_MAX - 1) / STORED_BLK_MAX;
+
+    return len + STORED_HDR_SZ * (blk_cnt ? blk_cnt : 1);
+}
+
+/* Write src as stored blocks, the last one final if final is set.
+ * Returns the bytes written, qzStoredSz(len) at most.
+ */
+unsigned int qzStoredGen(unsigned char *dest, const unsigned char *src,
+                         unsigned int len, int final)
+{
+    unsigned char *p = dest;
+    unsigned int blk;
+
+    do {
+        blk = (len > STORED_BLK_MAX) ? STORED_BLK_MAX : len;
+        len -= blk;
+        p[0] = (final && 0 == len) ? 1 : 0;
+        p[1] = GET_LOWER_8BITS(blk);
+        p[2] = GET_LOWER_8BITS(blk >> 8);
+        p[3] = GET_LOWER_8BITS(~blk);
+        p[4] = GET_LOWER_8BITS(~blk >> 8);
+        p += STORED_HDR_SZ;
+        memcpy(p, src, blk);
+        p += blk;
+        src += blk;
+    } while (len);
+
+    return (unsigned int)(p - dest);
+}
+
+/* Decide whether the next chunk of the session is stored, called from
+ * the submitting side only
+ */
+int qzStoreChunk(QzSess_T *qz_sess, const unsigned char *src,
+                 unsigned int len)
+{
+    unsigned long trips;
+
+    if (0 == qz_sess->sess_params.store_incompressible) {
+        return 0;
+    }
+
+    trips = QZ_STAT_GET(qz_sess->poor_trips);
+    if (trips != qz_sess->trips_seen) {
+        qz_sess->trips_seen = trips;
+        qz_sess->bypass_left = QZ_BYPASS_CHUNKS;
+    }
+
+    if (qz_sess->bypass_left) {
+        qz_sess->bypass_left--;
+        return 1;
+    }
+
+    return qzIsIncompressible(src, len);
+}
+
+/* Track the ratio of compressed chunks, called from the receiving side
+ * only. A run of poor ratios starts a bypass.
+ */
+void qzRatioUpdate(QzSess_T *qz_sess, unsigned int consumed,
+                   unsigned int produced)
+{
+    unsigned int ratio;
+
+    if (consumed) {
+        ratio = (unsigned int)(((unsigned long)produced << 8) / consumed);
+        qz_sess->ratio_avg = qz_sess->ratio_avg ?
+                             (qz_sess->ratio_avg * 7 + ratio) / 8 : ratio;
+    }
+
+    /*saving less than 1/16 is poor*/
+    if ((unsigned long)produced * 16 < (unsigned long)consumed * 15) {
+        qz_sess->poor_run = 0;
+        return;
+    }
+
+    if (++qz_sess->poor_run >= QZ_POOR_RUN_MAX) {
+        qz_sess->poor_run = 0;
+        QZ_STAT_ADD(qz_sess->poor_trips, 1);
+    }
+}
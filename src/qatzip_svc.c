@@ -0,0 +1,1001 @@
+/***************************************************************************
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2007-2017 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+
+
+/* Compression service.
+ *
+ * qzipd owns the QAT instances of the host and serves the sessions of the
+ * processes that set the service parameter, so that hundreds of small
+ * processes neither start instances nor pin buffers of their own. The
+ * daemon publishes a control segment in /dev/shm with a doorbell and a
+ * table of clients. Every client process creates a segment with
+ * SVC_SLOTS request slots, each with an input and an output buffer, and a
+ * lock free queue of submitted slots. A client copies its input to a free
+ * slot, queues the slot and rings the doorbell, a daemon worker takes the
+ * slot from the queue, runs the request on a session kept for the client
+ * session and posts the semaphore of the slot. The slot buffers are not
+ * pinned, so to the daemon they are caller buffers like any other: the
+ * input is copied from the slot into the pinned buffers of an instance
+ * and the output back into the slot. Each direction thus takes two copies
+ * more than a call in the process, one in the client and one in the
+ * daemon. Requests larger than a slot go through it in pieces, the daemon
+ * session carries the stream state.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "cpa.h"
+#include "cpa_dc.h"
+#include "qatzip.h"
+#include "qatzipP.h"
+#include "qz_utils.h"
+
+#define SVC_MAGIC           0x515a5331  /*"QZS1"*/
+#define SVC_CLIENTS         256
+#define SVC_SLOTS           16          /*a power of 2*/
+#define SVC_BUF_SZ          (1024 * 1024)
+#define SVC_OUT_SZ          (2 * SVC_BUF_SZ)
+#define SVC_POLL_MS         100
+#define SVC_THREADS_MAX     64
+
+enum {
+    SVC_COMPRESS = 1,
+    SVC_DECOMPRESS,
+    SVC_CLOSE
+};
+
+typedef struct SvcCell_S {
+    unsigned long seq;
+    unsigned int slot;
+} SvcCell_T;
+
+/* Bounded multi producer, multi consumer queue of slot numbers, a cell
+ * is ready to fill when its seq equals the tail and ready to take when
+ * it equals the head plus one
+ */
+typedef struct SvcQueue_S {
+    SvcCell_T cell[SVC_SLOTS];
+    unsigned long head;
+    unsigned long tail;
+} SvcQueue_T;
+
+typedef struct SvcSlot_S {
+    sem_t done;
+    int op;
+    int status;
+    unsigned long sid;
+    QzSessionParams_T params;
+    unsigned int last;
+    unsigned int src_len;
+    unsigned int dest_len;
+    unsigned long crc;
+} SvcSlot_T;
+
+typedef struct SvcClient_S {
+    unsigned int magic;
+    pid_t pid;
+    unsigned long free;  /*bitmap of free slots*/
+    SvcQueue_T queue;
+    SvcSlot_T slot[SVC_SLOTS];
+} SvcClient_T;
+
+typedef struct SvcCtl_S {
+    unsigned int magic;
+    pid_t pid;
+    sem_t bell;
+    pid_t client[SVC_CLIENTS];
+} SvcCtl_T;
+
+#define SVC_DATA_OFF    ((sizeof(SvcClient_T) + 4095) & ~4095UL)
+#define SVC_SEG_SZ      (SVC_DATA_OFF + SVC_SLOTS * (SVC_BUF_SZ + SVC_OUT_SZ))
+
+static inline unsigned char *slotIn(SvcClient_T *seg, int k)
+{
+    return (unsigned char *)seg + SVC_DATA_OFF +
+           (unsigned long)k * (SVC_BUF_SZ + SVC_OUT_SZ);
+}
+
+static inline unsigned char *slotOut(SvcClient_T *seg, int k)
+{
+    return slotIn(seg, k) + SVC_BUF_SZ;
+}
+
+static void ctlName(char *name, size_t len)
+{
+    snprintf(name, len, "/qatzip_svc.%u", (unsigned int)getuid());
+}
+
+static void clientName(char *name, size_t len, pid_t pid)
+{
+    snprintf(name, len, "/qatzip_svc.%u.%d", (unsigned int)getuid(), (int)pid);
+}
+
+static int pidLive(pid_t pid)
+{
+    return pid > 0 && (0 == kill(pid, 0) || EPERM == errno);
+}
+
+static void *mapSegment(const char *name, size_t sz, int create)
+{
+    int fd;
+    void *p;
+
+    fd = shm_open(name, O_RDWR | (create ? O_CREAT | O_TRUNC : 0),
+                  S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (create && 0 != ftruncate(fd, sz)) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    p = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return (MAP_FAILED == p) ? NULL : p;
+}
+
+static int semWaitMs(sem_t *sem, unsigned int ms)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return sem_timedwait(sem, &ts);
+}
+
+static void queueInit(SvcQueue_T *q)
+{
+    unsigned long i;
+
+    for (i = 0; i < SVC_SLOTS; i++) {
+        q->cell[i].seq = i;
+    }
+    q->head = 0;
+    q->tail = 0;
+}
+
+static void queuePush(SvcQueue_T *q, unsigned int slot)
+{
+    SvcCell_T *c;
+    unsigned long pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+
+    /*never full, a queue has a cell for every slot*/
+    while (1) {
+        c = &q->cell[pos & (SVC_SLOTS - 1)];
+        if (__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) == pos &&
+            __sync_bool_compare_and_swap(&q->tail, pos, pos + 1)) {
+            c->slot = slot;
+            __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+            return;
+        }
+        pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    }
+}
+
+static int queuePop(SvcQueue_T *q)
+{
+    SvcCell_T *c;
+    unsigned int slot;
+    unsigned long seq, pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+
+    while (1) {
+        c = &q->cell[pos & (SVC_SLOTS - 1)];
+        seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos + 1) {
+            if (__sync_bool_compare_and_swap(&q->head, pos, pos + 1)) {
+                slot = c->slot;
+                __atomic_store_n(&c->seq, pos + SVC_SLOTS, __ATOMIC_RELEASE);
+                return slot;
+            }
+        } else if ((long)(seq - (pos + 1)) < 0) {
+            return -1;
+        }
+        pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Client side
+ */
+static struct {
+    pthread_mutex_t lock;
+    SvcCtl_T *ctl;
+    SvcClient_T *seg;
+    int idx;
+    sem_t free;
+    unsigned long next_sid;
+    unsigned int users;     /*requests in flight on seg*/
+    unsigned char lost;     /*the daemon went away, detach once idle*/
+    unsigned char exit_set;
+} g_svc = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .idx = -1,
+};
+
+static int daemonLive(SvcCtl_T *ctl)
+{
+    return SVC_MAGIC == ctl->magic && pidLive(ctl->pid);
+}
+
+static void svcDetach(void)
+{
+    char name[64];
+
+    if (NULL != g_svc.seg) {
+        (void)__sync_bool_compare_and_swap(&g_svc.ctl->client[g_svc.idx],
+                                           g_svc.seg->pid, 0);
+        clientName(name, sizeof(name), g_svc.seg->pid);
+        munmap(g_svc.seg, SVC_SEG_SZ);
+        shm_unlink(name);
+        sem_destroy(&g_svc.free);
+        g_svc.seg = NULL;
+        g_svc.idx = -1;
+    }
+    g_svc.lost = 0;
+
+    if (NULL != g_svc.ctl) {
+        munmap(g_svc.ctl, sizeof(SvcCtl_T));
+        g_svc.ctl = NULL;
+    }
+}
+
+static void svcExit(void)
+{
+    pthread_mutex_lock(&g_svc.lock);
+    svcDetach();
+    pthread_mutex_unlock(&g_svc.lock);
+}
+
+/* The segment of the parent stays with the parent, the child of a fork
+ * attaches with a segment of its own
+ */
+void qzSvcAtFork(void)
+{
+    pthread_mutex_init(&g_svc.lock, NULL);
+    if (NULL != g_svc.seg) {
+        munmap(g_svc.seg, SVC_SEG_SZ);
+        g_svc.seg = NULL;
+        g_svc.idx = -1;
+    }
+
+    if (NULL != g_svc.ctl) {
+        munmap(g_svc.ctl, sizeof(SvcCtl_T));
+        g_svc.ctl = NULL;
+    }
+}
+
+/* Attach the process to a running qzipd */
+int qzSvcAttach(void)
+{
+    char name[64];
+    int k, rc = QZ_FAIL;
+    pid_t me = getpid();
+    SvcClient_T *seg;
+
+    pthread_mutex_lock(&g_svc.lock);
+    if (NULL != g_svc.seg) {
+        if (g_svc.seg->pid == me && !g_svc.lost && daemonLive(g_svc.ctl)) {
+            rc = QZ_OK;
+            goto done;
+        }
+        /*requests still in flight find the daemon gone and detach*/
+        if (g_svc.users) {
+            g_svc.lost = 1;
+            goto done;
+        }
+        svcDetach();
+    }
+
+    ctlName(name, sizeof(name));
+    g_svc.ctl = mapSegment(name, sizeof(SvcCtl_T), 0);
+    if (NULL == g_svc.ctl || !daemonLive(g_svc.ctl)) {
+        goto fail;
+    }
+
+    clientName(name, sizeof(name), me);
+    seg = mapSegment(name, SVC_SEG_SZ, 1);
+    if (NULL == seg) {
+        goto fail;
+    }
+    seg->pid = me;
+    seg->free = (SVC_SLOTS < 64) ? (1UL << SVC_SLOTS) - 1 : ~0UL;
+    queueInit(&seg->queue);
+    for (k = 0; k < SVC_SLOTS; k++) {
+        sem_init(&seg->slot[k].done, 1, 0);
+    }
+    seg->magic = SVC_MAGIC;
+    g_svc.seg = seg;
+    sem_init(&g_svc.free, 0, SVC_SLOTS);
+
+    for (k = 0; k < SVC_CLIENTS; k++) {
+        if (__sync_bool_compare_and_swap(&g_svc.ctl->client[k], 0, me)) {
+            g_svc.idx = k;
+            break;
+        }
+    }
+    if (-1 == g_svc.idx) {
+        QZ_DEBUG("qzipd serves %d clients already\n", SVC_CLIENTS);
+        goto fail;
+    }
+
+    if (!g_svc.exit_set) {
+        g_svc.exit_set = 1;
+        atexit(svcExit);
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    svcDetach();
+done:
+    pthread_mutex_unlock(&g_svc.lock);
+    return rc;
+}
+
+unsigned long qzSvcNewSid(void)
+{
+    return __sync_add_and_fetch(&g_svc.next_sid, 1);
+}
+
+static int claimSlot(void)
+{
+    int k;
+    unsigned long free;
+
+    /*slots held by requests a dead daemon never answers do not come back*/
+    while (0 != semWaitMs(&g_svc.free, SVC_POLL_MS)) {
+        if ((EINTR != errno && ETIMEDOUT != errno) ||
+            !daemonLive(g_svc.ctl)) {
+            return -1;
+        }
+    }
+
+    while (1) {
+        free = g_svc.seg->free;
+        k = __builtin_ctzl(free);
+        if (__sync_bool_compare_and_swap(&g_svc.seg->free, free,
+                                         free & ~(1UL << k))) {
+            return k;
+        }
+    }
+}
+
+static void releaseSlot(int k)
+{
+    __sync_fetch_and_or(&g_svc.seg->free, 1UL << k);
+    sem_post(&g_svc.free);
+}
+
+static int svcEnter(void)
+{
+    int rc = 0;
+
+    pthread_mutex_lock(&g_svc.lock);
+    if (NULL != g_svc.seg && !g_svc.lost && g_svc.seg->pid == getpid()) {
+        g_svc.users++;
+        rc = 1;
+    }
+    pthread_mutex_unlock(&g_svc.lock);
+    return rc;
+}
+
+/* Leave the segment, the last request out detaches from a lost daemon */
+static void svcLeave(int lost)
+{
+    pthread_mutex_lock(&g_svc.lock);
+    if (lost) {
+        g_svc.lost = 1;
+    }
+    if (0 == --g_svc.users && g_svc.lost) {
+        svcDetach();
+    }
+    pthread_mutex_unlock(&g_svc.lock);
+}
+
+/* Run one piece of a request of the session through a slot. QZ_SVC_LOST
+ * leaves the lengths alone, the daemon is gone and the caller takes over
+ */
+static int svcRequest(QzSess_T *qz_sess, int op, const unsigned char *src,
+                      unsigned int *src_len, unsigned char *dest,
+                      unsigned int *dest_len, unsigned int last,
+                      unsigned long *crc)
+{
+    int k, rc;
+    SvcSlot_T *slot;
+
+    if (!svcEnter()) {
+        return QZ_SVC_LOST;
+    }
+
+    k = claimSlot();
+    if (k < 0) {
+        QZ_ERROR("qzipd is gone\n");
+        svcLeave(1);
+        return QZ_SVC_LOST;
+    }
+
+    slot = &g_svc.seg->slot[k];
+    if (*src_len) {
+        QZ_MEMCPY(slotIn(g_svc.seg, k), src, SVC_BUF_SZ, *src_len);
+    }
+    slot->op = op;
+    slot->sid = qz_sess->svc_sid;
+    slot->params = qz_sess->sess_params;
+    slot->last = last;
+    slot->src_len = *src_len;
+    slot->dest_len = (*dest_len < SVC_OUT_SZ) ? *dest_len : SVC_OUT_SZ;
+    slot->crc = 0;
+    queuePush(&g_svc.seg->queue, k);
+    sem_post(&g_svc.ctl->bell);
+
+    /*a slot a dead daemon never answers is not given back*/
+    while (0 != semWaitMs(&slot->done, SVC_POLL_MS)) {
+        if (!daemonLive(g_svc.ctl)) {
+            QZ_ERROR("qzipd is gone\n");
+            svcLeave(1);
+            return QZ_SVC_LOST;
+        }
+    }
+
+    rc = slot->status;
+    *src_len = slot->src_len;
+    *dest_len = slot->dest_len;
+    if (*dest_len) {
+        QZ_MEMCPY(dest, slotOut(g_svc.seg, k), *dest_len, *dest_len);
+    }
+    if (NULL != crc) {
+        *crc = slot->crc;
+    }
+    releaseSlot(k);
+    svcLeave(0);
+    return rc;
+}
+
+/* The daemon went away under a session: it is served by the process from
+ * now on and the call starts over there, unless a compressed stream was
+ * left open at the daemon
+ */
+static int svcLost(QzSession_T *sess, unsigned int *src_len,
+                   unsigned int *dest_len)
+{
+    QzSess_T *qz_sess = (QzSess_T *)sess->internal;
+
+    qz_sess->svc_sid = 0;
+    if (qz_sess->svc_open) {
+        qz_sess->svc_open = 0;
+        *src_len = 0;
+        *dest_len = 0;
+        return QZ_FAIL;
+    }
+    return QZ_SVC_LOST;
+}
+
+int qzSvcCompress(QzSession_T *sess, const unsigned char *src,
+                  unsigned int *src_len, unsigned char *dest,
+                  unsigned int *dest_len, unsigned int last,
+                  unsigned long *crc)
+{
+    int rc;
+    QzSess_T *qz_sess = (QzSess_T *)sess->internal;
+    QzDataFormat_T data_fmt = qz_sess->sess_params.data_fmt;
+    unsigned int in_sz, out_sz, total_in = 0, total_out = 0;
+    unsigned long piece_crc;
+
+    if (NULL != crc) {
+        *crc = streamCksumInit(data_fmt);
+    }
+
+    do {
+        in_sz = *src_len - total_in;
+        if (in_sz > SVC_BUF_SZ) {
+            in_sz = SVC_BUF_SZ;
+        }
+        out_sz = *dest_len - total_out;
+        rc = svcRequest(qz_sess, SVC_COMPRESS, src + total_in, &in_sz,
+                        dest + total_out, &out_sz,
+                        last && total_in + in_sz == *src_len, &piece_crc);
+        if (QZ_SVC_LOST == rc) {
+            return svcLost(sess, src_len, dest_len);
+        }
+        total_in += in_sz;
+        total_out += out_sz;
+        if (NULL != crc) {
+            *crc = streamCksumCombine(data_fmt, *crc, piece_crc, in_sz);
+        }
+        if (QZ_OK != rc || 0 == in_sz) {
+            break;
+        }
+    } while (total_in < *src_len);
+
+    /*a stream left open at the daemon cannot be finished by the caller*/
+    qz_sess->svc_open = QZ_DEFLATE_GZIP_EXT != data_fmt && QZ_OK == rc && !last;
+    *src_len = total_in;
+    *dest_len = total_out;
+    sess->total_in = total_in;
+    sess->total_out = total_out;
+    return rc;
+}
+
+/* Whether the service can take the compressed data. A single stream only
+ * decompresses in one piece, larger ones are left to the software of the
+ * caller as they would be by the hardware path
+ */
+int qzSvcDecompressible(QzSess_T *qz_sess, const unsigned char *src,
+                        unsigned int src_len, unsigned int dest_len)
+{
+    if (QZ_DEFLATE_GZIP_EXT == qz_sess->sess_params.data_fmt &&
+        src_len >= qzGzipHeaderSz() && !isStdGzipHeader(src)) {
+        return 1;
+    }
+
+    return src_len <= SVC_BUF_SZ && dest_len <= SVC_OUT_SZ;
+}
+
+/* The whole members at the start of src that fit in a slot, as much as
+ * fits when the members cannot be told apart
+ */
+static unsigned int svcPiece(const unsigned char *src, unsigned int src_len)
+{
+    unsigned long pos = 0, len, u_sz;
+    unsigned long max = (src_len < SVC_BUF_SZ) ? src_len : SVC_BUF_SZ;
+
+    while (pos < max) {
+        len = qzIndexMemberSz(src + pos, src_len - pos);
+        if (0 == len) {
+            len = qzGzipMemberSz(src + pos, src_len - pos, &u_sz);
+        }
+        if (0 == len || pos + len > max) {
+            break;
+        }
+        pos += len;
+    }
+
+    return pos ? pos : max;
+}
+
+int qzSvcDecompress(QzSession_T *sess, const unsigned char *src,
+                    unsigned int *src_len, unsigned char *dest,
+                    unsigned int *dest_len, unsigned long *crc)
+{
+    int rc;
+    QzSess_T *qz_sess = (QzSess_T *)sess->internal;
+    QzDataFormat_T data_fmt = qz_sess->sess_params.data_fmt;
+    unsigned int in_sz, out_sz, total_in = 0, total_out = 0;
+    unsigned long piece_crc;
+
+    if (NULL != crc) {
+        *crc = streamCksumInit(data_fmt);
+    }
+
+    /*every piece ends at the last member it holds in full*/
+    do {
+        in_sz = svcPiece(src + total_in, *src_len - total_in);
+        out_sz = *dest_len - total_out;
+        rc = svcRequest(qz_sess, SVC_DECOMPRESS, src + total_in, &in_sz,
+                        dest + total_out, &out_sz, 1, &piece_crc);
+        if (QZ_SVC_LOST == rc) {
+            return svcLost(sess, src_len, dest_len);
+        }
+        total_in += in_sz;
+        total_out += out_sz;
+        if (NULL != crc) {
+            *crc = streamCksumCombine(data_fmt, *crc, piece_crc, out_sz);
+        }
+        if ((QZ_OK != rc && QZ_BUF_ERROR != rc) || 0 == in_sz) {
+            break;
+        }
+    } while (total_in < *src_len);
+
+    *src_len = total_in;
+    *dest_len = total_out;
+    sess->total_in = total_in;
+    sess->total_out = total_out;
+    return rc;
+}
+
+/* Drop the daemon session of a client session */
+void qzSvcClose(QzSess_T *qz_sess)
+{
+    unsigned int in_sz = 0, out_sz = 0;
+
+    if (0 == qz_sess->svc_sid) {
+        return;
+    }
+
+    if (NULL != g_svc.seg && g_svc.seg->pid == getpid()) {
+        (void)svcRequest(qz_sess, SVC_CLOSE, NULL, &in_sz, NULL, &out_sz, 0,
+                         NULL);
+    }
+    qz_sess->svc_sid = 0;
+}
+
+/*
+ * Daemon side
+ */
+typedef struct SvcSess_S {
+    struct SvcSess_S *next;
+    pid_t pid;
+    unsigned long sid;
+    QzSession_T sess;
+} SvcSess_T;
+
+static struct {
+    pthread_mutex_t lock;
+    SvcCtl_T *ctl;
+    SvcClient_T *cli[SVC_CLIENTS];
+    pid_t cli_pid[SVC_CLIENTS];
+    unsigned int cli_ref[SVC_CLIENTS];
+    SvcSess_T *sess;
+    unsigned int rr;
+    unsigned int threads;
+    pthread_t tid[SVC_THREADS_MAX];
+    volatile int stop;
+} g_srv = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* Find or set up the daemon session of a client session, under the lock */
+static SvcSess_T *srvSession(pid_t pid, unsigned long sid,
+                             QzSessionParams_T *params)
+{
+    int rc;
+    SvcSess_T *s;
+
+    for (s = g_srv.sess; NULL != s; s = s->next) {
+        if (s->pid == pid && s->sid == sid) {
+            return s;
+        }
+    }
+
+    s = calloc(1, sizeof(SvcSess_T));
+    if (NULL == s) {
+        return NULL;
+    }
+
+    params->service = 0;
+    rc = qzSetupSession(&s->sess, params);
+    if (QZ_OK != rc && QZ_NO_HW != rc) {
+        (void)qzTeardownSession(&s->sess);
+        free(s);
+        return NULL;
+    }
+    s->pid = pid;
+    s->sid = sid;
+    s->next = g_srv.sess;
+    g_srv.sess = s;
+    return s;
+}
+
+static void srvDropSession(SvcSess_T *drop)
+{
+    SvcSess_T **s;
+
+    for (s = &g_srv.sess; NULL != *s; s = &(*s)->next) {
+        if (*s == drop) {
+            *s = drop->next;
+            break;
+        }
+    }
+    (void)qzTeardownSession(&drop->sess);
+    free(drop);
+}
+
+/* Let go of a client that left or died, under the lock */
+static void srvDropClient(int c)
+{
+    char name[64];
+    SvcSess_T *s, *next;
+    pid_t pid = g_srv.cli_pid[c];
+
+    for (s = g_srv.sess; NULL != s; s = next) {
+        next = s->next;
+        if (s->pid == pid) {
+            srvDropSession(s);
+        }
+    }
+
+    munmap(g_srv.cli[c], SVC_SEG_SZ);
+    g_srv.cli[c] = NULL;
+    g_srv.cli_pid[c] = 0;
+    if (!pidLive(pid)) {
+        clientName(name, sizeof(name), pid);
+        shm_unlink(name);
+        (void)__sync_bool_compare_and_swap(&g_srv.ctl->client[c], pid, 0);
+    }
+}
+
+static void srvReap(void)
+{
+    char name[64];
+    int c;
+    pid_t pid;
+
+    pthread_mutex_lock(&g_srv.lock);
+    for (c = 0; c < SVC_CLIENTS; c++) {
+        pid = g_srv.ctl->client[c];
+        if (NULL != g_srv.cli[c] && 0 == g_srv.cli_ref[c] &&
+            (pid != g_srv.cli_pid[c] || !pidLive(pid))) {
+            srvDropClient(c);
+        } else if (NULL == g_srv.cli[c] && pid > 0 && !pidLive(pid)) {
+            clientName(name, sizeof(name), pid);
+            shm_unlink(name);
+            (void)__sync_bool_compare_and_swap(&g_srv.ctl->client[c], pid, 0);
+        }
+    }
+    pthread_mutex_unlock(&g_srv.lock);
+}
+
+/* The segment of client c, mapped on first use, under the lock */
+static SvcClient_T *srvClient(int c)
+{
+    char name[64];
+    pid_t pid = g_srv.ctl->client[c];
+    SvcClient_T *seg;
+
+    if (pid <= 0) {
+        return NULL;
+    }
+    if (NULL != g_srv.cli[c] && g_srv.cli_pid[c] == pid) {
+        return g_srv.cli[c];
+    }
+    if (NULL != g_srv.cli[c]) {
+        if (g_srv.cli_ref[c]) {
+            return NULL;
+        }
+        srvDropClient(c);
+    }
+
+    clientName(name, sizeof(name), pid);
+    seg = mapSegment(name, SVC_SEG_SZ, 0);
+    if (NULL == seg) {
+        return NULL;
+    }
+    if (SVC_MAGIC != seg->magic || seg->pid != pid) {
+        munmap(seg, SVC_SEG_SZ);
+        return NULL;
+    }
+    g_srv.cli[c] = seg;
+    g_srv.cli_pid[c] = pid;
+    return seg;
+}
+
+static void srvRun(SvcSess_T *s, SvcClient_T *seg, int k)
+{
+    SvcSlot_T *slot = &seg->slot[k];
+    unsigned char *in = slotIn(seg, k);
+    unsigned char *out = slotOut(seg, k);
+
+    if (slot->src_len > SVC_BUF_SZ) {
+        slot->src_len = SVC_BUF_SZ;
+    }
+    if (slot->dest_len > SVC_OUT_SZ) {
+        slot->dest_len = SVC_OUT_SZ;
+    }
+
+    switch (slot->op) {
+    case SVC_COMPRESS:
+        slot->status = qzCompressCrc(&s->sess, in, &slot->src_len, out,
+                                     &slot->dest_len, slot->last, &slot->crc);
+        break;
+    case SVC_DECOMPRESS:
+        slot->status = qzDecompressCrc(&s->sess, in, &slot->src_len, out,
+                                       &slot->dest_len, &slot->crc);
+        break;
+    default:
+        slot->status = QZ_PARAMS;
+        slot->src_len = 0;
+        slot->dest_len = 0;
+    }
+}
+
+/* Serve one queued request of any client, 0 when none is left */
+static int srvServeOne(void)
+{
+    int n, c, k = -1;
+    SvcClient_T *seg = NULL;
+    SvcSlot_T *slot;
+    SvcSess_T *s = NULL;
+
+    pthread_mutex_lock(&g_srv.lock);
+    for (n = 0; n < SVC_CLIENTS && -1 == k; n++) {
+        c = (g_srv.rr + n) % SVC_CLIENTS;
+        seg = srvClient(c);
+        if (NULL != seg) {
+            k = queuePop(&seg->queue);
+        }
+    }
+    if (-1 == k) {
+        pthread_mutex_unlock(&g_srv.lock);
+        return 0;
+    }
+    g_srv.rr = c + 1;
+
+    slot = &seg->slot[k];
+    if (SVC_CLOSE == slot->op) {
+        for (s = g_srv.sess; NULL != s; s = s->next) {
+            if (s->pid == seg->pid && s->sid == slot->sid) {
+                srvDropSession(s);
+                break;
+            }
+        }
+        slot->status = QZ_OK;
+        slot->src_len = 0;
+        slot->dest_len = 0;
+        pthread_mutex_unlock(&g_srv.lock);
+        sem_post(&slot->done);
+        return 1;
+    }
+
+    s = srvSession(seg->pid, slot->sid, &slot->params);
+    g_srv.cli_ref[c]++;
+    pthread_mutex_unlock(&g_srv.lock);
+
+    if (NULL == s) {
+        slot->status = QZ_FAIL;
+        slot->src_len = 0;
+        slot->dest_len = 0;
+    } else {
+        srvRun(s, seg, k);
+    }
+    sem_post(&slot->done);
+
+    pthread_mutex_lock(&g_srv.lock);
+    g_srv.cli_ref[c]--;
+    pthread_mutex_unlock(&g_srv.lock);
+    return 1;
+}
+
+/* Drain the queues on every wake, a ring raced by two producers can
+ * hold a request whose doorbell was consumed by another worker
+ */
+static void *srvWorker(void *arg)
+{
+    (void)arg;
+
+    while (!g_srv.stop) {
+        if (0 != semWaitMs(&g_srv.ctl->bell, SVC_POLL_MS) &&
+            ETIMEDOUT == errno) {
+            srvReap();
+        }
+        while (!g_srv.stop && srvServeOne()) {
+            ;
+        }
+    }
+
+    return NULL;
+}
+
+/* Start serving the clients of the user with threads workers */
+int qzSvcStart(unsigned int threads)
+{
+    char name[64];
+    unsigned int t;
+    SvcCtl_T *ctl;
+
+    if (0 == threads || threads > SVC_THREADS_MAX) {
+        return QZ_PARAMS;
+    }
+    if (NULL != g_srv.ctl) {
+        return QZ_DUPLICATE;
+    }
+
+    ctlName(name, sizeof(name));
+    ctl = mapSegment(name, sizeof(SvcCtl_T), 0);
+    if (NULL != ctl) {
+        if (daemonLive(ctl)) {
+            QZ_ERROR("qzipd %d serves %s already\n", (int)ctl->pid, name);
+            munmap(ctl, sizeof(SvcCtl_T));
+            return QZ_FAIL;
+        }
+        munmap(ctl, sizeof(SvcCtl_T));
+    }
+
+    ctl = mapSegment(name, sizeof(SvcCtl_T), 1);
+    if (NULL == ctl) {
+        QZ_ERROR("Cannot create %s: %s\n", name, strerror(errno));
+        return QZ_FAIL;
+    }
+    sem_init(&ctl->bell, 1, 0);
+    ctl->pid = getpid();
+    __sync_synchronize();
+    ctl->magic = SVC_MAGIC;
+
+    g_srv.ctl = ctl;
+    g_srv.stop = 0;
+    for (t = 0; t < threads; t++) {
+        if (0 != pthread_create(&g_srv.tid[t], NULL, srvWorker, NULL)) {
+            break;
+        }
+    }
+    g_srv.threads = t;
+    if (0 == t) {
+        qzSvcStop();
+        return QZ_FAIL;
+    }
+
+    return QZ_OK;
+}
+
+void qzSvcStop(void)
+{
+    char name[64];
+    unsigned int t;
+    int c;
+
+    if (NULL == g_srv.ctl) {
+        return;
+    }
+
+    g_srv.ctl->magic = 0;
+    g_srv.stop = 1;
+    for (t = 0; t < g_srv.threads; t++) {
+        pthread_join(g_srv.tid[t], NULL);
+    }
+    g_srv.threads = 0;
+
+    pthread_mutex_lock(&g_srv.lock);
+    for (c = 0; c < SVC_CLIENTS; c++) {
+        if (NULL != g_srv.cli[c]) {
+            srvDropClient(c);
+        }
+    }
+    pthread_mutex_unlock(&g_srv.lock);
+
+    sem_destroy(&g_srv.ctl->bell);
+    munmap(g_srv.ctl, sizeof(SvcCtl_T));
+    g_srv.ctl = NULL;
+    ctlName(name, sizeof(name));
+    shm_unlink(name);
+}
@@ -66,6 +66,282 @@ static void gen_qatzip_hdr(gz_header *hdr)
     hdr->os = 255;
 }
 
+/* Keep the last DEFLATE_WINDOW_SZ bytes of the open member input
+ * to prime the next software call
+ */
+static void saveWindow(QzSess_T *qz_sess, const unsigned char *src,
+                       unsigned int len)
+{
+    unsigned int keep;
+
+    if (NULL == qz_sess->win) {
+        qz_sess->win = malloc(DEFLATE_WINDOW_SZ);
+        if (NULL == qz_sess->win) {
+            qz_sess->win_len = 0;
+            return;
+        }
+    }
+
+    if (len >= DEFLATE_WINDOW_SZ) {
+        memcpy(qz_sess->win, src + len - DEFLATE_WINDOW_SZ, DEFLATE_WINDOW_SZ);
+        qz_sess->win_len = DEFLATE_WINDOW_SZ;
+    } else {
+        keep = MIN(qz_sess->win_len, DEFLATE_WINDOW_SZ - len);
+        memmove(qz_sess->win, qz_sess->win + qz_sess->win_len - keep, keep);
+        memcpy(qz_sess->win + keep, src, len);
+        qz_sess->win_len = keep + len;
+    }
+}
+
+/* The software compression of the single stream formats, every call
+ * appends a sync flushed raw deflate segment to the open stream
+ */
+static int qzSWCompressMember(QzSess_T *qz_sess, const unsigned char *src,
+                              unsigned int *src_len, unsigned char *dest,
+                              unsigned int *dest_len, unsigned int last)
+{
+    int ret;
+    z_stream stream;
+    unsigned long cksum;
+    unsigned int hdr_sz, ftr_sz, out_len;
+    QzDataFormat_T data_fmt = qz_sess->sess_params.data_fmt;
+    int comp_level = (qz_sess->sess_params.comp_lvl == Z_BEST_COMPRESSION) ? \
+                     Z_BEST_COMPRESSION : Z_DEFAULT_COMPRESSION;
+
+    hdr_sz = qz_sess->member_open ? 0 : streamHeaderSz(data_fmt);
+    if (hdr_sz && QZ_DEFLATE_ZLIB == data_fmt && NULL != qz_sess->dict) {
+        hdr_sz += ZLIB_DICT_ID_SZ;
+    }
+    ftr_sz = last ? streamFooterSz(data_fmt) : 0;
+    if (*dest_len <= hdr_sz + ftr_sz) {
+        return QZ_BUF_ERROR;
+    }
+
+    stream.zalloc = (alloc_func)0;
+    stream.zfree = (free_func)0;
+    stream.opaque = (voidpf)0;
+    if (Z_OK != deflateInit2(&stream,
+                             comp_level,
+                             Z_DEFLATED,
+                             -MAX_WBITS,
+                             MAX_MEM_LEVEL,
+                             Z_DEFAULT_STRATEGY)) {
+        return QZ_FAIL;
+    }
+
+    if (qz_sess->member_open && qz_sess->win_len &&
+        Z_OK != deflateSetDictionary(&stream, qz_sess->win, qz_sess->win_len)) {
+        ret = QZ_FAIL;
+        goto done;
+    }
+
+    /*a new stream starts from the preset dictionary*/
+    if (!qz_sess->member_open && NULL != qz_sess->dict &&
+        Z_OK != deflateSetDictionary(&stream, qz_sess->dict, qz_sess->dict_len)) {
+        ret = QZ_FAIL;
+        goto done;
+    }
+
+    stream.next_in   = (z_const Bytef *)src;
+    stream.avail_in  = *src_len;
+    stream.next_out  = (Bytef *)dest + hdr_sz;
+    stream.avail_out = *dest_len - hdr_sz - ftr_sz;
+
+    ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    if ((last && Z_STREAM_END != ret) ||
+        (!last && (Z_OK != ret || 0 == stream.avail_out))) {
+        QZ_DEBUG("qzSWCompressMember: deflate returned %d\n", ret);
+        ret = (0 == stream.avail_out) ? QZ_BUF_ERROR : QZ_FAIL;
+        goto done;
+    }
+
+    if (!qz_sess->member_open) {
+        if (QZ_DEFLATE_ZLIB == data_fmt && NULL != qz_sess->dict) {
+            zlibDictHeaderGen(dest, qz_sess->sess_params.comp_lvl,
+                              qz_sess->dict_id);
+        } else {
+            streamHeaderGen(dest, &qz_sess->sess_params);
+        }
+        qz_sess->member_open = 1;
+        qz_sess->member_cksum = streamCksumInit(data_fmt);
+        qz_sess->member_len = 0;
+        qz_sess->win_len = 0;
+    }
+
+    if (QZ_DEFLATE_ZLIB == data_fmt) {
+        cksum = adler32(adler32(0, NULL, 0), src, *src_len);
+    } else {
+        cksum = crc32(0, src, *src_len);
+    }
+    qz_sess->member_cksum = streamCksumCombine(data_fmt, qz_sess->member_cksum,
+                                               cksum, *src_len);
+    qz_sess->member_len += *src_len;
+    if (NULL != qz_sess->crc32) {
+        *(qz_sess->crc32) = cksum;
+    }
+
+    out_len = hdr_sz + GET_LOWER_32BITS(stream.total_out);
+    if (last) {
+        streamFooterGen(dest + out_len, data_fmt,
+                        qz_sess->member_cksum, qz_sess->member_len);
+        out_len += ftr_sz;
+        qz_sess->member_open = 0;
+        qz_sess->win_len = 0;
+    } else {
+        saveWindow(qz_sess, src, *src_len);
+    }
+
+    *dest_len = out_len;
+    ret = QZ_OK;
+
+done:
+    (void)deflateEnd(&stream);
+    return ret;
+}
+
+/* Compress one chunk into a QZ member, dest_len is set to the member
+ * length and res to its sizes and CRC32
+ */
+static int qzSWCompressChunk(const unsigned char *src, unsigned int src_len,
+                             unsigned char *dest, unsigned int *dest_len,
+                             int comp_level, CpaDcRqResults *res)
+{
+    int ret;
+    z_stream stream;
+    gz_header hdr;
+
+    stream.zalloc = (alloc_func)0;
+    stream.zfree = (free_func)0;
+    stream.opaque = (voidpf)0;
+
+    /*Gzip header*/
+    if (Z_OK != deflateInit2(&stream,
+                             comp_level,
+                             Z_DEFLATED,
+                             MAX_WBITS + GZIP_WRAPPER,
+                             MAX_MEM_LEVEL,
+                             Z_DEFAULT_STRATEGY)) {
+        return QZ_FAIL;
+    }
+
+    gen_qatzip_hdr(&hdr);
+    if (Z_OK != deflateSetHeader(&stream, &hdr)) {
+        (void)deflateEnd(&stream);
+        return QZ_FAIL;
+    }
+
+    stream.next_in   = (z_const Bytef *)src;
+    stream.avail_in  = src_len;
+    stream.next_out  = (Bytef *)dest;
+    stream.avail_out = *dest_len;
+
+    if (Z_STREAM_END != (ret = deflate(&stream, Z_FINISH))) {
+        QZ_ERROR("ERR: deflate failed with return code: %d\n", ret);
+        (void)deflateEnd(&stream);
+        return QZ_FAIL;
+    }
+
+    res->consumed = (Cpa32U) GET_LOWER_32BITS(stream.total_in);
+    res->produced = (Cpa32U) GET_LOWER_32BITS((stream.total_out - qzGzipHeaderSz() -
+                    qzGzipFooterSz()));
+    res->checksum = (Cpa32U) stream.adler;
+    qzGzipHeaderGen(dest, res);
+    *dest_len = GET_LOWER_32BITS(stream.total_out);
+
+    if (Z_OK != deflateEnd(&stream)) {
+        return QZ_FAIL;
+    }
+
+    return QZ_OK;
+}
+
+/* Build the QZ member of one chunk from the compressed chunk cache,
+ * returns QZ_FAIL on a miss
+ */
+static int qzSWCachedChunk(QzCache_T *cache, const unsigned char *src,
+                           unsigned int src_len, unsigned char *dest,
+                           unsigned int *dest_len, CpaDcRqResults *res)
+{
+    unsigned long hdr_sz = qzGzipHeaderSz();
+    unsigned long ftr_sz = qzGzipFooterSz();
+    unsigned int comp_len;
+    uint32_t cksum;
+
+    if (*dest_len <= hdr_sz + ftr_sz ||
+        QZ_OK != qzCacheLookup(cache, src, src_len, dest + hdr_sz,
+                               *dest_len - hdr_sz - ftr_sz, &comp_len, &cksum)) {
+        return QZ_FAIL;
+    }
+
+    res->consumed = src_len;
+    res->produced = comp_len;
+    res->checksum = cksum;
+    qzGzipHeaderGen(dest, res);
+    qzGzipFooterGen(dest + hdr_sz + comp_len, res);
+    *dest_len = hdr_sz + comp_len + ftr_sz;
+    return QZ_OK;
+}
+
+/* Compress one chunk into a QZ member primed with the session dictionary.
+ * The gzip wrapper of zlib cannot take a dictionary, so the member is
+ * framed here around a raw deflate stream.
+ */
+static int qzSWCompressDictChunk(QzSess_T *qz_sess, const unsigned char *src,
+                                 unsigned int src_len, unsigned char *dest,
+                                 unsigned int *dest_len, int comp_level,
+                                 CpaDcRqResults *res)
+{
+    int ret;
+    z_stream stream;
+    unsigned long hdr_sz = qzDictHeaderSz();
+    unsigned long ftr_sz = qzGzipFooterSz();
+
+    if (*dest_len <= hdr_sz + ftr_sz) {
+        return QZ_FAIL;
+    }
+
+    stream.zalloc = (alloc_func)0;
+    stream.zfree = (free_func)0;
+    stream.opaque = (voidpf)0;
+    if (Z_OK != deflateInit2(&stream,
+                             comp_level,
+                             Z_DEFLATED,
+                             -MAX_WBITS,
+                             MAX_MEM_LEVEL,
+                             Z_DEFAULT_STRATEGY)) {
+        return QZ_FAIL;
+    }
+
+    if (Z_OK != deflateSetDictionary(&stream, qz_sess->dict, qz_sess->dict_len)) {
+        (void)deflateEnd(&stream);
+        return QZ_FAIL;
+    }
+
+    stream.next_in   = (z_const Bytef *)src;
+    stream.avail_in  = src_len;
+    stream.next_out  = (Bytef *)dest + hdr_sz;
+    stream.avail_out = *dest_len - hdr_sz - ftr_sz;
+
+    if (Z_STREAM_END != (ret = deflate(&stream, Z_FINISH))) {
+        QZ_ERROR("ERR: deflate failed with return code: %d\n", ret);
+        (void)deflateEnd(&stream);
+        return QZ_FAIL;
+    }
+
+    res->consumed = src_len;
+    res->produced = (Cpa32U) GET_LOWER_32BITS(stream.total_out);
+    res->checksum = (Cpa32U) crc32(0, src, src_len);
+    qzDictHeaderGen(dest, res, qz_sess->dict_id);
+    qzGzipFooterGen(dest + hdr_sz + res->produced, res);
+    *dest_len = GET_LOWER_32BITS(hdr_sz + res->produced + ftr_sz);
+
+    if (Z_OK != deflateEnd(&stream)) {
+        return QZ_FAIL;
+    }
+
+    return QZ_OK;
+}
+
 /* The software failover function for compression request */
 int qzSWCompress(QzSession_T *sess, const unsigned char *src,
                  unsigned int *src_len, unsigned char *dest,
@@ -73,78 +349,167 @@ int qzSWCompress(QzSession_T *sess, const unsigned char *src,
 
 {
     int ret;
-    z_stream stream;
-    gz_header hdr;
     CpaDcRqResults res;
     unsigned int left_input_sz = *src_len;
     unsigned int left_output_sz = *dest_len;
-    unsigned int send_sz;
-    unsigned int cur_hdr_pos = 0;
+    unsigned int send_sz, member_sz;
+    int stored, level;
     unsigned int total_in = 0, total_out = 0;
+    unsigned int idx_len;
+    unsigned long idx_sz = 0;
     QzSess_T *qz_sess = (QzSess_T *) sess->internal;
+    QzCache_T *cache;
     qz_sess->force_sw = 1;
-    const unsigned int chunk_sz = qz_sess->sess_params.hw_buff_sz;
     int comp_level = (qz_sess->sess_params.comp_lvl == Z_BEST_COMPRESSION) ? \
                      Z_BEST_COMPRESSION : Z_DEFAULT_COMPRESSION;
 
-    stream.zalloc = (alloc_func)0;
-    stream.zfree = (free_func)0;
-    stream.opaque = (voidpf)0;
-#ifdef QATZIP_DEBUG
-    insertThread((unsigned int)pthread_self(), COMPRESSION, SW);
-#endif
-    while (left_input_sz) {
-        /*Gzip header*/
-        if (Z_OK != deflateInit2(&stream,
-                                 comp_level,
-                                 Z_DEFLATED,
-                                 MAX_WBITS + GZIP_WRAPPER,
-                                 MAX_MEM_LEVEL,
-                                 Z_DEFAULT_STRATEGY)) {
-            return QZ_FAIL;
-        }
+    if (QZ_DEFLATE_GZIP_EXT != qz_sess->sess_params.data_fmt) {
+        return qzSWCompressMember(qz_sess, src, src_len, dest, dest_len, last);
+    }
+    cache = qzSessCache(qz_sess);
 
-        gen_qatzip_hdr(&hdr);
-        if (Z_OK != deflateSetHeader(&stream, &hdr)) {
-            return QZ_FAIL;
+    /*reserve the seek index written after the last member*/
+    if (last && qz_sess->sess_params.index_trailer) {
+        idx_sz = qzIndexSz(qz_sess->idx_cnt +
+                           qzChunkCntMax(&qz_sess->sess_params,
+                                         qz_sess->sess_params.hw_buff_sz,
+                                         left_input_sz));
+        if (left_output_sz <= idx_sz) {
+            return QZ_BUF_ERROR;
         }
+        left_output_sz -= idx_sz;
+    }
 
-        send_sz = left_input_sz > chunk_sz ? chunk_sz : left_input_sz;
-        left_input_sz -= send_sz;
+    while (left_input_sz) {
+        /*one chunk at a time in software, small ones gain nothing*/
+        send_sz = qzChunkLen(&qz_sess->sess_params,
+                             qz_sess->sess_params.hw_buff_sz,
+                             src + total_in, left_input_sz);
+        stored = qzStoreChunk(qz_sess, src + total_in, send_sz);
+        level = stored ? Z_NO_COMPRESSION : comp_level;
 
-        stream.next_in   = (z_const Bytef *)src + total_in;
-        stream.avail_in  = send_sz;
-        stream.next_out  = (Bytef *)dest + total_out;
-        stream.avail_out = left_output_sz;
+        member_sz = left_output_sz;
+        if (stored || NULL == cache ||
+            QZ_OK != qzSWCachedChunk(cache, src + total_in, send_sz,
+                                     dest + total_out, &member_sz, &res)) {
+            if (NULL != qz_sess->dict) {
+                ret = qzSWCompressDictChunk(qz_sess, src + total_in, send_sz,
+                                            dest + total_out, &member_sz,
+                                            level, &res);
+            } else {
+                ret = qzSWCompressChunk(src + total_in, send_sz,
+                                        dest + total_out, &member_sz,
+                                        level, &res);
+            }
+            if (QZ_OK != ret) {
+                return ret;
+            }
 
-        if (Z_STREAM_END != (ret = deflate(&stream, Z_FINISH))) {
-            QZ_ERROR("ERR: deflate failed with return code: %d\n", ret);
-            return QZ_FAIL;
+            if (!stored) {
+                qzRatioUpdate(qz_sess, res.consumed, res.produced);
+            }
+            if (!stored && NULL != cache) {
+                qzCacheInsert(cache, src + total_in, send_sz,
+                              dest + total_out + qzGzipHeaderSz(),
+                              res.produced, res.checksum);
+            }
         }
 
-        left_output_sz -= GET_LOWER_32BITS(stream.total_out);
-        res.consumed = (Cpa32U) GET_LOWER_32BITS(stream.total_in);
-        res.produced = (Cpa32U) GET_LOWER_32BITS((stream.total_out - qzGzipHeaderSz() -
-                       qzGzipFooterSz()));
-        qzGzipHeaderGen(dest + cur_hdr_pos, &res);
-        cur_hdr_pos += GET_LOWER_32BITS(stream.total_out);
+        left_input_sz -= send_sz;
+        left_output_sz -= member_sz;
+        qzIndexAdd(qz_sess, member_sz, send_sz);
 
-        total_out += GET_LOWER_32BITS(stream.total_out);
-        total_in += GET_LOWER_32BITS(stream.total_in);
+        total_out += member_sz;
+        total_in += send_sz;
         *src_len = total_in;
         *dest_len = total_out;
         if (NULL != qz_sess->crc32) {
-            *(qz_sess->crc32) = stream.adler;
+            *(qz_sess->crc32) = crc32_combine(*(qz_sess->crc32), res.checksum,
+                                              send_sz);
         }
 
-        if (Z_OK != deflateEnd(&stream)) {
-            return QZ_FAIL;
+        if (left_input_sz && qzDeadlinePassed(qz_sess)) {
+            return QZ_TIMEOUT;
         }
     }
 
+    if (idx_sz) {
+        idx_len = GET_LOWER_32BITS(idx_sz);
+        (void)qzIndexWrite(qz_sess, dest + total_out, &idx_len);
+        total_out += idx_len;
+        *dest_len = total_out;
+    }
+
     return QZ_OK;
 }
 
+/* Decompress a QZ member framed by qzSWCompressDictChunk, the stream
+ * totals cover the whole member like those of a gunzipped one
+ */
+static int qzSWDecompressDictMember(QzSess_T *qz_sess, z_stream *stream,
+                                    const unsigned char *src,
+                                    unsigned int *src_len, unsigned char *dest,
+                                    unsigned int *dest_len)
+{
+    int ret;
+    QzDictField_T *dict = (QzDictField_T *)(src + sizeof(QzGzH_T));
+    unsigned long hdr_sz = qzDictHeaderSz();
+    unsigned long ftr_sz = qzGzipFooterSz();
+    QzGzF_T ftr;
+
+    if (NULL == qz_sess->dict || dict->dict_id != qz_sess->dict_id) {
+        QZ_ERROR("ERR: member needs dictionary %08x, session has %08lx\n",
+                 dict->dict_id, qz_sess->dict ? qz_sess->dict_id : 0);
+        return QZ_FAIL;
+    }
+
+    if (Z_OK != inflateInit2(stream, -MAX_WBITS)) {
+        return QZ_FAIL;
+    }
+
+    if (Z_OK != inflateSetDictionary(stream, qz_sess->dict, qz_sess->dict_len)) {
+        ret = QZ_FAIL;
+        goto done;
+    }
+
+    stream->next_in   = (z_const Bytef *)src + hdr_sz;
+    stream->avail_in  = *src_len - hdr_sz;
+    stream->next_out  = (Bytef *)dest;
+    stream->avail_out = *dest_len;
+
+    ret = inflate(stream, Z_FINISH);
+    if (Z_STREAM_END != ret) {
+        ret = (Z_BUF_ERROR == ret && 0 == stream->avail_out) ?
+              QZ_BUF_ERROR : QZ_DATA_ERROR;
+        goto done;
+    }
+
+    if (stream->avail_in < ftr_sz) {
+        ret = QZ_DATA_ERROR;
+        goto done;
+    }
+
+    qzGzipFooterExt(stream->next_in, &ftr);
+    if (ftr.i_size != GET_LOWER_32BITS(stream->total_out) ||
+        ftr.crc32 != crc32(0, dest, GET_LOWER_32BITS(stream->total_out))) {
+        ret = QZ_DATA_ERROR;
+        goto done;
+    }
+
+    /*like the gzip wrapper leaves the member CRC32 in adler*/
+    stream->adler = ftr.crc32;
+    stream->total_in += hdr_sz + ftr_sz;
+    *src_len = GET_LOWER_32BITS(stream->total_in);
+    *dest_len = GET_LOWER_32BITS(stream->total_out);
+    ret = QZ_OK;
+
+done:
+    if (Z_OK != inflateEnd(stream)) {
+        ret = QZ_FAIL;
+    }
+    return ret;
+}
+
 /* The software failover function for decompression request */
 int qzSWDecompress(QzSession_T *sess, const unsigned char *src,
                    unsigned int *uncompressed_buf_len, unsigned char *dest,
@@ -168,6 +533,12 @@ int qzSWDecompress(QzSession_T *sess, const unsigned char *src,
         ((QzSess_T *) sess->internal)->inflate_strm = stream;
     }
 
+    if (*uncompressed_buf_len >= qzDictHeaderSz() && isQzDictHeader(src)) {
+        return qzSWDecompressDictMember(qz_sess, stream, src,
+                                        uncompressed_buf_len, dest,
+                                        compressed_buffer_len);
+    }
+
     stream->next_in   = (z_const Bytef *)src;
     stream->avail_in  = *uncompressed_buf_len;
     stream->next_out  = (Bytef *)dest;
@@ -205,6 +576,68 @@ done:
     return ret;
 }
 
+/* The software decompression of a single raw deflate or zlib stream */
+int qzSWDecompressStream(QzSession_T *sess, const unsigned char *src,
+                         unsigned int *src_len, unsigned char *dest,
+                         unsigned int *dest_len)
+{
+    z_stream stream;
+    int ret;
+    QzSess_T *qz_sess = (QzSess_T *) sess->internal;
+    int window_bits = (QZ_DEFLATE_ZLIB == qz_sess->sess_params.data_fmt) ?
+                      MAX_WBITS : -MAX_WBITS;
+
+    stream.zalloc = (alloc_func)0;
+    stream.zfree  = (free_func)0;
+    stream.opaque = (voidpf)0;
+    stream.next_in  = (z_const Bytef *)src;
+    stream.avail_in = *src_len;
+    if (Z_OK != inflateInit2(&stream, window_bits)) {
+        return QZ_FAIL;
+    }
+
+    /*raw streams start from the dictionary, zlib ones ask for it*/
+    if (QZ_DEFLATE_RAW == qz_sess->sess_params.data_fmt && NULL != qz_sess->dict &&
+        Z_OK != inflateSetDictionary(&stream, qz_sess->dict, qz_sess->dict_len)) {
+        (void)inflateEnd(&stream);
+        return QZ_FAIL;
+    }
+
+    stream.next_out  = (Bytef *)dest;
+    stream.avail_out = *dest_len;
+    ret = inflate(&stream, Z_FINISH);
+    if (Z_NEED_DICT == ret && NULL != qz_sess->dict &&
+        Z_OK == inflateSetDictionary(&stream, qz_sess->dict, qz_sess->dict_len)) {
+        ret = inflate(&stream, Z_FINISH);
+    }
+    switch (ret) {
+    case Z_STREAM_END:
+        ret = QZ_OK;
+        break;
+    case Z_BUF_ERROR:
+        /*out of output space or truncated input*/
+        ret = (0 == stream.avail_out) ? QZ_BUF_ERROR : QZ_DATA_ERROR;
+        break;
+    case Z_DATA_ERROR:
+    case Z_NEED_DICT:
+        ret = QZ_DATA_ERROR;
+        break;
+    default:
+        QZ_ERROR("ERR: inflate failed with error code %d\n", ret);
+        ret = QZ_FAIL;
+    }
+
+    *src_len = GET_LOWER_32BITS(stream.total_in);
+    *dest_len = GET_LOWER_32BITS(stream.total_out);
+    if (NULL != qz_sess->crc32) {
+        /*raw deflate carries no checksum*/
+        *(qz_sess->crc32) = (QZ_DEFLATE_ZLIB == qz_sess->sess_params.data_fmt) ?
+                            stream.adler : crc32(0, dest, *dest_len);
+    }
+    (void)inflateEnd(&stream);
+    return ret;
+}
+
 int qzSWDecompressMultiGzip(QzSession_T *sess, const unsigned char *src,
                             unsigned int *uncompressed_buf_len, unsigned char *dest,
                             unsigned int *compressed_buffer_len)
@@ -216,17 +649,47 @@ int qzSWDecompressMultiGzip(QzSession_T *sess, const unsigned char *src,
     const unsigned int output_len = *compressed_buffer_len;
     unsigned int cur_input_len = input_len;
     unsigned int cur_output_len = output_len;
-#ifdef QATZIP_DEBUG
-    insertThread((unsigned int)pthread_self(), DECOMPRESSION, SW);
-#endif
+    QzSess_T *qz_sess = (QzSess_T *) sess->internal;
+    unsigned int par_thrshold = qz_sess->sess_params.par_decomp_thrshold;
+    unsigned long cksum;
+    QzGzF_T ftr;
     while (total_in < input_len) {
-        ret = qzSWDecompress(sess,
-                             src + total_in,
-                             &cur_input_len,
-                             dest + total_out,
-                             &cur_output_len);
+        /*large standard gzip member, try parallel inflate once per call*/
+        ret = QZ_FAIL;
+        if (0 != par_thrshold &&
+            cur_input_len >= par_thrshold &&
+            isStdGzipHeader(src + total_in)) {
+            ret = qzSWDecompressParallel(sess,
+                                         src + total_in,
+                                         &cur_input_len,
+                                         dest + total_out,
+                                         &cur_output_len);
+            if (ret != QZ_OK) {
+                par_thrshold = 0;
+            } else {
+                /*the trailer was checked against the output*/
+                qzGzipFooterExt(src + total_in + cur_input_len - qzGzipFooterSz(),
+                                &ftr);
+                cksum = ftr.crc32;
+                qzStatsParallel();
+            }
+        }
+
         if (ret != QZ_OK) {
-            goto out;
+            ret = qzSWDecompress(sess,
+                                 src + total_in,
+                                 &cur_input_len,
+                                 dest + total_out,
+                                 &cur_output_len);
+            if (ret != QZ_OK) {
+                goto out;
+            }
+            cksum = qz_sess->inflate_strm->adler;
+        }
+
+        if (NULL != qz_sess->crc32) {
+            *(qz_sess->crc32) = crc32_combine(*(qz_sess->crc32), cksum,
+                                              cur_output_len);
         }
 
         total_in  += cur_input_len;
@@ -235,6 +698,11 @@ int qzSWDecompressMultiGzip(QzSession_T *sess, const unsigned char *src,
         cur_output_len = output_len - total_out;
         *uncompressed_buf_len  = total_in;
         *compressed_buffer_len = total_out;
+
+        if (total_in < input_len && qzDeadlinePassed(qz_sess)) {
+            ret = QZ_TIMEOUT;
+            goto out;
+        }
     }
 
 out:
@@ -0,0 +1,819 @@
+/***************************************************************************
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2007-2017 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+
+/* Speculative parallel decompression of a single standard gzip member.
+ *
+ * The deflate stream is split into regions at byte offsets. Every region
+ * but the first searches its start for a plausible dynamic Huffman block
+ * header, and all regions are then inflated on their own thread. Regions
+ * other than the first do not know the 32K window that precedes them, so
+ * they are inflated twice against two placeholder dictionaries: a byte that
+ * is equal in both outputs is a literal, a byte that differs was copied
+ * from the unknown window and the two values encode its window offset.
+ * Once the preceding output is known, those bytes are resolved in a second
+ * pass. Any inconsistency makes the caller fall back to serial inflate.
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "cpa.h"
+#include "cpa_dc.h"
+#include "qatzip.h"
+#include "qatzipP.h"
+#include "qz_utils.h"
+
+#define PAR_WINDOW_SZ        (32 * 1024)
+#define PAR_MIN_REGION_SZ    (1024 * 1024)
+#define PAR_MAX_REGIONS      16
+#define PAR_TRIAL_BUF_SZ     (64 * 1024)
+#define PAR_TRIAL_MAX_OUT    (4 * 1024 * 1024)
+
+#define PAR_MAX_BITS         15
+#define PAR_MAX_LCODES       286
+#define PAR_MAX_DCODES       30
+
+#define GZIP_FHCRC           0x02
+#define GZIP_FEXTRA          0x04
+#define GZIP_FNAME           0x08
+#define GZIP_FCOMMENT        0x10
+#define GZIP_FRESERVED       0xe0
+
+typedef struct ParCtx_S ParCtx_T;
+
+typedef struct ParRegion_S {
+    ParCtx_T *ctx;
+    int idx;
+    unsigned long start_bit;
+    unsigned long limit_bit;
+    unsigned long end_bit;
+    unsigned char *out;
+    unsigned char *alt;
+    unsigned long out_len;
+    unsigned long out_off;
+    unsigned long final_bit;
+    unsigned long crc;
+    int found;
+    int rc;
+} ParRegion_T;
+
+struct ParCtx_S {
+    const unsigned char *src;
+    unsigned long src_bits;
+    unsigned long out_limit;
+    unsigned char *dest;
+    int num_regions;
+    volatile int abort;
+    ParRegion_T region[PAR_MAX_REGIONS];
+};
+
+typedef struct ParHuffman_S {
+    short count[PAR_MAX_BITS + 1];
+    short symbol[PAR_MAX_LCODES];
+} ParHuffman_T;
+
+typedef struct ParBits_S {
+    const unsigned char *src;
+    unsigned long pos;
+    unsigned long end;
+} ParBits_T;
+
+static unsigned char g_par_dict[2][PAR_WINDOW_SZ];
+static pthread_once_t g_par_dict_once = PTHREAD_ONCE_INIT;
+
+/* Placeholder windows: for every offset k the two dictionaries differ, and
+ * (dict[1][k] - dict[0][k] - 1) holds the high bits of k.
+ */
+static void parInitDict(void)
+{
+    unsigned int k;
+
+    for (k = 0; k < PAR_WINDOW_SZ; k++) {
+        g_par_dict[0][k] = (unsigned char)(k & 0xff);
+        g_par_dict[1][k] = (unsigned char)((k + 1 + (k >> 8)) & 0xff);
+    }
+}
+
+static int parBits(ParBits_T *b, unsigned int n)
+{
+    int val = 0;
+    unsigned int k;
+
+    if (b->pos + n > b->end) {
+        return -1;
+    }
+
+    for (k = 0; k < n; k++, b->pos++) {
+        val |= ((b->src[b->pos >> 3] >> (b->pos & 7)) & 1) << k;
+    }
+
+    return val;
+}
+
+/* Build a canonical Huffman decoder, returns 0 for a complete code,
+ * a positive value for an incomplete one and a negative value for an
+ * over-subscribed one
+ */
+static int parConstruct(ParHuffman_T *h, const short *length, int n)
+{
+    int symbol, len, left;
+    short offs[PAR_MAX_BITS + 1];
+
+    memset(h->count, 0, sizeof(h->count));
+    for (symbol = 0; symbol < n; symbol++) {
+        h->count[length[symbol]]++;
+    }
+
+    if (h->count[0] == n) {
+        return 0;
+    }
+
+    left = 1;
+    for (len = 1; len <= PAR_MAX_BITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) {
+            return left;
+        }
+    }
+
+    offs[1] = 0;
+    for (len = 1; len < PAR_MAX_BITS; len++) {
+        offs[len + 1] = offs[len] + h->count[len];
+    }
+
+    for (symbol = 0; symbol < n; symbol++) {
+        if (length[symbol] != 0) {
+            h->symbol[offs[length[symbol]]++] = (short)symbol;
+        }
+    }
+
+    return left;
+}
+
+static int parDecode(ParBits_T *b, const ParHuffman_T *h)
+{
+    int len, bit, code = 0, first = 0, index = 0, count;
+
+    for (len = 1; len <= PAR_MAX_BITS; len++) {
+        bit = parBits(b, 1);
+        if (bit < 0) {
+            return -1;
+        }
+        code |= bit;
+        count = h->count[len];
+        if (code - count < first) {
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+/* Cheap structural check of a non-final dynamic block header at bit_pos,
+ * following the same completeness rules as inflate
+ */
+static int parIsBlockHeader(const unsigned char *src, unsigned long src_bits,
+                            unsigned long bit_pos)
+{
+    static const short order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+    ParBits_T b = {src, bit_pos, src_bits};
+    ParHuffman_T lencode, distcode;
+    short lengths[PAR_MAX_LCODES + PAR_MAX_DCODES];
+    int nlen, ndist, ncode, index, symbol, len, rc;
+
+    /* BFINAL 0, BTYPE 10 */
+    if (parBits(&b, 3) != 0x4) {
+        return 0;
+    }
+
+    nlen = parBits(&b, 5);
+    ndist = parBits(&b, 5);
+    ncode = parBits(&b, 4);
+    if (nlen < 0 || ndist < 0 || ncode < 0) {
+        return 0;
+    }
+
+    nlen += 257;
+    ndist += 1;
+    ncode += 4;
+    if (nlen > PAR_MAX_LCODES || ndist > PAR_MAX_DCODES) {
+        return 0;
+    }
+
+    for (index = 0; index < ncode; index++) {
+        len = parBits(&b, 3);
+        if (len < 0) {
+            return 0;
+        }
+        lengths[order[index]] = (short)len;
+    }
+    for (; index < 19; index++) {
+        lengths[order[index]] = 0;
+    }
+
+    if (0 != parConstruct(&lencode, lengths, 19)) {
+        return 0;
+    }
+
+    index = 0;
+    while (index < nlen + ndist) {
+        symbol = parDecode(&b, &lencode);
+        if (symbol < 0) {
+            return 0;
+        }
+
+        if (symbol < 16) {
+            lengths[index++] = (short)symbol;
+            continue;
+        }
+
+        len = 0;
+        if (symbol == 16) {
+            if (index == 0) {
+                return 0;
+            }
+            len = lengths[index - 1];
+            symbol = 3 + parBits(&b, 2);
+        } else if (symbol == 17) {
+            symbol = 3 + parBits(&b, 3);
+        } else {
+            symbol = 11 + parBits(&b, 7);
+        }
+
+        if (symbol < 3 || index + symbol > nlen + ndist) {
+            return 0;
+        }
+        while (symbol--) {
+            lengths[index++] = (short)len;
+        }
+    }
+
+    /* the end-of-block code must be present */
+    if (lengths[256] == 0) {
+        return 0;
+    }
+
+    rc = parConstruct(&lencode, lengths, nlen);
+    if (rc < 0 || (rc > 0 && nlen - lencode.count[0] != 1)) {
+        return 0;
+    }
+
+    rc = parConstruct(&distcode, lengths + nlen, ndist);
+    if (rc < 0 || (rc > 0 && ndist - distcode.count[0] != 1)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Position the raw inflate stream at an arbitrary bit offset */
+static int parInflateAt(z_stream *strm, ParCtx_T *ctx, unsigned long bit_pos,
+                        const unsigned char *dict)
+{
+    unsigned long byte = bit_pos >> 3;
+    unsigned int shift = (unsigned int)(bit_pos & 7);
+    unsigned long src_len = (ctx->src_bits + 7) >> 3;
+
+    memset(strm, 0, sizeof(*strm));
+    if (Z_OK != inflateInit2(strm, -MAX_WBITS)) {
+        return QZ_FAIL;
+    }
+
+    if (0 == shift) {
+        strm->next_in = (z_const Bytef *)(ctx->src + byte);
+        strm->avail_in = (uInt)(src_len - byte);
+    } else {
+        strm->next_in = (z_const Bytef *)(ctx->src + byte + 1);
+        strm->avail_in = (uInt)(src_len - byte - 1);
+        if (Z_OK != inflatePrime(strm, 8 - shift, ctx->src[byte] >> shift)) {
+            goto err;
+        }
+    }
+
+    if (NULL != dict &&
+        Z_OK != inflateSetDictionary(strm, dict, PAR_WINDOW_SZ)) {
+        goto err;
+    }
+
+    return QZ_OK;
+
+err:
+    (void)inflateEnd(strm);
+    return QZ_FAIL;
+}
+
+static inline unsigned long parBitPos(z_stream *strm, ParCtx_T *ctx)
+{
+    return (unsigned long)(strm->next_in - ctx->src) * 8 -
+           (unsigned long)(strm->data_type & 7);
+}
+
+/* Inflate the block starting at bit_pos into scratch memory and report
+ * whether it decodes cleanly up to its end-of-block code
+ */
+static int parTrialBlock(ParCtx_T *ctx, unsigned long bit_pos,
+                         unsigned char *scratch)
+{
+    z_stream strm;
+    unsigned long produced = 0;
+    int ret, good = 0;
+
+    if (QZ_OK != parInflateAt(&strm, ctx, bit_pos, g_par_dict[0])) {
+        return 0;
+    }
+
+    while (produced < PAR_TRIAL_MAX_OUT) {
+        strm.next_out = scratch;
+        strm.avail_out = PAR_TRIAL_BUF_SZ;
+        ret = inflate(&strm, Z_BLOCK);
+        produced += PAR_TRIAL_BUF_SZ - strm.avail_out;
+        if (Z_OK != ret && !(Z_BUF_ERROR == ret && 0 == strm.avail_out)) {
+            break;
+        }
+
+        if (strm.data_type & 128) {
+            good = 1;
+            break;
+        }
+    }
+
+    (void)inflateEnd(&strm);
+    return good;
+}
+
+/* Phase one: find the first block boundary inside the region */
+static void *parFindStart(void *arg)
+{
+    ParRegion_T *r = (ParRegion_T *)arg;
+    ParCtx_T *ctx = r->ctx;
+    unsigned char *scratch;
+    unsigned long bit_pos;
+
+    r->found = 0;
+    scratch = malloc(PAR_TRIAL_BUF_SZ);
+    if (NULL == scratch) {
+        return NULL;
+    }
+
+    for (bit_pos = r->start_bit; bit_pos < r->limit_bit && !ctx->abort;
+         bit_pos++) {
+        if (parIsBlockHeader(ctx->src, ctx->src_bits, bit_pos) &&
+            parTrialBlock(ctx, bit_pos, scratch)) {
+            r->start_bit = bit_pos;
+            r->found = 1;
+            break;
+        }
+    }
+
+    free(scratch);
+    return NULL;
+}
+
+static int parGrow(unsigned char **buf, unsigned long *cap,
+                   unsigned long used, unsigned long limit)
+{
+    unsigned long new_cap;
+    unsigned char *tmp;
+
+    if (*cap >= limit) {
+        return QZ_BUF_ERROR;
+    }
+
+    new_cap = (*cap > (limit >> 1)) ? limit : (*cap << 1);
+    if (new_cap < used + PAR_WINDOW_SZ && used + PAR_WINDOW_SZ <= limit) {
+        new_cap = used + PAR_WINDOW_SZ;
+    }
+
+    tmp = realloc(*buf, new_cap);
+    if (NULL == tmp) {
+        return QZ_FAIL;
+    }
+
+    *buf = tmp;
+    *cap = new_cap;
+    return QZ_OK;
+}
+
+/* Phase two: inflate the region from its start to the start of the next
+ * region, or to the end of the final block for the last region
+ */
+static void *parInflateRegion(void *arg)
+{
+    ParRegion_T *r = (ParRegion_T *)arg;
+    ParCtx_T *ctx = r->ctx;
+    int last = (r->idx == ctx->num_regions - 1);
+    unsigned long cap, pos;
+    z_stream strm;
+    int ret;
+
+    r->rc = QZ_FAIL;
+    cap = ((r->end_bit - r->start_bit) >> 3) * 4;
+    if (cap > ctx->out_limit) {
+        cap = ctx->out_limit;
+    }
+    if (cap < PAR_WINDOW_SZ) {
+        cap = PAR_WINDOW_SZ;
+    }
+
+    r->out = malloc(cap);
+    if (NULL == r->out) {
+        goto done;
+    }
+
+    if (QZ_OK != parInflateAt(&strm, ctx, r->start_bit,
+                              (0 == r->idx) ? NULL : g_par_dict[0])) {
+        goto done;
+    }
+
+    strm.next_out = r->out;
+    strm.avail_out = (uInt)cap;
+    for (;;) {
+        if (0 == strm.avail_out) {
+            if (QZ_OK != parGrow(&r->out, &cap, strm.total_out, ctx->out_limit)) {
+                goto end_strm;
+            }
+            strm.next_out = r->out + strm.total_out;
+            strm.avail_out = (uInt)(cap - strm.total_out);
+        }
+
+        ret = inflate(&strm, Z_BLOCK);
+        if (Z_STREAM_END == ret) {
+            if (!last) {
+                QZ_DEBUG("parInflateRegion: region %d hit the end of stream\n",
+                         r->idx);
+                goto end_strm;
+            }
+            r->final_bit = parBitPos(&strm, ctx);
+            break;
+        }
+
+        if (Z_OK != ret && !(Z_BUF_ERROR == ret && 0 == strm.avail_out)) {
+            goto end_strm;
+        }
+
+        if (ctx->abort) {
+            goto end_strm;
+        }
+
+        if (!last && (strm.data_type & 128)) {
+            pos = parBitPos(&strm, ctx);
+            if (pos == r->end_bit) {
+                break;
+            } else if (pos > r->end_bit) {
+                QZ_DEBUG("parInflateRegion: region %d overran %lu\n",
+                         r->idx, r->end_bit);
+                goto end_strm;
+            }
+        }
+    }
+
+    r->out_len = strm.total_out;
+    (void)inflateEnd(&strm);
+
+    if (0 != r->idx) {
+        /* second decode against the other placeholder window */
+        r->alt = malloc(r->out_len ? r->out_len : 1);
+        if (NULL == r->alt) {
+            goto done;
+        }
+
+        if (QZ_OK != parInflateAt(&strm, ctx, r->start_bit, g_par_dict[1])) {
+            goto done;
+        }
+
+        strm.next_out = r->alt;
+        strm.avail_out = (uInt)r->out_len;
+        while (strm.avail_out) {
+            ret = inflate(&strm, Z_NO_FLUSH);
+            if (Z_OK != ret) {
+                break;
+            }
+        }
+
+        if (strm.total_out != r->out_len) {
+            goto end_strm;
+        }
+        (void)inflateEnd(&strm);
+    }
+
+    r->rc = QZ_OK;
+    goto done;
+
+end_strm:
+    (void)inflateEnd(&strm);
+done:
+    if (QZ_OK != r->rc) {
+        ctx->abort = 1;
+    }
+    return NULL;
+}
+
+/* Replace the window references of the region bytes [from, to) */
+static int parResolve(ParCtx_T *ctx, ParRegion_T *r,
+                      unsigned long from, unsigned long to)
+{
+    const unsigned char *win = ctx->dest + r->out_off - PAR_WINDOW_SZ;
+    unsigned char *dst = ctx->dest + r->out_off;
+    unsigned long x;
+    unsigned int a, d;
+
+    for (x = from; x < to; x++) {
+        a = r->out[x];
+        if (a == r->alt[x]) {
+            dst[x] = (unsigned char)a;
+            continue;
+        }
+
+        d = (r->alt[x] - a - 1) & 0xff;
+        if (d >= (PAR_WINDOW_SZ >> 8)) {
+            return QZ_FAIL;
+        }
+        dst[x] = win[a | (d << 8)];
+    }
+
+    return QZ_OK;
+}
+
+/* Phase three: resolve the region body once the tail of every region is
+ * known, then checksum the resolved output
+ */
+static void *parResolveRegion(void *arg)
+{
+    ParRegion_T *r = (ParRegion_T *)arg;
+    ParCtx_T *ctx = r->ctx;
+    unsigned long tail;
+
+    r->rc = QZ_OK;
+    if (0 != r->idx) {
+        tail = (r->out_len > PAR_WINDOW_SZ) ? (r->out_len - PAR_WINDOW_SZ) : 0;
+        r->rc = parResolve(ctx, r, 0, tail);
+    }
+
+    r->crc = crc32(0L, ctx->dest + r->out_off, (uInt)r->out_len);
+    return NULL;
+}
+
+static inline unsigned long parGetLe32(const unsigned char *p)
+{
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+           ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static long parGzipHeaderLen(const unsigned char *src, unsigned long len)
+{
+    unsigned long pos = 10;
+    unsigned char flg;
+
+    if (len < 18 || src[0] != 0x1f || src[1] != 0x8b || src[2] != Z_DEFLATED) {
+        return -1;
+    }
+
+    flg = src[3];
+    if (flg & GZIP_FRESERVED) {
+        return -1;
+    }
+
+    if (flg & GZIP_FEXTRA) {
+        if (pos + 2 > len) {
+            return -1;
+        }
+        pos += 2 + (src[pos] | (src[pos + 1] << 8));
+    }
+
+    if (flg & GZIP_FNAME) {
+        while (pos < len && src[pos] != 0) {
+            pos++;
+        }
+        pos++;
+    }
+
+    if (flg & GZIP_FCOMMENT) {
+        while (pos < len && src[pos] != 0) {
+            pos++;
+        }
+        pos++;
+    }
+
+    if (flg & GZIP_FHCRC) {
+        pos += 2;
+    }
+
+    return (pos < len) ? (long)pos : -1;
+}
+
+static int parRun(void *(*fn)(void *), ParCtx_T *ctx, int skip_first)
+{
+    pthread_t th[PAR_MAX_REGIONS];
+    int started[PAR_MAX_REGIONS] = {0};
+    int k;
+
+    for (k = 1; k < ctx->num_regions; k++) {
+        started[k] = (0 == pthread_create(&th[k], NULL, fn, &ctx->region[k]));
+        if (!started[k]) {
+            fn(&ctx->region[k]);
+        }
+    }
+
+    if (!skip_first) {
+        fn(&ctx->region[0]);
+    }
+
+    for (k = 1; k < ctx->num_regions; k++) {
+        if (started[k]) {
+            pthread_join(th[k], NULL);
+        }
+    }
+
+    return QZ_OK;
+}
+
+static int parRegionCount(unsigned long deflate_len)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long n = deflate_len / PAR_MIN_REGION_SZ;
+
+    if (cpus < 2) {
+        return 1;
+    }
+
+    if (n > (unsigned long)cpus) {
+        n = (unsigned long)cpus;
+    }
+
+    return (n > PAR_MAX_REGIONS) ? PAR_MAX_REGIONS : (int)n;
+}
+
+/* Decompress one standard gzip member with speculative parallel inflate.
+ * Returns QZ_OK on success; any other value leaves dest undefined and the
+ * caller is expected to decompress the member serially.
+ */
+int qzSWDecompressParallel(QzSession_T *sess, const unsigned char *src,
+                           unsigned int *src_len, unsigned char *dest,
+                           unsigned int *dest_len)
+{
+    ParCtx_T *ctx;
+    ParRegion_T *r;
+    long hdr_len;
+    unsigned long deflate_len, step, total, crc, trailer;
+    int k, n, found, rc = QZ_FAIL;
+
+    (void)sess;
+    hdr_len = parGzipHeaderLen(src, *src_len);
+    if (hdr_len < 0) {
+        return QZ_FAIL;
+    }
+
+    deflate_len = *src_len - (unsigned long)hdr_len;
+    n = parRegionCount(deflate_len);
+    if (n < 2) {
+        return QZ_FAIL;
+    }
+
+    ctx = calloc(1, sizeof(ParCtx_T));
+    if (NULL == ctx) {
+        return QZ_FAIL;
+    }
+
+    (void)pthread_once(&g_par_dict_once, parInitDict);
+    ctx->src = src + hdr_len;
+    ctx->src_bits = deflate_len * 8;
+    ctx->out_limit = *dest_len;
+    ctx->dest = dest;
+    ctx->num_regions = n;
+
+    step = deflate_len / n;
+    for (k = 0; k < n; k++) {
+        r = &ctx->region[k];
+        r->ctx = ctx;
+        r->idx = k;
+        r->start_bit = (unsigned long)k * step * 8;
+        r->limit_bit = (k == n - 1) ? ctx->src_bits : (k + 1) * step * 8;
+    }
+
+    /* phase one, drop the regions without a usable block boundary */
+    parRun(parFindStart, ctx, 1);
+    for (k = 1, found = 1; k < n; k++) {
+        if (ctx->region[k].found) {
+            ctx->region[found] = ctx->region[k];
+            ctx->region[found].idx = found;
+            found++;
+        }
+    }
+
+    ctx->num_regions = found;
+    if (found < 2) {
+        QZ_DEBUG("qzSWDecompressParallel: no block boundary found\n");
+        goto done;
+    }
+
+    for (k = 0; k < found; k++) {
+        ctx->region[k].end_bit = (k == found - 1) ? ctx->src_bits :
+                                 ctx->region[k + 1].start_bit;
+    }
+
+    /* phase two */
+    parRun(parInflateRegion, ctx, 0);
+    total = 0;
+    for (k = 0; k < found; k++) {
+        r = &ctx->region[k];
+        if (QZ_OK != r->rc) {
+            goto done;
+        }
+        r->out_off = total;
+        total += r->out_len;
+    }
+
+    if (total > *dest_len || ctx->region[1].out_off < PAR_WINDOW_SZ) {
+        goto done;
+    }
+
+    /* resolve the region tails in order, they form the next window */
+    memcpy(dest, ctx->region[0].out, ctx->region[0].out_len);
+    for (k = 1; k < found; k++) {
+        r = &ctx->region[k];
+        if (QZ_OK != parResolve(ctx, r,
+                                (r->out_len > PAR_WINDOW_SZ) ?
+                                (r->out_len - PAR_WINDOW_SZ) : 0,
+                                r->out_len)) {
+            goto done;
+        }
+    }
+
+    /* phase three */
+    parRun(parResolveRegion, ctx, 0);
+    crc = ctx->region[0].crc;
+    for (k = 1; k < found; k++) {
+        r = &ctx->region[k];
+        if (QZ_OK != r->rc) {
+            goto done;
+        }
+        crc = crc32_combine(crc, r->crc, (z_off_t)r->out_len);
+    }
+
+    trailer = (ctx->region[found - 1].final_bit + 7) >> 3;
+    if (trailer + 8 > deflate_len) {
+        goto done;
+    }
+
+    if (crc != parGetLe32(ctx->src + trailer) ||
+        GET_LOWER_32BITS(total) != parGetLe32(ctx->src + trailer + 4)) {
+        QZ_DEBUG("qzSWDecompressParallel: trailer check failed\n");
+        goto done;
+    }
+
+    *src_len = GET_LOWER_32BITS(hdr_len + trailer + 8);
+    *dest_len = GET_LOWER_32BITS(total);
+    rc = QZ_OK;
+    QZ_DEBUG("qzSWDecompressParallel: %d regions, in %u out %u\n",
+             found, *src_len, *dest_len);
+
+done:
+    for (k = 0; k < n; k++) {
+        free(ctx->region[k].out);
+        free(ctx->region[k].alt);
+    }
+    free(ctx);
+    return rc;
+}
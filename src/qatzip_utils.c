@@ -36,138 +36,229 @@
 #include <stdlib.h>
 #include <qz_utils.h>
 
-static QatThread_T g_qat_thread;
-
-static void doInsertThread(unsigned int th_id,
-                           ThreadList_T **thd_list,
-                           unsigned int *num_thd,
-                           pthread_mutex_t *lock,
-                           Serv_T serv_type,
-                           Engine_T engine_type)
+ThreadStats_T *g_thread_stats = NULL;
+ThreadStats_T g_thread_retired;
+unsigned int g_lat_epoch;
+pthread_mutex_t g_thread_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread ThreadStats_T *t_stats;
+static pthread_key_t g_thread_key;
+static pthread_once_t g_thread_once = PTHREAD_ONCE_INIT;
+
+/*the owning thread is the only writer, a plain load and store will do*/
+#define THREAD_STAT_BUMP(cnt, n) \
+    __atomic_store_n(&(cnt), (cnt) + (n), __ATOMIC_RELAXED)
+
+/* Histogram bucket of a time: linear below 2^QZ_LAT_SUB_BITS, then
+ * QZ_LAT_SUB_BITS bits after the leading one of each power of two
+ */
+unsigned int latBucket(unsigned long nsec)
 {
-    ThreadList_T *node;
-    ThreadList_T *prev_node;
+    unsigned int e;
 
-    if (0 != pthread_mutex_lock(lock)) {
-        return;
+    if (nsec < (1UL << QZ_LAT_SUB_BITS)) {
+        return (unsigned int)nsec;
+    }
+    if (nsec >= (1UL << QZ_LAT_MAX_BITS)) {
+        return QZ_LAT_BUCKETS - 1;
     }
 
-    for (prev_node = node = *thd_list; node; node = node->next) {
-        if (node->thread_id == th_id) {
-            break;
-        }
-        prev_node = node;
+    e = 63 - __builtin_clzl(nsec);
+    return ((e - QZ_LAT_SUB_BITS + 1) << QZ_LAT_SUB_BITS) +
+           ((nsec >> (e - QZ_LAT_SUB_BITS)) & ((1U << QZ_LAT_SUB_BITS) - 1));
+}
+
+/* Highest time that falls in a bucket */
+unsigned long latValue(unsigned int bucket)
+{
+    unsigned int e, m;
+
+    if (bucket < (1U << QZ_LAT_SUB_BITS)) {
+        return bucket;
     }
 
-    if (!node) {
-        node = (ThreadList_T *)calloc(1, sizeof(*node));
-        if (!node) {
-            QZ_ERROR("[ERROR]: alloc memory failed in file(%s) line(%d)\n",
-                     __FILE__, __LINE__);
-            goto done;
-        }
+    e = (bucket >> QZ_LAT_SUB_BITS) + QZ_LAT_SUB_BITS - 1;
+    m = bucket & ((1U << QZ_LAT_SUB_BITS) - 1);
+    return ((((1UL << QZ_LAT_SUB_BITS) + m + 1) << (e - QZ_LAT_SUB_BITS))) - 1;
+}
 
-        node->thread_id = th_id;
-        ++*num_thd;
-        if (prev_node) {
-            prev_node->next = node;
-        } else {
-            *thd_list = node;
+/* Size class of an input: under 4KB, 64KB, 1MB and the rest */
+unsigned int latSize(unsigned long len)
+{
+    if (len < 4 * 1024) {
+        return 0;
+    }
+    if (len < 64 * 1024) {
+        return 1;
+    }
+    if (len < 1024 * 1024) {
+        return 2;
+    }
+    return 3;
+}
+
+void latClear(ThreadStats_T *ts)
+{
+    unsigned long *cnt = &ts->lat[0][0][0][0];
+    unsigned int k;
+
+    for (k = 0; k < sizeof(ts->lat) / sizeof(ts->lat[0][0][0][0]); k++) {
+        if (cnt[k]) {
+            __atomic_store_n(&cnt[k], 0, __ATOMIC_RELAXED);
         }
     }
+}
+
+/* Hand the counts of an exiting thread to g_thread_retired and free its
+ * block for the next thread
+ */
+static void retireThread(void *arg)
+{
+    ThreadStats_T *ts = (ThreadStats_T *)arg;
+    int s, e;
 
-    if (SW == engine_type) {
-        if (COMPRESSION == serv_type) {
-            ++node->comp_sw_count;
-        } else if (DECOMPRESSION == serv_type) {
-            ++node->decomp_sw_count;
+    pthread_mutex_lock(&g_thread_lock);
+    for (s = 0; s < 2; s++) {
+        for (e = 0; e < 2; e++) {
+            __atomic_fetch_add(&g_thread_retired.calls[s][e],
+                               ts->calls[s][e], __ATOMIC_RELAXED);
+            __atomic_fetch_add(&g_thread_retired.bytes_in[s][e],
+                               ts->bytes_in[s][e], __ATOMIC_RELAXED);
+            __atomic_fetch_add(&g_thread_retired.bytes_out[s][e],
+                               ts->bytes_out[s][e], __ATOMIC_RELAXED);
+            __atomic_fetch_add(&g_thread_retired.nsec[s][e],
+                               ts->nsec[s][e], __ATOMIC_RELAXED);
+            __atomic_store_n(&ts->calls[s][e], 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&ts->bytes_in[s][e], 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&ts->bytes_out[s][e], 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&ts->nsec[s][e], 0, __ATOMIC_RELAXED);
         }
-    } else if (HW == engine_type) {
-        if (COMPRESSION == serv_type) {
-            ++node->comp_hw_count;
-        } else if (DECOMPRESSION == serv_type) {
-            ++node->decomp_hw_count;
+    }
+    if (ts->lat_epoch == __atomic_load_n(&g_lat_epoch, __ATOMIC_RELAXED)) {
+        unsigned long *cnt = &ts->lat[0][0][0][0];
+        unsigned long *sum = &g_thread_retired.lat[0][0][0][0];
+        unsigned int k;
+
+        for (k = 0; k < sizeof(ts->lat) / sizeof(ts->lat[0][0][0][0]); k++) {
+            if (cnt[k]) {
+                __atomic_fetch_add(&sum[k], cnt[k], __ATOMIC_RELAXED);
+            }
         }
     }
+    latClear(ts);
+    __atomic_store_n(&ts->thread_id, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ts->live, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_thread_lock);
+}
 
-done:
-    (void)pthread_mutex_unlock(lock);
+/* Threads that exit after the library is unloaded have nothing to call */
+static void threadKeyDelete(void)
+{
+    (void)pthread_key_delete(g_thread_key);
 }
 
-void insertThread(unsigned int th_id,
-                  Serv_T serv_type,
-                  Engine_T engine_type)
+static void threadKeyCreate(void)
 {
-    QatThread_T *th_list = &g_qat_thread;
-    if (COMPRESSION == serv_type) {
-        doInsertThread(th_id,
-                       &th_list->comp_th_list,
-                       &th_list->num_comp_th,
-                       &th_list->comp_lock,
-                       serv_type,
-                       engine_type);
-    } else if (DECOMPRESSION == serv_type) {
-        doInsertThread(th_id,
-                       &th_list->decomp_th_list,
-                       &th_list->num_decomp_th,
-                       &th_list->decomp_lock,
-                       serv_type,
-                       engine_type);
+    if (0 == pthread_key_create(&g_thread_key, retireThread)) {
+        (void)atexit(threadKeyDelete);
     }
 }
 
-static void doDumpThreadInfo(ThreadList_T *node,
-                             unsigned int num_node,
-                             Serv_T type)
+/* Take a block left by an exited thread, or push a new one */
+static ThreadStats_T *claimThread(void)
 {
-    unsigned int i;
-    char *serv_title;
-
-    if (num_node > 0) {
-        i = 0;
-        if (COMPRESSION == type) {
-            serv_title = "Compression";
-        } else {
-            serv_title = "Decompression";
-        }
+    ThreadStats_T *ts;
+    unsigned int free_blk;
 
-        QZ_PRINT("[INFO]: %s num_th %u\n",
-                 serv_title, num_node);
-        while (node) {
-            QZ_PRINT("th_id: %u comp_hw_count: %u comp_sw_count: %u "
-                     "decomp_hw_count: %u decomp_sw_count: %u\n",
-                     node->thread_id,
-                     node->comp_hw_count,
-                     node->comp_sw_count,
-                     node->decomp_hw_count,
-                     node->decomp_sw_count);
-            i++;
-            node = node->next;
-            if (i == num_node) {
-                break;
-            }
+    (void)pthread_once(&g_thread_once, threadKeyCreate);
+
+    for (ts = __atomic_load_n(&g_thread_stats, __ATOMIC_ACQUIRE);
+         ts; ts = ts->next) {
+        free_blk = 0;
+        if (__atomic_compare_exchange_n(&ts->live, &free_blk, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            goto claimed;
         }
+    }
+
+    ts = (ThreadStats_T *)calloc(1, sizeof(*ts));
+    if (NULL == ts) {
+        return NULL;
+    }
+    ts->live = 1;
+    ts->next = __atomic_load_n(&g_thread_stats, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&g_thread_stats, &ts->next, ts, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        ;
+    }
+
+claimed:
+    __atomic_store_n(&ts->thread_id, (unsigned long)pthread_self(),
+                     __ATOMIC_RELAXED);
+    (void)pthread_setspecific(g_thread_key, ts);
+    return ts;
+}
+
+void countThread(Serv_T serv_type,
+                 Engine_T engine_type,
+                 unsigned long in,
+                 unsigned long out,
+                 unsigned long nsec)
+{
+    ThreadStats_T *ts = t_stats;
+    unsigned int epoch;
 
-        if (node) {
-            QZ_ERROR("[ERROR]: there's node left in the list\n");
+    if (NULL == ts) {
+        ts = t_stats = claimThread();
+        if (NULL == ts) {
+            return;
         }
-        QZ_PRINT("\n");
     }
+
+    THREAD_STAT_BUMP(ts->calls[serv_type][engine_type], 1);
+    THREAD_STAT_BUMP(ts->bytes_in[serv_type][engine_type], in);
+    THREAD_STAT_BUMP(ts->bytes_out[serv_type][engine_type], out);
+    THREAD_STAT_BUMP(ts->nsec[serv_type][engine_type], nsec);
+
+    /*the thread clears its own histograms after a reset*/
+    epoch = __atomic_load_n(&g_lat_epoch, __ATOMIC_ACQUIRE);
+    if (ts->lat_epoch != epoch) {
+        latClear(ts);
+        __atomic_store_n(&ts->lat_epoch, epoch, __ATOMIC_RELEASE);
+    }
+    THREAD_STAT_BUMP(ts->lat[serv_type][engine_type][latSize(in)]
+                     [latBucket(nsec)], 1);
 }
 
-void dumpThreadInfo(void)
+/* Only the forking thread lives on in a child, retire the others */
+void forkThreadStats(void)
 {
-    QatThread_T *th_list = &g_qat_thread;
-    doDumpThreadInfo(th_list->comp_th_list,
-                     th_list->num_comp_th,
-                     COMPRESSION);
-    doDumpThreadInfo(th_list->decomp_th_list,
-                     th_list->num_decomp_th,
-                     DECOMPRESSION);
+    ThreadStats_T *ts;
+
+    pthread_mutex_init(&g_thread_lock, NULL);
+    for (ts = g_thread_stats; ts; ts = ts->next) {
+        if (ts->live && ts != t_stats) {
+            retireThread(ts);
+        }
+    }
 }
 
-void initDebugLock(void)
+void dumpThreadInfo(void)
 {
-    pthread_mutex_init(&g_qat_thread.comp_lock, NULL);
-    pthread_mutex_init(&g_qat_thread.decomp_lock, NULL);
+    ThreadStats_T *ts;
+
+    for (ts = __atomic_load_n(&g_thread_stats, __ATOMIC_ACQUIRE);
+         ts; ts = ts->next) {
+        if (!__atomic_load_n(&ts->live, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        QZ_PRINT("th_id: %lu comp_hw_count: %lu comp_sw_count: %lu "
+                 "decomp_hw_count: %lu decomp_sw_count: %lu\n",
+                 ts->thread_id,
+                 ts->calls[COMPRESSION][HW],
+                 ts->calls[COMPRESSION][SW],
+                 ts->calls[DECOMPRESSION][HW],
+                 ts->calls[DECOMPRESSION][SW]);
+    }
+    QZ_PRINT("\n");
 }
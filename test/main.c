@@ -42,6 +42,7 @@
 #include <stdlib.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <errno.h>
 #include <ctype.h>
 #include <assert.h>
@@ -133,6 +134,7 @@ static pthread_mutex_t g_lock_print = PTHREAD_MUTEX_INITIALIZER;
 static struct timeval g_timers[100][100];
 static struct timeval g_timer_start;
 extern void dumpAllCounters();
+extern processData_T g_process;
 
 QzBlock_T *parseFormatOption(char *buf)
 {
@@ -1995,6 +1997,2687 @@ done:
     return rc;
 }
 
+int qzDecompressParallelStdGzip(void)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    QzStats_T before, after;
+    z_stream strm;
+    uint8_t *orig_src, *comp_src, *decomp_src;
+    size_t orig_sz, comp_sz, decomp_sz, i;
+
+    orig_sz = decomp_sz = 16 * MB;
+    comp_sz = orig_sz + MB;
+    orig_src = malloc(orig_sz);
+    comp_src = malloc(comp_sz);
+    decomp_src = malloc(decomp_sz);
+    if (orig_src == NULL ||
+        comp_src == NULL ||
+        decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+
+    /*poorly compressible data keeps the member above the threshold*/
+    genRandomData(orig_src, orig_sz);
+    for (i = 0; i < orig_sz; i += 3) {
+        orig_src[i] = GET_LOWER_8BITS(rand());
+    }
+
+    /*single member standard gzip stream*/
+    memset(&strm, 0, sizeof(strm));
+    if (Z_OK != deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                             MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY)) {
+        goto done;
+    }
+    strm.next_in = orig_src;
+    strm.avail_in = GET_LOWER_32BITS(orig_sz);
+    strm.next_out = comp_src;
+    strm.avail_out = GET_LOWER_32BITS(comp_sz);
+    if (Z_STREAM_END != deflate(&strm, Z_FINISH)) {
+        (void)deflateEnd(&strm);
+        goto done;
+    }
+    comp_sz = strm.total_out;
+    (void)deflateEnd(&strm);
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        QZ_ERROR("qzInit for testing %s error, return: %d\n", __func__, rc);
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.par_decomp_thrshold = QZ_PAR_DECOMP_THRESHOLD_MINIMUM;
+    rc = qzSetupSession(&sess, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        QZ_ERROR("qzSetupSession for testing %s error, return: %d\n", __func__, rc);
+        goto done;
+    }
+
+    (void)qzGetStats(&before, NULL, 0);
+    rc = qzDecompress(&sess, comp_src, (uint32_t *)(&comp_sz), decomp_src,
+                      (uint32_t *)(&decomp_sz));
+    (void)qzGetStats(&after, NULL, 0);
+    if (rc != QZ_OK          ||
+        decomp_sz != orig_sz ||
+        memcmp(orig_src, decomp_src, orig_sz)) {
+        QZ_ERROR("ERROR: Parallel decompression FAILED with return value: %d\n",
+                 rc);
+        rc = QZ_FAIL;
+        goto done;
+    }
+
+    /*one cpu runs the serial inflate only*/
+    if (sysconf(_SC_NPROCESSORS_ONLN) > 1 &&
+        after.par_members != before.par_members + 1) {
+        QZ_ERROR("ERROR: %lu members inflated in parallel\n",
+                 after.par_members - before.par_members);
+        rc = QZ_FAIL;
+        goto done;
+    }
+
+done:
+    free(orig_src);
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+static int doCompressSingleStream(QzDataFormat_T data_fmt, size_t test_sz,
+                                  unsigned int comp_lvl, int close_empty)
+{
+    int rc = QZ_FAIL;
+    int k;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    z_stream strm;
+    uint8_t *orig_src, *comp_src, *decomp_src;
+    size_t orig_sz, comp_sz, decomp_sz;
+    unsigned int src_sz, out_sz, last;
+    unsigned int in_len = 0, comp_len = 0;
+    unsigned int parts[3];
+    int window_bits;
+
+    orig_sz = decomp_sz = test_sz;
+    comp_sz = qzMaxCompressedLength(orig_sz);
+    orig_src = malloc(orig_sz);
+    comp_src = malloc(comp_sz);
+    decomp_src = malloc(decomp_sz);
+    if (orig_src == NULL ||
+        comp_src == NULL ||
+        decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        QZ_ERROR("qzInit for testing %s error, return: %d\n", __func__, rc);
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.comp_lvl = comp_lvl;
+    params.data_fmt = data_fmt;
+    rc = qzSetupSession(&sess, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        QZ_ERROR("qzSetupSession for testing %s error, return: %d\n", __func__, rc);
+        goto done;
+    }
+
+    /*the small part below input_sz_thrshold goes to software*/
+    genRandomData(orig_src, orig_sz);
+    parts[0] = GET_LOWER_32BITS(orig_sz / 4) + 17;
+    parts[1] = 100;
+    parts[2] = GET_LOWER_32BITS(orig_sz) - parts[0] - parts[1];
+    for (k = 0; k < ARRAY_LEN(parts); k++) {
+        src_sz = parts[k];
+        out_sz = GET_LOWER_32BITS(comp_sz) - comp_len;
+        last = (k == ARRAY_LEN(parts) - 1 && !close_empty) ? 1 : 0;
+        rc = qzCompress(&sess, orig_src + in_len, &src_sz,
+                        comp_src + comp_len, &out_sz, last);
+        if (rc != QZ_OK || src_sz != parts[k]) {
+            QZ_ERROR("ERROR: Compression of part %d FAILED with return value: %d\n",
+                     k, rc);
+            rc = QZ_FAIL;
+            goto done;
+        }
+        in_len += src_sz;
+        comp_len += out_sz;
+    }
+
+    if (close_empty) {
+        src_sz = 0;
+        out_sz = GET_LOWER_32BITS(comp_sz) - comp_len;
+        rc = qzCompress(&sess, orig_src, &src_sz, comp_src + comp_len, &out_sz, 1);
+        if (rc != QZ_OK || 0 == out_sz) {
+            QZ_ERROR("ERROR: Closing the member FAILED with return value: %d\n", rc);
+            rc = QZ_FAIL;
+            goto done;
+        }
+        comp_len += out_sz;
+    }
+
+    /*the output must be exactly one gzip member, raw or zlib stream*/
+    rc = QZ_FAIL;
+    if (QZ_DEFLATE_GZIP == data_fmt) {
+        window_bits = MAX_WBITS + 16;
+    } else if (QZ_DEFLATE_ZLIB == data_fmt) {
+        window_bits = MAX_WBITS;
+    } else {
+        window_bits = -MAX_WBITS;
+    }
+    memset(&strm, 0, sizeof(strm));
+    if (Z_OK != inflateInit2(&strm, window_bits)) {
+        goto done;
+    }
+    strm.next_in = comp_src;
+    strm.avail_in = comp_len;
+    strm.next_out = decomp_src;
+    strm.avail_out = GET_LOWER_32BITS(decomp_sz);
+    if (Z_STREAM_END != inflate(&strm, Z_FINISH) ||
+        strm.total_in != comp_len                 ||
+        strm.total_out != orig_sz                 ||
+        memcmp(orig_src, decomp_src, orig_sz)) {
+        QZ_ERROR("ERROR: zlib inflate of format %d FAILED\n", data_fmt);
+        (void)inflateEnd(&strm);
+        goto done;
+    }
+    (void)inflateEnd(&strm);
+
+    src_sz = comp_len;
+    out_sz = GET_LOWER_32BITS(decomp_sz);
+    memset(decomp_src, 0, decomp_sz);
+    rc = qzDecompress(&sess, comp_src, &src_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK       ||
+        src_sz != comp_len ||
+        out_sz != orig_sz  ||
+        memcmp(orig_src, decomp_src, orig_sz)) {
+        QZ_ERROR("ERROR: Decompression FAILED with return value: %d\n", rc);
+        rc = QZ_FAIL;
+        goto done;
+    }
+
+done:
+    free(orig_src);
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+/* Empty input with last set is a whole empty stream, not zero bytes */
+static int doCompressEmptyStream(QzDataFormat_T data_fmt)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    z_stream strm;
+    unsigned char src[1], comp_src[64], decomp_src[16];
+    unsigned int src_sz = 0, out_sz = sizeof(comp_src), comp_len;
+    int window_bits;
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.data_fmt = data_fmt;
+    rc = qzSetupSession(&sess, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+
+    rc = qzCompress(&sess, src, &src_sz, comp_src, &out_sz, 1);
+    if (rc != QZ_OK || 0 == out_sz) {
+        QZ_ERROR("ERROR: Empty stream of format %d has %u bytes: %d\n",
+                 data_fmt, out_sz, rc);
+        rc = QZ_FAIL;
+        goto done;
+    }
+    comp_len = out_sz;
+
+    rc = QZ_FAIL;
+    if (QZ_DEFLATE_GZIP == data_fmt) {
+        window_bits = MAX_WBITS + 16;
+    } else if (QZ_DEFLATE_ZLIB == data_fmt) {
+        window_bits = MAX_WBITS;
+    } else {
+        window_bits = -MAX_WBITS;
+    }
+    memset(&strm, 0, sizeof(strm));
+    if (Z_OK != inflateInit2(&strm, window_bits)) {
+        goto done;
+    }
+    strm.next_in = comp_src;
+    strm.avail_in = comp_len;
+    strm.next_out = decomp_src;
+    strm.avail_out = sizeof(decomp_src);
+    if (Z_STREAM_END != inflate(&strm, Z_FINISH) ||
+        strm.total_in != comp_len || strm.total_out != 0) {
+        QZ_ERROR("ERROR: zlib inflate of empty format %d FAILED\n", data_fmt);
+        (void)inflateEnd(&strm);
+        goto done;
+    }
+    (void)inflateEnd(&strm);
+
+    src_sz = comp_len;
+    out_sz = sizeof(decomp_src);
+    rc = qzDecompress(&sess, comp_src, &src_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK || src_sz != comp_len || out_sz != 0) {
+        QZ_ERROR("ERROR: Decompression of empty format %d FAILED: %d\n",
+                 data_fmt, rc);
+        rc = QZ_FAIL;
+    }
+
+done:
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+int qzCompressStdGzipMember(void)
+{
+    int rc;
+
+    rc = doCompressSingleStream(QZ_DEFLATE_GZIP, 4 * MB, 1, 0);
+    if (QZ_OK == rc) {
+        rc = doCompressSingleStream(QZ_DEFLATE_GZIP, 4 * MB, 1, 1);
+    }
+    if (QZ_OK == rc) {
+        rc = doCompressSingleStream(QZ_DEFLATE_GZIP, 4 * MB, 9, 1);
+    }
+    if (QZ_OK == rc) {
+        rc = doCompressEmptyStream(QZ_DEFLATE_GZIP);
+    }
+
+    return rc;
+}
+
+int qzCompressRawAndZlib(void)
+{
+    QzDataFormat_T fmts[] = {QZ_DEFLATE_RAW, QZ_DEFLATE_ZLIB};
+    size_t test_sz[] = {40 * KB, 4 * MB};
+    int i, k, rc = QZ_OK;
+
+    /*the small stream is decompressed by a single hardware request*/
+    for (i = 0; i < ARRAY_LEN(fmts) && QZ_OK == rc; i++) {
+        for (k = 0; k < ARRAY_LEN(test_sz) && QZ_OK == rc; k++) {
+            rc = doCompressSingleStream(fmts[i], test_sz[k], 1, k);
+        }
+        if (QZ_OK == rc) {
+            rc = doCompressSingleStream(fmts[i], 4 * MB, 9, 0);
+        }
+        if (QZ_OK == rc) {
+            rc = doCompressEmptyStream(fmts[i]);
+        }
+    }
+
+    return rc;
+}
+
+int qzCompressZlibAdler(void)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    uint8_t *src = NULL, *comp = NULL;
+    unsigned int src_sz, comp_sz;
+    unsigned long adler_sw, adler_qz = 0;
+    size_t orig_sz = 256 * KB;
+
+    src = malloc(orig_sz);
+    comp = malloc(qzMaxCompressedLength(orig_sz));
+    if (NULL == src || NULL == comp) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.data_fmt = QZ_DEFLATE_ZLIB;
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+    rc = qzSetupSession(&sess, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+
+    genRandomData(src, orig_sz);
+    adler_sw = adler32(adler32(0, NULL, 0), src, GET_LOWER_32BITS(orig_sz));
+    src_sz = GET_LOWER_32BITS(orig_sz);
+    comp_sz = qzMaxCompressedLength(orig_sz);
+    rc = qzCompressCrc(&sess, src, &src_sz, comp, &comp_sz, 1, &adler_qz);
+    if (rc != QZ_OK || adler_sw != adler_qz) {
+        QZ_ERROR("ERROR: zlib Adler-32 check FAILED: SW %lu, QATzip %lu\n",
+                 adler_sw, adler_qz);
+        rc = QZ_FAIL;
+    }
+
+done:
+    free(src);
+    free(comp);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+static int doCompressIndexTrailer(unsigned int comp_lvl, int close_empty)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    QzIndex_T index = {0};
+    z_stream strm;
+    uint8_t *orig_src, *comp_src, *decomp_src;
+    size_t orig_sz, comp_sz, decomp_sz;
+    unsigned int src_sz, out_sz, comp_len = 0;
+    unsigned long off;
+    long k;
+
+    orig_sz = decomp_sz = 4 * MB;
+    comp_sz = qzMaxCompressedLength(orig_sz) + 64 * KB;
+    orig_src = malloc(orig_sz);
+    comp_src = malloc(comp_sz);
+    decomp_src = malloc(decomp_sz);
+    if (orig_src == NULL ||
+        comp_src == NULL ||
+        decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.comp_lvl = comp_lvl;
+    params.index_trailer = 1;
+    rc = qzSetupSession(&sess, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+
+    genRandomData(orig_src, orig_sz);
+    src_sz = MB + 5;
+    out_sz = GET_LOWER_32BITS(comp_sz);
+    rc = qzCompress(&sess, orig_src, &src_sz, comp_src, &out_sz, 0);
+    if (rc != QZ_OK || src_sz != MB + 5) {
+        goto fail;
+    }
+    comp_len = out_sz;
+
+    src_sz = GET_LOWER_32BITS(orig_sz) - (MB + 5);
+    out_sz = GET_LOWER_32BITS(comp_sz) - comp_len;
+    rc = qzCompress(&sess, orig_src + MB + 5, &src_sz, comp_src + comp_len,
+                    &out_sz, close_empty ? 0 : 1);
+    if (rc != QZ_OK || src_sz != orig_sz - (MB + 5)) {
+        goto fail;
+    }
+    comp_len += out_sz;
+
+    if (close_empty) {
+        src_sz = 0;
+        out_sz = GET_LOWER_32BITS(comp_sz) - comp_len;
+        rc = qzCompress(&sess, orig_src, &src_sz, comp_src + comp_len, &out_sz, 1);
+        if (rc != QZ_OK || 0 == out_sz) {
+            goto fail;
+        }
+        comp_len += out_sz;
+    }
+
+    /*every offset maps to the member holding it*/
+    rc = qzIndexLoad(comp_src, comp_len, &index);
+    if (rc != QZ_OK || index.u_off[index.cnt] != orig_sz) {
+        QZ_ERROR("ERROR: Loading the seek index FAILED\n");
+        goto fail;
+    }
+    for (off = 0; off < orig_sz; off += 99991) {
+        k = qzIndexLookup(&index, off);
+        if (k < 0 || index.u_off[k] > off || index.u_off[k + 1] <= off) {
+            QZ_ERROR("ERROR: Seek index lookup of %lu FAILED\n", off);
+            goto fail;
+        }
+    }
+    if (-1 != qzIndexLookup(&index, orig_sz)) {
+        goto fail;
+    }
+
+    /*gunzip sees the index as empty members*/
+    memset(&strm, 0, sizeof(strm));
+    if (Z_OK != inflateInit2(&strm, MAX_WBITS + 16)) {
+        goto fail;
+    }
+    strm.next_in = comp_src;
+    strm.avail_in = comp_len;
+    strm.next_out = decomp_src;
+    strm.avail_out = GET_LOWER_32BITS(decomp_sz);
+    while (strm.avail_in) {
+        if (Z_STREAM_END != inflate(&strm, Z_NO_FLUSH) ||
+            Z_OK != inflateReset(&strm)) {
+            break;
+        }
+    }
+    (void)inflateEnd(&strm);
+    if (strm.avail_in || strm.next_out != decomp_src + orig_sz ||
+        memcmp(orig_src, decomp_src, orig_sz)) {
+        QZ_ERROR("ERROR: gunzip of the indexed stream FAILED\n");
+        goto fail;
+    }
+
+    src_sz = comp_len;
+    out_sz = GET_LOWER_32BITS(decomp_sz);
+    memset(decomp_src, 0, decomp_sz);
+    rc = qzDecompress(&sess, comp_src, &src_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK || src_sz != comp_len || out_sz != orig_sz ||
+        memcmp(orig_src, decomp_src, orig_sz)) {
+        QZ_ERROR("ERROR: Decompression of the indexed stream FAILED: %d\n", rc);
+        goto fail;
+    }
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    qzIndexFree(&index);
+    free(orig_src);
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+int qzCompressIndexTrailer(void)
+{
+    int rc;
+
+    rc = doCompressIndexTrailer(1, 0);
+    if (QZ_OK == rc) {
+        rc = doCompressIndexTrailer(1, 1);
+    }
+    if (QZ_OK == rc) {
+        rc = doCompressIndexTrailer(9, 0);
+    }
+
+    return rc;
+}
+
+static int doDecompressRange(unsigned char index_trailer)
+{
+    int rc = QZ_FAIL;
+    int k;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    uint8_t *orig_src, *comp_src, *decomp_src;
+    size_t orig_sz, comp_sz;
+    unsigned int src_sz, out_sz, len;
+    unsigned long off, expect;
+    /*aligned, straddling, single byte, whole and past the end*/
+    const unsigned long ranges[][2] = {
+        {0, 64 * KB}, {64 * KB, 192 * KB}, {1000, 1}, {65535, 2},
+        {777777, 1555555}, {0, 3 * MB}, {3 * MB - 10, 100}, {3 * MB, 10}
+    };
+
+    orig_sz = 3 * MB;
+    comp_sz = qzMaxCompressedLength(orig_sz) + 64 * KB;
+    orig_src = malloc(orig_sz);
+    comp_src = malloc(comp_sz);
+    decomp_src = malloc(orig_sz);
+    if (orig_src == NULL ||
+        comp_src == NULL ||
+        decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.index_trailer = index_trailer;
+    rc = qzSetupSession(&sess, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+
+    genRandomData(orig_src, orig_sz);
+    src_sz = GET_LOWER_32BITS(orig_sz);
+    out_sz = GET_LOWER_32BITS(comp_sz);
+    rc = qzCompress(&sess, orig_src, &src_sz, comp_src, &out_sz, 1);
+    if (rc != QZ_OK || src_sz != orig_sz) {
+        goto fail;
+    }
+
+    for (k = 0; k < ARRAY_LEN(ranges); k++) {
+        off = ranges[k][0];
+        len = GET_LOWER_32BITS(ranges[k][1]);
+        expect = (off >= orig_sz) ? 0 : orig_sz - off;
+        if (expect > ranges[k][1]) {
+            expect = ranges[k][1];
+        }
+        rc = qzDecompressRange(&sess, comp_src, out_sz, off, &len, decomp_src);
+        if (rc != QZ_OK || len != expect ||
+            (len && memcmp(orig_src + off, decomp_src, len))) {
+            QZ_ERROR("ERROR: Range [%lu, +%lu) FAILED: %d, len %u\n",
+                     off, ranges[k][1], rc, len);
+            goto fail;
+        }
+    }
+
+    /*a stream without QZ members is refused*/
+    memset(decomp_src, 0, 64 * KB);
+    len = 10;
+    rc = qzDecompressRange(&sess, decomp_src, 64 * KB, 0, &len, decomp_src);
+    if (rc != QZ_FAIL) {
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+int qzDecompressRangeTest(void)
+{
+    int rc;
+
+    rc = doDecompressRange(0);
+    if (QZ_OK == rc) {
+        rc = doDecompressRange(1);
+    }
+
+    return rc;
+}
+
+static int doDecompressedLength(unsigned char index_trailer)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    uint8_t *orig_src, *comp_src;
+    size_t orig_sz, comp_sz;
+    unsigned int src_sz, out_sz, members, part_members;
+    unsigned long out_len, part_len;
+
+    orig_sz = 3 * MB + 5;
+    comp_sz = qzMaxCompressedLength(orig_sz) + 64 * KB;
+    orig_src = malloc(orig_sz);
+    comp_src = malloc(comp_sz);
+    if (orig_src == NULL ||
+        comp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.index_trailer = index_trailer;
+    rc = qzSetupSession(&sess, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+
+    genRandomData(orig_src, orig_sz);
+    src_sz = GET_LOWER_32BITS(orig_sz);
+    out_sz = GET_LOWER_32BITS(comp_sz);
+    rc = qzCompress(&sess, orig_src, &src_sz, comp_src, &out_sz, 1);
+    if (rc != QZ_OK || src_sz != orig_sz) {
+        goto fail;
+    }
+
+    rc = qzDecompressedLength(comp_src, out_sz, &out_len, &members);
+    if (rc != QZ_OK || out_len != orig_sz || members < 2) {
+        QZ_ERROR("ERROR: Decompressed length %lu of %u members FAILED: %d\n",
+                 out_len, members, rc);
+        goto fail;
+    }
+
+    /*a truncated tail only counts the complete members*/
+    rc = qzDecompressedLength(comp_src, out_sz / 2, &part_len, &part_members);
+    if (rc != QZ_DATA_ERROR || part_len >= out_len ||
+        part_members >= members || 0 == part_members) {
+        QZ_ERROR("ERROR: Truncated length %lu of %u members FAILED: %d\n",
+                 part_len, part_members, rc);
+        goto fail;
+    }
+
+    memset(comp_src, 0, 64 * KB);
+    rc = qzDecompressedLength(comp_src, 64 * KB, &out_len, &members);
+    if (rc != QZ_FAIL || 0 != out_len) {
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+int qzDecompressedLengthTest(void)
+{
+    int rc;
+
+    rc = doDecompressedLength(0);
+    if (QZ_OK == rc) {
+        rc = doDecompressedLength(1);
+    }
+
+    return rc;
+}
+
+static int doCompressIncompressible(unsigned char store_incompressible)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    uint8_t *orig_src, *comp_src, *decomp_src;
+    size_t orig_sz, comp_sz, i;
+    unsigned int src_sz, out_sz, members;
+
+    orig_sz = 4 * MB;
+    comp_sz = qzMaxCompressedLength(orig_sz);
+    orig_src = malloc(orig_sz);
+    comp_src = malloc(comp_sz);
+    decomp_src = malloc(orig_sz);
+    if (orig_src == NULL ||
+        comp_src == NULL ||
+        decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.store_incompressible = store_incompressible;
+    rc = qzSetupSession(&sess, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+
+    for (i = 0; i < orig_sz; i++) {
+        orig_src[i] = GET_LOWER_8BITS(rand());
+    }
+
+    src_sz = GET_LOWER_32BITS(orig_sz);
+    out_sz = GET_LOWER_32BITS(comp_sz);
+    rc = qzCompress(&sess, orig_src, &src_sz, comp_src, &out_sz, 1);
+    if (rc != QZ_OK || src_sz != orig_sz) {
+        goto fail;
+    }
+
+    /*stored members only grow by their framing*/
+    members = GET_LOWER_32BITS(orig_sz / params.hw_buff_sz);
+    if (store_incompressible &&
+        out_sz > orig_sz + members * (qzGzipHeaderSz() + qzGzipFooterSz() + 5)) {
+        QZ_ERROR("ERROR: Incompressible data grew to %u bytes\n", out_sz);
+        goto fail;
+    }
+
+    src_sz = out_sz;
+    out_sz = GET_LOWER_32BITS(orig_sz);
+    rc = qzDecompress(&sess, comp_src, &src_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK || out_sz != orig_sz ||
+        memcmp(orig_src, decomp_src, orig_sz)) {
+        QZ_ERROR("ERROR: Decompression of incompressible data FAILED: %d\n", rc);
+        goto fail;
+    }
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+int qzCompressIncompressible(void)
+{
+    int rc;
+
+    rc = doCompressIncompressible(1);
+    if (QZ_OK == rc) {
+        rc = doCompressIncompressible(0);
+    }
+
+    return rc;
+}
+
+static unsigned int genJsonRecord(char *buf, unsigned int seq)
+{
+    return (unsigned int)sprintf(buf,
+                                 "{\"id\":%u,\"user\":\"user%u\",\"status\":\"%s\","
+                                 "\"region\":\"eu-west-%u\",\"tags\":[\"alpha\",\"beta\"],"
+                                 "\"metrics\":{\"latency_ms\":%u,\"bytes_in\":%u,"
+                                 "\"bytes_out\":%u,\"retries\":%u}}\n",
+                                 seq, seq * 7919 % 10007,
+                                 (seq % 3) ? "active" : "suspended", seq % 4,
+                                 seq * 31 % 997, seq * 131 % 65521,
+                                 seq * 17 % 32749, seq % 5);
+}
+
+static int doCompressDictionary(QzDataFormat_T data_fmt)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0}, dsess = {0};
+    QzSessionParams_T params;
+    char dict[4 * KB], rec[4 * KB];
+    uint8_t *orig_src = NULL, *comp_src = NULL, *decomp_src = NULL;
+    unsigned int dict_len = 0, rec_len, plain_len = 0, src_sz, out_sz;
+    unsigned int k, large_sz = 256 * KB, comp_len;
+
+    /*the dictionary holds records like those being compressed*/
+    for (k = 0; dict_len < sizeof(dict) - 512; k++) {
+        dict_len += genJsonRecord(dict + dict_len, 100000 + k);
+    }
+    rec_len = genJsonRecord(rec, 4242);
+
+    orig_src = malloc(large_sz);
+    comp_src = malloc(DEST_SZ(large_sz) * 2);
+    decomp_src = malloc(large_sz * 2);
+    if (orig_src == NULL ||
+        comp_src == NULL ||
+        decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.data_fmt = data_fmt;
+    if ((rc = qzSetupSession(&sess, &params)) != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+    if ((rc = qzSetupSession(&dsess, &params)) != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+
+    src_sz = rec_len;
+    plain_len = DEST_SZ(large_sz);
+    rc = qzCompress(&sess, (uint8_t *)rec, &src_sz, comp_src, &plain_len, 1);
+    if (rc != QZ_OK ||
+        qzSetDictionary(&sess, (uint8_t *)dict, dict_len) != QZ_OK ||
+        qzSetDictionary(&dsess, (uint8_t *)dict, dict_len) != QZ_OK) {
+        goto fail;
+    }
+
+    /*a small record shrinks with the dictionary and decompresses with it*/
+    src_sz = rec_len;
+    out_sz = DEST_SZ(large_sz);
+    rc = qzCompress(&sess, (uint8_t *)rec, &src_sz, comp_src, &out_sz, 1);
+    if (rc != QZ_OK || out_sz >= plain_len) {
+        QZ_ERROR("ERROR: Record of %u bytes compressed to %u with dictionary, "
+                 "%u without\n", rec_len, out_sz, plain_len);
+        goto fail;
+    }
+
+    src_sz = out_sz;
+    out_sz = large_sz;
+    rc = qzDecompress(&dsess, comp_src, &src_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK || out_sz != rec_len || memcmp(rec, decomp_src, rec_len)) {
+        QZ_ERROR("ERROR: Decompression with dictionary FAILED: %d\n", rc);
+        goto fail;
+    }
+
+    if (QZ_DEFLATE_GZIP_EXT != data_fmt) {
+        rc = QZ_OK;
+        goto done;
+    }
+
+    /*QZ members carry the dictionary ID*/
+    (void)qzSetDictionary(&dsess, NULL, 0);
+    out_sz = large_sz;
+    if (QZ_OK == qzDecompress(&dsess, comp_src, &src_sz, decomp_src, &out_sz)) {
+        goto fail;
+    }
+    (void)qzSetDictionary(&dsess, (uint8_t *)dict, dict_len);
+
+    /*hardware members followed by dictionary members*/
+    genRandomData(orig_src, large_sz);
+    (void)qzSetDictionary(&sess, NULL, 0);
+    src_sz = large_sz;
+    out_sz = DEST_SZ(large_sz) * 2;
+    rc = qzCompress(&sess, orig_src, &src_sz, comp_src, &out_sz, 1);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+    comp_len = out_sz;
+    (void)qzSetDictionary(&sess, (uint8_t *)dict, dict_len);
+    src_sz = large_sz;
+    out_sz = DEST_SZ(large_sz) * 2 - comp_len;
+    rc = qzCompress(&sess, orig_src, &src_sz, comp_src + comp_len, &out_sz, 1);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+    comp_len += out_sz;
+
+    src_sz = comp_len;
+    out_sz = large_sz * 2;
+    rc = qzDecompress(&dsess, comp_src, &src_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK || src_sz != comp_len || out_sz != large_sz * 2 ||
+        memcmp(orig_src, decomp_src, large_sz) ||
+        memcmp(orig_src, decomp_src + large_sz, large_sz)) {
+        QZ_ERROR("ERROR: Decompression of mixed members FAILED: %d\n", rc);
+        goto fail;
+    }
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    (void)qzTeardownSession(&dsess);
+    qzClose(&sess);
+    return rc;
+}
+
+int qzCompressDictionary(void)
+{
+    int rc;
+
+    rc = doCompressDictionary(QZ_DEFLATE_GZIP_EXT);
+    if (QZ_OK == rc) {
+        rc = doCompressDictionary(QZ_DEFLATE_RAW);
+    }
+    if (QZ_OK == rc) {
+        rc = doCompressDictionary(QZ_DEFLATE_ZLIB);
+    }
+
+    return rc;
+}
+
+static int doCompressCache(unsigned int src_sz, unsigned int cache_sz)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    QzCacheStats_T stats;
+    uint8_t *orig_src = NULL, *comp_src = NULL, *comp2_src = NULL;
+    uint8_t *decomp_src = NULL;
+    unsigned int in_sz, out_sz, comp_len, chunks;
+
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    comp2_src = malloc(DEST_SZ(src_sz));
+    decomp_src = malloc(src_sz);
+    if (orig_src == NULL ||
+        comp_src == NULL ||
+        comp2_src == NULL ||
+        decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.cache_sz = cache_sz;
+    if ((rc = qzSetupSession(&sess, &params)) != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+    chunks = (src_sz + params.hw_buff_sz - 1) / params.hw_buff_sz;
+
+    in_sz = src_sz;
+    comp_len = DEST_SZ(src_sz);
+    rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &comp_len, 1);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+
+    /*the second pass is served from the cache and matches the first*/
+    in_sz = src_sz;
+    out_sz = DEST_SZ(src_sz);
+    rc = qzCompress(&sess, orig_src, &in_sz, comp2_src, &out_sz, 1);
+    if (rc != QZ_OK || out_sz != comp_len ||
+        memcmp(comp_src, comp2_src, comp_len) ||
+        qzGetCacheStats(&sess, &stats) != QZ_OK) {
+        QZ_ERROR("ERROR: Cached compression FAILED: %d\n", rc);
+        goto fail;
+    }
+
+    if (stats.bytes > cache_sz ||
+        stats.hits + stats.misses != 2 * chunks ||
+        (cache_sz >= 2 * src_sz && stats.hits != chunks)) {
+        QZ_ERROR("ERROR: Cache hits %lu misses %lu bytes %lu for %u chunks\n",
+                 stats.hits, stats.misses, stats.bytes, chunks);
+        goto fail;
+    }
+
+    in_sz = out_sz;
+    out_sz = src_sz;
+    rc = qzDecompress(&sess, comp2_src, &in_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK || out_sz != src_sz || memcmp(orig_src, decomp_src, src_sz)) {
+        QZ_ERROR("ERROR: Decompression of cached output FAILED: %d\n", rc);
+        goto fail;
+    }
+
+    /*setting up the session again empties the cache*/
+    if (qzSetupSession(&sess, &params) != QZ_OK ||
+        qzGetCacheStats(&sess, &stats) != QZ_OK ||
+        stats.hits || stats.entries) {
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    free(comp2_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+/* A cached chunk the output has no room for is a miss, it is never copied
+ * past the end of a pinned destination
+ */
+static int doCompressCacheBound(void)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    uint8_t *orig_src = NULL, *comp_src = NULL, *pinned = NULL;
+    unsigned int src_sz = QZ_HW_BUFF_SZ, dest_sz = DEST_SZ(src_sz);
+    unsigned int in_sz, comp_len, out_sz, k;
+
+    orig_src = malloc(src_sz);
+    comp_src = malloc(dest_sz);
+    pinned = qzMalloc(dest_sz, 0, PINNED_MEM);
+    if (orig_src == NULL || comp_src == NULL || pinned == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.hw_buff_sz = QZ_HW_BUFF_SZ;
+    params.cache_sz = 4 * 1024 * KB;
+    if ((rc = qzSetupSession(&sess, &params)) != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+
+    in_sz = src_sz;
+    comp_len = dest_sz;
+    rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &comp_len, 1);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+
+    memset(pinned, 0xa5, dest_sz);
+    in_sz = src_sz;
+    out_sz = comp_len / 2;
+    rc = qzCompress(&sess, orig_src, &in_sz, pinned, &out_sz, 1);
+    if (rc == QZ_OK) {
+        QZ_ERROR("ERROR: Cached compression into a short buffer returned %d\n",
+                 rc);
+        goto fail;
+    }
+    for (k = comp_len / 2; k < dest_sz; k++) {
+        if (pinned[k] != 0xa5) {
+            QZ_ERROR("ERROR: Cached compression wrote past the buffer at %u\n",
+                     k);
+            goto fail;
+        }
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    if (NULL != pinned) {
+        qzFree(pinned);
+    }
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+int qzCompressCache(void)
+{
+    int rc;
+
+    /*hardware chunks, software chunks below comp_threshold, an LRU cap*/
+    rc = doCompressCache(1024 * KB, 4 * 1024 * KB);
+    if (QZ_OK == rc) {
+        rc = doCompressCache(512, 4 * 1024 * KB);
+    }
+    if (QZ_OK == rc) {
+        rc = doCompressCache(1024 * KB, 256 * KB);
+    }
+    if (QZ_OK == rc) {
+        rc = doCompressCacheBound();
+    }
+
+    return rc;
+}
+
+/* With rsyncable set a byte inserted near the start only changes the
+ * members around it, the rest of the output is unchanged
+ */
+int qzCompressRsyncable(void)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    uint8_t *orig_src = NULL, *comp_src = NULL, *comp2_src = NULL;
+    uint8_t *decomp_src = NULL;
+    unsigned int src_sz = 2 * 1024 * KB, ins_off = 1000;
+    unsigned int in_sz, out_sz, comp_len, comp2_len, same;
+
+    orig_src = malloc(src_sz + 1);
+    comp_src = malloc(DEST_SZ(src_sz));
+    comp2_src = malloc(DEST_SZ(src_sz));
+    decomp_src = malloc(src_sz + 1);
+    if (orig_src == NULL ||
+        comp_src == NULL ||
+        comp2_src == NULL ||
+        decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.rsyncable = 1;
+    if ((rc = qzSetupSession(&sess, &params)) != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+
+    in_sz = src_sz;
+    comp_len = DEST_SZ(src_sz);
+    rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &comp_len, 1);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+
+    memmove(orig_src + ins_off + 1, orig_src + ins_off, src_sz - ins_off);
+    orig_src[ins_off] = 'x';
+    in_sz = src_sz + 1;
+    comp2_len = DEST_SZ(src_sz);
+    rc = qzCompress(&sess, orig_src, &in_sz, comp2_src, &comp2_len, 1);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+
+    for (same = 0; same < comp_len && same < comp2_len; same++) {
+        if (comp_src[comp_len - same - 1] != comp2_src[comp2_len - same - 1]) {
+            break;
+        }
+    }
+    if (same < comp_len / 2) {
+        QZ_ERROR("ERROR: Only %u of %u bytes unchanged after an insertion\n",
+                 same, comp_len);
+        goto fail;
+    }
+
+    in_sz = comp2_len;
+    out_sz = src_sz + 1;
+    rc = qzDecompress(&sess, comp2_src, &in_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK || out_sz != src_sz + 1 ||
+        memcmp(orig_src, decomp_src, src_sz + 1)) {
+        QZ_ERROR("ERROR: Decompression of rsyncable output FAILED: %d\n", rc);
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    free(comp2_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+static int doDecompressCrc(QzDataFormat_T data_fmt, unsigned int src_sz,
+                           unsigned int fail_submits)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    uint8_t *orig_src = NULL, *comp_src = NULL, *decomp_src = NULL;
+    unsigned int in_sz, out_sz;
+    unsigned long comp_crc, decomp_crc, cksum;
+
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    decomp_src = malloc(src_sz);
+    if (orig_src == NULL ||
+        comp_src == NULL ||
+        decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    /*half compressible, large inputs reach the parallel inflate*/
+    for (in_sz = 0; in_sz < src_sz; in_sz++) {
+        orig_src[in_sz] = 'a' + rand() % 16;
+    }
+    cksum = (QZ_DEFLATE_ZLIB == data_fmt) ?
+            adler32(adler32(0, NULL, 0), orig_src, src_sz) :
+            crc32(0, orig_src, src_sz);
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.data_fmt = data_fmt;
+    params.par_decomp_thrshold = QZ_PAR_DECOMP_THRESHOLD_MINIMUM;
+    if ((rc = qzSetupSession(&sess, &params)) != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+
+    in_sz = src_sz;
+    out_sz = DEST_SZ(src_sz);
+    rc = qzCompressCrc(&sess, orig_src, &in_sz, comp_src, &out_sz, 1, &comp_crc);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+
+    in_sz = out_sz;
+    out_sz = src_sz;
+    decomp_crc = ~cksum;
+    g_process.fail_submits = fail_submits;
+    rc = qzDecompressCrc(&sess, comp_src, &in_sz, decomp_src, &out_sz,
+                         &decomp_crc);
+    /*without hardware nothing is submitted*/
+    if (fail_submits && g_process.fail_submits &&
+        QZ_OK == g_process.qz_init_status) {
+        QZ_ERROR("ERROR: the submit failure was not injected\n");
+        goto fail;
+    }
+    if (rc != QZ_OK || out_sz != src_sz ||
+        memcmp(orig_src, decomp_src, src_sz) ||
+        comp_crc != cksum || decomp_crc != cksum) {
+        QZ_ERROR("ERROR: format %d size %u checksum %lx, compression %lx, "
+                 "decompression %lx: %d\n", data_fmt, src_sz, cksum,
+                 comp_crc, decomp_crc, rc);
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    g_process.fail_submits = 0;
+    free(orig_src);
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+int qzDecompressCrcTest(void)
+{
+    QzDataFormat_T fmts[] = {QZ_DEFLATE_GZIP_EXT, QZ_DEFLATE_GZIP,
+                             QZ_DEFLATE_RAW, QZ_DEFLATE_ZLIB
+                            };
+    /*software sized, hardware sized, parallel inflate sized*/
+    unsigned int sizes[] = {600, 1024 * KB, 4 * 1024 * KB};
+    int f, k;
+
+    for (f = 0; f < ARRAY_LEN(fmts); f++) {
+        for (k = 0; k < ARRAY_LEN(sizes); k++) {
+            if (QZ_OK != doDecompressCrc(fmts[f], sizes[k], 0)) {
+                return QZ_FAIL;
+            }
+        }
+    }
+
+    return QZ_OK;
+}
+
+/* A device failing the first submit hands the whole buffer to software,
+ * the checksum must then cover every member once
+ */
+int qzDecompressFaultCrcTest(void)
+{
+    return doDecompressCrc(QZ_DEFLATE_GZIP_EXT, 1024 * KB, 1);
+}
+
+#define WAIT_TEST_THREADS   8
+
+typedef struct WaitTestArg_S {
+    const uint8_t *src;
+    unsigned int src_sz;
+    QzPriority_T priority;
+    int rc;
+} WaitTestArg_T;
+
+static void *doWaitCompress(void *arg)
+{
+    WaitTestArg_T *targ = (WaitTestArg_T *)arg;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    uint8_t *comp_src = NULL, *decomp_src = NULL;
+    unsigned int in_sz, out_sz;
+    int k;
+
+    targ->rc = QZ_FAIL;
+    comp_src = malloc(DEST_SZ(targ->src_sz));
+    decomp_src = malloc(targ->src_sz);
+    if (comp_src == NULL || decomp_src == NULL) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.wait_timeout = QZ_WAIT_TIMEOUT_MAX;
+    params.priority = targ->priority;
+    if (qzSetupSession(&sess, &params) != QZ_OK) {
+        goto done;
+    }
+
+    for (k = 0; k < 2; k++) {
+        in_sz = targ->src_sz;
+        out_sz = DEST_SZ(targ->src_sz);
+        if (qzCompress(&sess, targ->src, &in_sz, comp_src, &out_sz, 1) != QZ_OK) {
+            goto done;
+        }
+        in_sz = out_sz;
+        out_sz = targ->src_sz;
+        if (qzDecompress(&sess, comp_src, &in_sz, decomp_src, &out_sz) != QZ_OK ||
+            out_sz != targ->src_sz || memcmp(targ->src, decomp_src, out_sz)) {
+            goto done;
+        }
+    }
+    targ->rc = QZ_OK;
+
+done:
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    return NULL;
+}
+
+/* Threads outnumbering the instances queue for them, bulk and high
+ * priority ones alike, the wait statistics account for every wait
+ */
+int qzInstanceWaitTest(void)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzWaitStats_T before, after;
+    WaitTestArg_T targ[WAIT_TEST_THREADS];
+    pthread_t threads[WAIT_TEST_THREADS];
+    uint8_t *orig_src = NULL;
+    unsigned int src_sz = 2 * 1024 * KB;
+    unsigned long hist_sum = 0;
+    int k, started = 0;
+
+    orig_src = malloc(src_sz);
+    if (orig_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        return QZ_FAIL;
+    }
+    genRandomData(orig_src, src_sz);
+
+    rc = qzInit(&sess, 1);
+    if ((rc != QZ_OK && rc != QZ_DUPLICATE) ||
+        qzGetWaitStats(&before) != QZ_OK) {
+        rc = QZ_FAIL;
+        goto done;
+    }
+
+    for (k = 0; k < WAIT_TEST_THREADS; k++) {
+        targ[k].src = orig_src;
+        targ[k].src_sz = src_sz;
+        targ[k].priority = (k % 2) ? QZ_PRIORITY_HIGH : QZ_PRIORITY_BULK;
+        targ[k].rc = QZ_FAIL;
+        if (pthread_create(&threads[k], NULL, doWaitCompress, &targ[k])) {
+            break;
+        }
+        started++;
+    }
+
+    rc = (started == WAIT_TEST_THREADS) ? QZ_OK : QZ_FAIL;
+    for (k = 0; k < started; k++) {
+        pthread_join(threads[k], NULL);
+        if (targ[k].rc != QZ_OK) {
+            rc = QZ_FAIL;
+        }
+    }
+
+    if (rc != QZ_OK || qzGetWaitStats(&after) != QZ_OK) {
+        QZ_ERROR("ERROR: Compression while waiting for instances FAILED\n");
+        rc = QZ_FAIL;
+        goto done;
+    }
+
+    for (k = 0; k < QZ_WAIT_HIST_SZ; k++) {
+        hist_sum += after.hist[k] - before.hist[k];
+    }
+    if (hist_sum != after.waits - before.waits ||
+        after.timeouts - before.timeouts > after.waits - before.waits ||
+        after.max_us > QZ_WAIT_TIMEOUT_MAX * 2) {
+        QZ_ERROR("ERROR: Wait statistics %lu waits, %lu in histogram, "
+                 "%lu timeouts, max %lu usec\n", after.waits - before.waits,
+                 hist_sum, after.timeouts - before.timeouts, after.max_us);
+        rc = QZ_FAIL;
+    }
+
+done:
+    free(orig_src);
+    qzClose(&sess);
+    return rc;
+}
+
+/* Bulk sessions compress large inputs in slices, the output is the same
+ * as in one piece
+ */
+static int doCompressBulk(QzDataFormat_T data_fmt)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0}, bsess = {0};
+    QzSessionParams_T params;
+    uint8_t *orig_src = NULL, *comp_src = NULL, *comp2_src = NULL;
+    uint8_t *decomp_src = NULL;
+    unsigned int src_sz = 9 * 1024 * KB;
+    unsigned int in_sz, out_sz, comp_len;
+    unsigned long crc, bulk_crc;
+
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    comp2_src = malloc(DEST_SZ(src_sz));
+    decomp_src = malloc(src_sz);
+    if (orig_src == NULL ||
+        comp_src == NULL ||
+        comp2_src == NULL ||
+        decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.data_fmt = data_fmt;
+    if ((rc = qzSetupSession(&sess, &params)) != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+    params.priority = QZ_PRIORITY_BULK;
+    if ((rc = qzSetupSession(&bsess, &params)) != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+
+    in_sz = src_sz;
+    comp_len = DEST_SZ(src_sz);
+    rc = qzCompressCrc(&sess, orig_src, &in_sz, comp_src, &comp_len, 1, &crc);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+
+    in_sz = src_sz;
+    out_sz = DEST_SZ(src_sz);
+    rc = qzCompressCrc(&bsess, orig_src, &in_sz, comp2_src, &out_sz, 1,
+                       &bulk_crc);
+    if (rc != QZ_OK || in_sz != src_sz || bulk_crc != crc ||
+        (QZ_DEFLATE_GZIP_EXT == data_fmt &&
+         (out_sz != comp_len || memcmp(comp_src, comp2_src, comp_len)))) {
+        QZ_ERROR("ERROR: Bulk compression FAILED: %d, %u bytes, crc %lx/%lx\n",
+                 rc, out_sz, bulk_crc, crc);
+        goto fail;
+    }
+
+    in_sz = out_sz;
+    out_sz = src_sz;
+    rc = qzDecompress(&bsess, comp2_src, &in_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK || out_sz != src_sz || memcmp(orig_src, decomp_src, src_sz)) {
+        QZ_ERROR("ERROR: Decompression of bulk output FAILED: %d\n", rc);
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    free(comp2_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    (void)qzTeardownSession(&bsess);
+    qzClose(&sess);
+    return rc;
+}
+
+int qzCompressBulk(void)
+{
+    QzDataFormat_T fmts[] = {QZ_DEFLATE_GZIP_EXT, QZ_DEFLATE_GZIP,
+                             QZ_DEFLATE_RAW, QZ_DEFLATE_ZLIB
+                            };
+    int f;
+
+    for (f = 0; f < ARRAY_LEN(fmts); f++) {
+        if (QZ_OK != doCompressBulk(fmts[f])) {
+            return QZ_FAIL;
+        }
+    }
+
+    return QZ_OK;
+}
+
+static int doDeadline(QzDataFormat_T data_fmt)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    uint8_t *orig_src = NULL, *comp_src = NULL, *decomp_src = NULL;
+    unsigned int src_sz = 9 * 1024 * KB;
+    unsigned int in_sz, out_sz, consumed, produced, comp_len, calls;
+    unsigned long budget;
+
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    decomp_src = malloc(src_sz);
+    if (orig_src == NULL ||
+        comp_src == NULL ||
+        decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    qzGetDefaults(&params);
+    params.data_fmt = data_fmt;
+    if ((rc = qzSetupSession(&sess, &params)) != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+
+    /* An exhausted budget consumes nothing */
+    in_sz = src_sz;
+    out_sz = DEST_SZ(src_sz);
+    rc = qzCompressDeadline(&sess, orig_src, &in_sz, comp_src, &out_sz, 1, 0);
+    if (rc != QZ_TIMEOUT || in_sz != 0 || out_sz != 0) {
+        QZ_ERROR("ERROR: Compression with no budget returned %d, %u/%u\n",
+                 rc, in_sz, out_sz);
+        goto fail;
+    }
+
+    /* Resume after every timeout until all input is consumed */
+    consumed = produced = calls = 0;
+    budget = 2000;
+    do {
+        in_sz = src_sz - consumed;
+        out_sz = DEST_SZ(src_sz) - produced;
+        rc = qzCompressDeadline(&sess, orig_src + consumed, &in_sz,
+                                comp_src + produced, &out_sz, 1, budget);
+        if ((rc != QZ_OK && rc != QZ_TIMEOUT) || ++calls > 1024) {
+            QZ_ERROR("ERROR: Deadline compression FAILED: %d\n", rc);
+            goto fail;
+        }
+        if (in_sz == 0) {
+            budget *= 2;
+        }
+        consumed += in_sz;
+        produced += out_sz;
+    } while (rc == QZ_TIMEOUT);
+    if (consumed != src_sz) {
+        QZ_ERROR("ERROR: Deadline compression consumed %u of %u bytes\n",
+                 consumed, src_sz);
+        goto fail;
+    }
+    comp_len = produced;
+
+    if (QZ_DEFLATE_GZIP_EXT != data_fmt) {
+        /* Other formats can only be resumed as a whole stream */
+        in_sz = comp_len;
+        out_sz = src_sz;
+        rc = qzDecompress(&sess, comp_src, &in_sz, decomp_src, &out_sz);
+        if (rc != QZ_OK || out_sz != src_sz ||
+            memcmp(orig_src, decomp_src, src_sz)) {
+            QZ_ERROR("ERROR: Decompression of deadline output FAILED: %d\n", rc);
+            goto fail;
+        }
+        rc = QZ_OK;
+        goto done;
+    }
+
+    in_sz = comp_len;
+    out_sz = src_sz;
+    rc = qzDecompressDeadline(&sess, comp_src, &in_sz, decomp_src, &out_sz, 0);
+    if (rc != QZ_TIMEOUT || in_sz != 0 || out_sz != 0) {
+        QZ_ERROR("ERROR: Decompression with no budget returned %d, %u/%u\n",
+                 rc, in_sz, out_sz);
+        goto fail;
+    }
+
+    consumed = produced = calls = 0;
+    budget = 2000;
+    do {
+        in_sz = comp_len - consumed;
+        out_sz = src_sz - produced;
+        rc = qzDecompressDeadline(&sess, comp_src + consumed, &in_sz,
+                                  decomp_src + produced, &out_sz, budget);
+        if ((rc != QZ_OK && rc != QZ_TIMEOUT) || ++calls > 1024) {
+            QZ_ERROR("ERROR: Deadline decompression FAILED: %d\n", rc);
+            goto fail;
+        }
+        if (in_sz == 0) {
+            budget *= 2;
+        }
+        consumed += in_sz;
+        produced += out_sz;
+    } while (rc == QZ_TIMEOUT);
+    if (consumed != comp_len || produced != src_sz ||
+        memcmp(orig_src, decomp_src, src_sz)) {
+        QZ_ERROR("ERROR: Deadline decompression produced %u of %u bytes\n",
+                 produced, src_sz);
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+int qzDeadlineTest(void)
+{
+    QzDataFormat_T fmts[] = {QZ_DEFLATE_GZIP_EXT, QZ_DEFLATE_GZIP,
+                             QZ_DEFLATE_RAW, QZ_DEFLATE_ZLIB
+                            };
+    int f;
+
+    for (f = 0; f < ARRAY_LEN(fmts); f++) {
+        if (QZ_OK != doDeadline(fmts[f])) {
+            return QZ_FAIL;
+        }
+    }
+
+    return QZ_OK;
+}
+
+int qzInstanceHealthTest(void)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzInstanceHealth_T health;
+    uint8_t *orig_src = NULL, *comp_src = NULL;
+    unsigned int src_sz = 1024 * KB;
+    unsigned int in_sz, out_sz, inst, k;
+    unsigned long requests = 0;
+
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    if (orig_src == NULL || comp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    for (k = 0; k < 8; k++) {
+        in_sz = src_sz;
+        out_sz = DEST_SZ(src_sz);
+        rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &out_sz, 1);
+        if (rc != QZ_OK) {
+            goto fail;
+        }
+    }
+
+    if (QZ_PARAMS != qzGetInstanceHealth(0, NULL)) {
+        goto fail;
+    }
+
+    /*a healthy device is never quarantined*/
+    for (inst = 0; QZ_OK == qzGetInstanceHealth(inst, &health); inst++) {
+        if (health.errors || health.quarantines || health.quarantined ||
+            (health.requests && 0 == health.heartbeat)) {
+            QZ_ERROR("ERROR: instance %u: %lu errors, %lu quarantines\n",
+                     inst, health.errors, health.quarantines);
+            goto fail;
+        }
+        requests += health.requests;
+    }
+
+    /*without hardware there is no instance to report*/
+    if ((inst && QZ_PARAMS != qzGetInstanceHealth(inst, &health)) ||
+        (inst && requests < 8)) {
+        QZ_ERROR("ERROR: %lu requests on %u instances\n", requests, inst);
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+int qzDeviceLoadTest(void)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    uint8_t *orig_src = NULL, *comp_src = NULL;
+    unsigned int src_sz = 1024 * KB;
+    unsigned int in_sz, out_sz, d;
+    int k;
+
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    if (orig_src == NULL || comp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+
+    for (k = 0; k < 4; k++) {
+        in_sz = src_sz;
+        out_sz = DEST_SZ(src_sz);
+        rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &out_sz, 1);
+        if (rc != QZ_OK) {
+            goto fail;
+        }
+    }
+
+    /*every released instance takes its request off the table*/
+    for (d = 0; d < QAT_MAX_DEVICES; d++) {
+        if (qzLoadDevice(d)) {
+            QZ_ERROR("ERROR: %lu requests left on device %u\n",
+                     qzLoadDevice(d), d);
+            goto fail;
+        }
+    }
+
+    for (k = 0; k < QZ_LOAD_SECTIONS; k++) {
+        if (qzLoadPickSection(k) >= QZ_LOAD_SECTIONS) {
+            goto fail;
+        }
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    (void)qzTeardownSession(&sess);
+    qzClose(&sess);
+    return rc;
+}
+
+/* Compress in a forked child with the session of the parent, the child
+ * exits 0 when it got hw of its own (hw set) or ran on sw (hw clear)
+ */
+static int forkCompress(QzSession_T *sess, uint8_t *src, unsigned int src_sz,
+                        uint8_t *dest, int hw)
+{
+    pid_t pid;
+    int status;
+    unsigned int in_sz, out_sz;
+
+    pid = fork();
+    if (pid < 0) {
+        return QZ_FAIL;
+    }
+
+    if (0 == pid) {
+        in_sz = src_sz;
+        out_sz = DEST_SZ(src_sz);
+        if (QZ_OK != qzCompress(sess, src, &in_sz, dest, &out_sz, 1) ||
+            in_sz != src_sz) {
+            _exit(1);
+        }
+        if (hw != (QZ_OK == g_process.qz_init_status &&
+                   g_process.num_instances > 0)) {
+            _exit(2);
+        }
+        _exit(0);
+    }
+
+    if (pid != waitpid(pid, &status, 0) ||
+        !WIFEXITED(status) || 0 != WEXITSTATUS(status)) {
+        QZ_ERROR("ERROR: forked child with hw=%d failed, status %d\n",
+                 hw, status);
+        return QZ_FAIL;
+    }
+    return QZ_OK;
+}
+
+static int setMaxForks(unsigned int max_forks)
+{
+    QzSessionParams_T params;
+
+    qzGetDefaults(&params);
+    params.max_forks = max_forks;
+    return qzSetDefaults(&params);
+}
+
+int qzForkTest(void)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    uint8_t *orig_src = NULL, *comp_src = NULL;
+    unsigned int src_sz = 1024 * KB;
+    unsigned int in_sz, out_sz, max_forks;
+
+    qzGetDefaults(&params);
+    max_forks = params.max_forks;
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    if (orig_src == NULL || comp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE) {
+        goto done;
+    }
+    if (QZ_OK != g_process.qz_init_status ||
+        QZ_OK != qzSetupSession(&sess, &params)) {
+        /*nothing to inherit without hw*/
+        rc = QZ_OK;
+        goto done;
+    }
+
+    in_sz = src_sz;
+    out_sz = DEST_SZ(src_sz);
+    rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &out_sz, 1);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+
+    /*children within max_forks bring up instances of their own*/
+    if (QZ_OK != setMaxForks(~0U) ||
+        QZ_OK != forkCompress(&sess, orig_src, src_sz, comp_src, 1)) {
+        goto fail;
+    }
+
+    /*the ones past it stay on sw*/
+    if (QZ_OK != setMaxForks(0) ||
+        QZ_OK != forkCompress(&sess, orig_src, src_sz, comp_src, 0)) {
+        goto fail;
+    }
+
+    /*the parent keeps its instances*/
+    in_sz = src_sz;
+    out_sz = DEST_SZ(src_sz);
+    rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &out_sz, 1);
+    if (rc != QZ_OK || 0 == g_process.num_instances) {
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    (void)setMaxForks(max_forks);
+    free(orig_src);
+    free(comp_src);
+    (void)qzTeardownSession(&sess);
+    return rc;
+}
+
+/* Start the hw in the background in a forked child, which has none, and
+ * compress while it warms up and after
+ */
+static int warmupChild(uint8_t *src, unsigned int src_sz, uint8_t *dest)
+{
+    QzSession_T sess = {0};
+    unsigned int in_sz, out_sz, i;
+    int k, rc;
+
+    if (0 != g_process.qz_init_called) {
+        return 1;
+    }
+    if (QZ_OK != qzInitBackground(1) || QZ_DUPLICATE != qzInitBackground(1)) {
+        return 2;
+    }
+
+    for (k = 0; k < 2; k++) {
+        in_sz = src_sz;
+        out_sz = DEST_SZ(src_sz);
+        rc = qzCompress(&sess, src, &in_sz, dest, &out_sz, 1);
+        if (rc != QZ_OK || in_sz != src_sz) {
+            return 3;
+        }
+
+        for (i = 0; i < 1000 && g_process.warming; i++) {
+            usleep(10000);
+        }
+    }
+    if (g_process.warming) {
+        return 4;
+    }
+
+    if (QZ_OK == g_process.qz_init_status) {
+        for (i = 0; i < g_process.num_instances; i++) {
+            if (0 == g_process.qz_inst[i].mem_setup ||
+                0 == g_process.qz_inst[i].cpa_sess_setup) {
+                return 5;
+            }
+        }
+        if (QZ_OK != qzWarmup()) {
+            return 6;
+        }
+    }
+
+    (void)qzTeardownSession(&sess);
+    return 0;
+}
+
+int qzWarmupTest(void)
+{
+    int rc = QZ_FAIL, status;
+    QzSessionParams_T params;
+    uint8_t *orig_src = NULL, *comp_src = NULL;
+    unsigned int src_sz = 1024 * KB;
+    pid_t pid;
+
+    qzGetDefaults(&params);
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    if (orig_src == NULL || comp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    /*the child brings up hw of its own*/
+    if (QZ_OK != setMaxForks(~0U)) {
+        goto done;
+    }
+    pid = fork();
+    if (pid < 0) {
+        goto done;
+    }
+    if (0 == pid) {
+        _exit(warmupChild(orig_src, src_sz, comp_src));
+    }
+
+    if (pid != waitpid(pid, &status, 0) ||
+        !WIFEXITED(status) || 0 != WEXITSTATUS(status)) {
+        QZ_ERROR("ERROR: background init failed, status %d\n", status);
+        goto done;
+    }
+    rc = QZ_OK;
+
+done:
+    (void)setMaxForks(params.max_forks);
+    free(orig_src);
+    free(comp_src);
+    return rc;
+}
+
+int qzBuffCntTest(void)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0}, small = {0};
+    QzSessionParams_T params;
+    QzSess_T *qz_sess;
+    uint8_t *orig_src = NULL, *comp_src = NULL, *decomp_src = NULL;
+    unsigned int buff_cnt = 2 * QZ_BUFF_CNT_DEFAULT;
+    unsigned int src_sz, in_sz, out_sz, comp_len;
+
+    qzGetDefaults(&params);
+    params.hw_buff_sz = QZ_HW_BUFF_SZ;
+    src_sz = buff_cnt * params.hw_buff_sz / 2;
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    decomp_src = malloc(src_sz);
+    if (orig_src == NULL || comp_src == NULL || decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    /*the submit ahead depth is bound by the buffer count*/
+    params.buff_cnt = QZ_BUFF_CNT_MAX + 1;
+    if (QZ_PARAMS != qzSetupSession(&sess, &params)) {
+        goto fail;
+    }
+    params.buff_cnt = buff_cnt;
+    params.req_cnt_thrshold = buff_cnt + 1;
+    if (QZ_PARAMS != qzSetupSession(&sess, &params)) {
+        goto fail;
+    }
+    (void)qzTeardownSession(&sess);
+
+    /*instances are set up again by the first session after qzClose*/
+    (void)qzClose(&sess);
+    params.req_cnt_thrshold = buff_cnt;
+    rc = qzInit(&sess, params.sw_backup);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        goto done;
+    }
+    rc = qzSetupSession(&sess, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        goto fail;
+    }
+
+    in_sz = src_sz;
+    comp_len = DEST_SZ(src_sz);
+    rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &comp_len, 1);
+    if (rc != QZ_OK || in_sz != src_sz) {
+        goto fail;
+    }
+
+    qz_sess = (QzSess_T *)sess.internal;
+    if (QZ_OK == g_process.qz_init_status && qz_sess->inst_hint >= 0 &&
+        g_process.qz_inst[qz_sess->inst_hint].dest_count != buff_cnt) {
+        QZ_ERROR("ERROR: instance has %u buffers instead of %u\n",
+                 g_process.qz_inst[qz_sess->inst_hint].dest_count, buff_cnt);
+        goto fail;
+    }
+
+    in_sz = comp_len;
+    out_sz = src_sz;
+    rc = qzDecompress(&sess, comp_src, &in_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK || out_sz != src_sz || memcmp(orig_src, decomp_src, src_sz)) {
+        goto fail;
+    }
+
+    /*more small members than buffers in little compressed data*/
+    params.hw_buff_sz = QZ_HW_BUFF_MIN_SZ;
+    rc = qzSetupSession(&small, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        goto fail;
+    }
+    in_sz = src_sz;
+    comp_len = DEST_SZ(src_sz);
+    rc = qzCompress(&small, orig_src, &in_sz, comp_src, &comp_len, 1);
+    if (rc != QZ_OK || in_sz != src_sz) {
+        goto fail;
+    }
+    in_sz = comp_len;
+    out_sz = src_sz;
+    rc = qzDecompress(&sess, comp_src, &in_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK || out_sz != src_sz || memcmp(orig_src, decomp_src, src_sz)) {
+        QZ_ERROR("ERROR: decompression of small members returned %d\n", rc);
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&small);
+    (void)qzTeardownSession(&sess);
+    /*leave the default buffer count to the tests after*/
+    (void)qzClose(&sess);
+    return rc;
+}
+
+static int doAdaptiveChunk(QzDataFormat_T data_fmt)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    QzSess_T *qz_sess;
+    uint8_t *orig_src = NULL, *comp_src = NULL, *decomp_src = NULL;
+    unsigned int src_sz = 2 * QZ_HW_BUFF_SZ;
+    unsigned int in_sz, out_sz, comp_len, members, chunk_sz;
+    unsigned long u_len;
+
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    decomp_src = malloc(src_sz);
+    if (orig_src == NULL || comp_src == NULL || decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    qzGetDefaults(&params);
+    params.data_fmt = data_fmt;
+    params.hw_buff_sz = QZ_HW_BUFF_SZ;
+    params.rsyncable = 0;
+    params.adaptive_chunk = 1;
+    params.store_incompressible = 0;
+    rc = qzSetupSession(&sess, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        goto fail;
+    }
+
+    in_sz = src_sz;
+    comp_len = DEST_SZ(src_sz);
+    rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &comp_len, 1);
+    if (rc != QZ_OK || in_sz != src_sz) {
+        goto fail;
+    }
+
+    /*the first call of a session on an idle device is spread over
+     *small chunks*/
+    qz_sess = (QzSess_T *)sess.internal;
+    if (QZ_DEFLATE_GZIP_EXT == data_fmt && qz_sess->inst_hint >= 0 &&
+        QZ_OK == g_process.qz_init_status) {
+        chunk_sz = qz_sess->chunk_sz;
+        if (QZ_OK != qzDecompressedLength(comp_src, comp_len, &u_len,
+                                          &members) ||
+            u_len != src_sz || chunk_sz > QZ_ADAPT_CHUNK_MIN ||
+            members != (src_sz + chunk_sz - 1) / chunk_sz) {
+            QZ_ERROR("ERROR: %u bytes in %u members\n", src_sz, members);
+            goto fail;
+        }
+    }
+
+    in_sz = comp_len;
+    out_sz = src_sz;
+    rc = qzDecompress(&sess, comp_src, &in_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK || out_sz != src_sz || memcmp(orig_src, decomp_src, src_sz)) {
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    return rc;
+}
+
+int qzAdaptiveChunkTest(void)
+{
+    QzDataFormat_T fmts[] = {QZ_DEFLATE_GZIP_EXT, QZ_DEFLATE_GZIP,
+                             QZ_DEFLATE_RAW, QZ_DEFLATE_ZLIB
+                            };
+    QzSess_T qz_sess;
+    unsigned int max = QZ_HW_BUFF_SZ, k;
+
+    memset(&qz_sess, 0, sizeof(qz_sess));
+    qzGetDefaults(&qz_sess.sess_params);
+    qz_sess.sess_params.hw_buff_sz = max;
+    qz_sess.sess_params.rsyncable = 0;
+    qz_sess.sess_params.adaptive_chunk = 1;
+
+    if (qzChunkSz(&qz_sess, 2 * max, 0, 32, 1) != QZ_ADAPT_CHUNK_MIN ||
+        qzChunkSz(&qz_sess, 8 * max, 0, 32, 1) != max ||
+        qzChunkSz(&qz_sess, 2 * max, 0, 2, 1) != max ||
+        qzChunkSz(&qz_sess, 2 * max, 0, 32, 2) != max ||
+        qzChunkSz(&qz_sess, 8 * max, max / 2, 32, 1) != max / 2 ||
+        qzChunkSz(&qz_sess, QZ_ADAPT_BULK_CHUNKS * max, 0, 32, 1) != max) {
+        QZ_ERROR("ERROR: unexpected adaptive chunk size\n");
+        return QZ_FAIL;
+    }
+
+    /*well compressing data keeps larger chunks*/
+    qz_sess.ratio_avg = QZ_ADAPT_GOOD_RATIO - 1;
+    if (qzChunkSz(&qz_sess, 2 * max, 0, 32, 1) != max / 2) {
+        return QZ_FAIL;
+    }
+
+    qz_sess.sess_params.adaptive_chunk = 0;
+    if (qzChunkSz(&qz_sess, 2 * max, 0, 32, 1) != max) {
+        return QZ_FAIL;
+    }
+
+    for (k = 0; k < ARRAY_LEN(fmts); k++) {
+        if (QZ_OK != doAdaptiveChunk(fmts[k])) {
+            QZ_ERROR("ERROR: adaptive chunks with format %d FAILED\n", fmts[k]);
+            return QZ_FAIL;
+        }
+    }
+    return QZ_OK;
+}
+
+int qzStatsTest(void)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0}, tiny = {0};
+    QzSessionParams_T params;
+    QzStats_T before, after;
+    QzInstanceStats_T inst[64];
+    QzStatus_T status;
+    uint8_t *orig_src = NULL, *comp_src = NULL;
+    unsigned int src_sz = 4 * QZ_HW_BUFF_SZ, in_sz, out_sz, comp_len, i;
+    unsigned long calls = 0, small, unsupported;
+
+    if (QZ_PARAMS != qzGetStats(NULL, NULL, 0) ||
+        QZ_PARAMS != qzGetStats(&before, NULL, 1) ||
+        QZ_PARAMS != qzGetStatus(NULL, &status) ||
+        QZ_PARAMS != qzGetStatus(&sess, NULL)) {
+        return QZ_FAIL;
+    }
+
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    if (orig_src == NULL || comp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    qzGetDefaults(&params);
+    params.hw_buff_sz = QZ_HW_BUFF_SZ;
+    params.input_sz_thrshold = QZ_COMP_THRESHOLD_DEFAULT;
+    /*full size members, larger than the buffers of the tiny session*/
+    params.adaptive_chunk = 0;
+    /*instances are set up again by the first session after qzClose*/
+    (void)qzClose(&sess);
+    rc = qzInit(&sess, params.sw_backup);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE && rc != QZ_NO_HW) {
+        goto done;
+    }
+    rc = qzSetupSession(&sess, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        goto fail;
+    }
+
+    (void)qzGetStats(&before, NULL, 0);
+    in_sz = src_sz;
+    comp_len = DEST_SZ(src_sz);
+    rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &comp_len, 1);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+    (void)qzGetStats(&after, inst, ARRAY_LEN(inst));
+    if (after.hw_calls + after.sw_calls != before.hw_calls + before.sw_calls + 1 ||
+        after.hw_bytes_in + after.sw_bytes_in !=
+        before.hw_bytes_in + before.sw_bytes_in + src_sz ||
+        after.hw_bytes_out + after.sw_bytes_out !=
+        before.hw_bytes_out + before.sw_bytes_out + comp_len) {
+        QZ_ERROR("ERROR: call not counted\n");
+        goto fail;
+    }
+    for (i = 0; i < after.num_instances && i < ARRAY_LEN(inst); i++) {
+        calls += inst[i].calls;
+        if (inst[i].slots_busy > inst[i].slots) {
+            goto fail;
+        }
+    }
+    if (calls < after.hw_calls - before.hw_calls) {
+        QZ_ERROR("ERROR: instance calls %lu below hw calls\n", calls);
+        goto fail;
+    }
+
+    /*input under the threshold is served by software*/
+    small = after.fallback[QZ_FALLBACK_SMALL];
+    in_sz = QZ_COMP_THRESHOLD_DEFAULT / 2;
+    comp_len = DEST_SZ(src_sz);
+    rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &comp_len, 1);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+    (void)qzGetStats(&after, NULL, 0);
+    if (QZ_OK == g_process.qz_init_status &&
+        after.fallback[QZ_FALLBACK_SMALL] != small + 1) {
+        QZ_ERROR("ERROR: small input fallback not counted\n");
+        goto fail;
+    }
+
+    /*members larger than the buffers of the session go to software*/
+    in_sz = src_sz;
+    comp_len = DEST_SZ(src_sz);
+    rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &comp_len, 1);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+    params.hw_buff_sz = QZ_HW_BUFF_MIN_SZ;
+    rc = qzSetupSession(&tiny, &params);
+    if (rc != QZ_OK && rc != QZ_NO_HW) {
+        goto fail;
+    }
+    unsupported = after.fallback[QZ_FALLBACK_UNSUPPORTED];
+    in_sz = comp_len;
+    out_sz = src_sz;
+    rc = qzDecompress(&tiny, comp_src, &in_sz, orig_src, &out_sz);
+    if (rc != QZ_OK || out_sz != src_sz) {
+        goto fail;
+    }
+    (void)qzGetStats(&after, NULL, 0);
+    if (QZ_OK == g_process.qz_init_status &&
+        after.fallback[QZ_FALLBACK_UNSUPPORTED] <= unsupported) {
+        QZ_ERROR("ERROR: member fallback not counted\n");
+        goto fail;
+    }
+
+    rc = qzGetStatus(&sess, &status);
+    if (rc != QZ_OK || status.algo_sw[QZ_DEFLATE] != 1 ||
+        status.hw_session_status != sess.hw_session_stat ||
+        status.memory_alloced != after.pinned_sz / 1024) {
+        goto fail;
+    }
+    if (QZ_OK == g_process.qz_init_status &&
+        (!status.qat_service_stated || !status.qat_hw_count ||
+         !status.algo_hw[QZ_DEFLATE] || 2 != status.qat_mem_drvr ||
+         !status.qat_instance_attach)) {
+        QZ_ERROR("ERROR: status not filled in\n");
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    (void)qzTeardownSession(&tiny);
+    (void)qzTeardownSession(&sess);
+    return rc;
+}
+
+static void *threadStatsCompress(void *arg)
+{
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    uint8_t *src = (uint8_t *)arg, *comp = NULL;
+    unsigned int in_sz = 4 * QZ_HW_BUFF_SZ, comp_len = DEST_SZ(in_sz);
+    long rc = QZ_FAIL;
+    static uint8_t data[4 * QZ_HW_BUFF_SZ];
+
+    if (NULL == src) {
+        src = data;
+    }
+
+    qzGetDefaults(&params);
+    params.hw_buff_sz = QZ_HW_BUFF_SZ;
+    comp = malloc(comp_len);
+    rc = qzSetupSession(&sess, &params);
+    if (NULL != comp && (QZ_OK == rc || QZ_NO_HW == rc)) {
+        rc = qzCompress(&sess, src, &in_sz, comp, &comp_len, 1);
+    } else {
+        rc = QZ_FAIL;
+    }
+    (void)qzTeardownSession(&sess);
+    free(comp);
+    return (void *)rc;
+}
+
+int qzThreadStatsTest(void)
+{
+    QzThreadStats_T stats[256];
+    unsigned int src_sz = 4 * QZ_HW_BUFF_SZ, cnt, k;
+    unsigned long calls = 0, mine = 0, total = 0;
+    uint8_t *src;
+    pthread_t th;
+    void *ret = NULL;
+
+    cnt = ARRAY_LEN(stats);
+    if (QZ_PARAMS != qzGetThreadStats(NULL, &cnt) ||
+        QZ_PARAMS != qzGetThreadStats(stats, NULL)) {
+        return QZ_FAIL;
+    }
+
+    src = malloc(src_sz);
+    if (NULL == src) {
+        return QZ_FAIL;
+    }
+    genRandomData(src, src_sz);
+
+    (void)qzGetThreadStats(stats, &cnt);
+    for (k = 0; k < cnt; k++) {
+        total += stats[k].comp_hw_calls + stats[k].comp_sw_calls;
+    }
+
+    /*a thread that exits is summed up under thread_id 0*/
+    if (pthread_create(&th, NULL, threadStatsCompress, src) ||
+        pthread_join(th, &ret) || QZ_OK != (long)ret ||
+        QZ_OK != (long)threadStatsCompress(src)) {
+        free(src);
+        return QZ_FAIL;
+    }
+    free(src);
+
+    cnt = ARRAY_LEN(stats);
+    (void)qzGetThreadStats(stats, &cnt);
+    for (k = 0; k < cnt; k++) {
+        calls += stats[k].comp_hw_calls + stats[k].comp_sw_calls;
+        if (stats[k].thread_id == (unsigned long)pthread_self()) {
+            mine = stats[k].comp_hw_calls + stats[k].comp_sw_calls;
+            if (0 == stats[k].hw_nsec + stats[k].sw_nsec ||
+                0 == stats[k].hw_bytes_in + stats[k].sw_bytes_in) {
+                QZ_ERROR("ERROR: thread time or bytes not counted\n");
+                return QZ_FAIL;
+            }
+        }
+    }
+    if (0 == mine || calls != total + 2) {
+        QZ_ERROR("ERROR: thread calls %lu, expected %lu\n", calls, total + 2);
+        return QZ_FAIL;
+    }
+    return QZ_OK;
+}
+
+int qzLatencyTest(void)
+{
+    QzLatency_T lat, hw, sw;
+    unsigned long v;
+    unsigned int k, calls = 16;
+
+    if (QZ_PARAMS != qzGetLatency(QZ_LAT_COMP_HW, QZ_LAT_SZ_MAX, NULL) ||
+        QZ_PARAMS != qzGetLatency(QZ_LAT_OP_MAX, QZ_LAT_SZ_MAX, &lat) ||
+        QZ_PARAMS != qzGetLatency(QZ_LAT_COMP_HW, QZ_LAT_SZ_MAX + 1, &lat)) {
+        return QZ_FAIL;
+    }
+
+    /*a bucket holds its time and is at most 12.5% above it*/
+    for (v = 1; v < (1UL << QZ_LAT_MAX_BITS); v = v * 3 + 1) {
+        if (latValue(latBucket(v)) < v || latValue(latBucket(v)) > v + v / 8 ||
+            latBucket(v) >= QZ_LAT_BUCKETS) {
+            QZ_ERROR("ERROR: %lu ns is in bucket %u up to %lu ns\n",
+                     v, latBucket(v), latValue(latBucket(v)));
+            return QZ_FAIL;
+        }
+    }
+    if (latBucket(~0UL) != QZ_LAT_BUCKETS - 1) {
+        return QZ_FAIL;
+    }
+
+    qzResetLatency();
+    for (k = 0; k < calls; k++) {
+        if (QZ_OK != (long)threadStatsCompress(NULL)) {
+            return QZ_FAIL;
+        }
+    }
+
+    (void)qzGetLatency(QZ_LAT_COMP_HW, QZ_LAT_SZ_1M, &hw);
+    (void)qzGetLatency(QZ_LAT_COMP_SW, QZ_LAT_SZ_1M, &sw);
+    if (hw.count + sw.count != calls) {
+        QZ_ERROR("ERROR: %lu calls recorded instead of %u\n",
+                 hw.count + sw.count, calls);
+        return QZ_FAIL;
+    }
+    lat = hw.count ? hw : sw;
+    if (0 == lat.p50 || lat.p50 > lat.p99 || lat.p99 > lat.p999 ||
+        lat.p999 > lat.max) {
+        QZ_ERROR("ERROR: p50 %lu p99 %lu p999 %lu max %lu\n",
+                 lat.p50, lat.p99, lat.p999, lat.max);
+        return QZ_FAIL;
+    }
+    (void)qzGetLatency(hw.count ? QZ_LAT_COMP_HW : QZ_LAT_COMP_SW,
+                       QZ_LAT_SZ_MAX, &lat);
+    if (lat.count != calls) {
+        return QZ_FAIL;
+    }
+
+    qzResetLatency();
+    (void)qzGetLatency(QZ_LAT_COMP_HW, QZ_LAT_SZ_MAX, &hw);
+    (void)qzGetLatency(QZ_LAT_COMP_SW, QZ_LAT_SZ_MAX, &sw);
+    if (hw.count || sw.count) {
+        return QZ_FAIL;
+    }
+    return QZ_OK;
+}
+
+static int doService(QzDataFormat_T data_fmt)
+{
+    int rc = QZ_FAIL;
+    QzSession_T sess = {0};
+    QzSessionParams_T params;
+    uint8_t *orig_src = NULL, *comp_src = NULL, *decomp_src = NULL;
+    unsigned int src_sz = 3 * 1024 * KB + 17;
+    unsigned int in_sz, out_sz, comp_len;
+    unsigned long crc, dcrc;
+
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    decomp_src = malloc(src_sz);
+    if (orig_src == NULL ||
+        comp_src == NULL ||
+        decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    qzGetDefaults(&params);
+    params.data_fmt = data_fmt;
+    params.service = 1;
+    if ((rc = qzSetupSession(&sess, &params)) != QZ_OK) {
+        QZ_ERROR("ERROR: service session setup returned %d\n", rc);
+        goto fail;
+    }
+
+    in_sz = src_sz;
+    comp_len = DEST_SZ(src_sz);
+    rc = qzCompressCrc(&sess, orig_src, &in_sz, comp_src, &comp_len, 1, &crc);
+    if (rc != QZ_OK || in_sz != src_sz) {
+        QZ_ERROR("ERROR: service compression FAILED: %d\n", rc);
+        goto fail;
+    }
+
+    in_sz = comp_len;
+    out_sz = src_sz;
+    rc = qzDecompressCrc(&sess, comp_src, &in_sz, decomp_src, &out_sz, &dcrc);
+    if (rc != QZ_OK || in_sz != comp_len || out_sz != src_sz ||
+        dcrc != crc || memcmp(orig_src, decomp_src, src_sz)) {
+        QZ_ERROR("ERROR: service decompression FAILED: %d, %u bytes\n",
+                 rc, out_sz);
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    return rc;
+}
+
+/* Calls of sessions qzipd leaves behind go to the process */
+static int doServiceLost(void)
+{
+    int rc = QZ_FAIL, k;
+    QzSession_T sess = {0}, raw = {0};
+    QzSessionParams_T params;
+    uint8_t *orig_src = NULL, *comp_src = NULL, *decomp_src = NULL;
+    unsigned int src_sz = 256 * KB;
+    unsigned int in_sz, out_sz, comp_len;
+
+    orig_src = malloc(src_sz);
+    comp_src = malloc(DEST_SZ(src_sz));
+    decomp_src = malloc(src_sz);
+    if (orig_src == NULL || comp_src == NULL || decomp_src == NULL) {
+        QZ_ERROR("Malloc Memory for testing %s error\n", __func__);
+        goto done;
+    }
+    genRandomData(orig_src, src_sz);
+
+    qzGetDefaults(&params);
+    params.service = 1;
+    params.sw_backup = 1;
+    params.hw_buff_sz = QZ_HW_BUFF_SZ;
+    if (QZ_OK != qzSetupSession(&sess, &params)) {
+        goto fail;
+    }
+    params.data_fmt = QZ_DEFLATE_RAW;
+    if (QZ_OK != qzSetupSession(&raw, &params)) {
+        goto fail;
+    }
+
+    /*a raw stream left open at the daemon is lost with it*/
+    in_sz = src_sz;
+    comp_len = DEST_SZ(src_sz);
+    rc = qzCompress(&raw, orig_src, &in_sz, comp_src, &comp_len, 0);
+    if (rc != QZ_OK) {
+        goto fail;
+    }
+
+    qzSvcStop();
+
+    /*more calls than slots, none of them waits for the daemon for good*/
+    for (k = 0; k < 20; k++) {
+        in_sz = src_sz;
+        comp_len = DEST_SZ(src_sz);
+        rc = qzCompress(&sess, orig_src, &in_sz, comp_src, &comp_len, 1);
+        if (rc != QZ_OK || in_sz != src_sz) {
+            QZ_ERROR("ERROR: compression without qzipd returned %d\n", rc);
+            goto fail;
+        }
+    }
+    in_sz = comp_len;
+    out_sz = src_sz;
+    rc = qzDecompress(&sess, comp_src, &in_sz, decomp_src, &out_sz);
+    if (rc != QZ_OK || out_sz != src_sz || memcmp(orig_src, decomp_src, src_sz)) {
+        QZ_ERROR("ERROR: decompression without qzipd returned %d\n", rc);
+        goto fail;
+    }
+
+    in_sz = src_sz;
+    comp_len = DEST_SZ(src_sz);
+    rc = qzCompress(&raw, orig_src, &in_sz, comp_src, &comp_len, 1);
+    if (rc != QZ_FAIL || in_sz || comp_len) {
+        QZ_ERROR("ERROR: open stream without qzipd returned %d\n", rc);
+        goto fail;
+    }
+    rc = QZ_OK;
+    goto done;
+
+fail:
+    rc = QZ_FAIL;
+done:
+    free(orig_src);
+    free(comp_src);
+    free(decomp_src);
+    (void)qzTeardownSession(&sess);
+    (void)qzTeardownSession(&raw);
+    return rc;
+}
+
+int qzServiceTest(void)
+{
+    QzDataFormat_T fmts[] = {QZ_DEFLATE_GZIP_EXT, QZ_DEFLATE_GZIP,
+                             QZ_DEFLATE_RAW, QZ_DEFLATE_ZLIB
+                            };
+    QzSession_T sess = {0};
+    int f, rc;
+
+    rc = qzInit(&sess, 1);
+    if (rc != QZ_OK && rc != QZ_DUPLICATE && rc != QZ_NO_HW) {
+        return QZ_FAIL;
+    }
+
+    /*serve this process from a few threads of its own*/
+    if (QZ_OK != qzSvcStart(4)) {
+        QZ_PRINT("qzipd is running, skip the service test\n");
+        return QZ_OK;
+    }
+
+    for (f = 0; f < ARRAY_LEN(fmts); f++) {
+        rc = doService(fmts[f]);
+        if (QZ_OK != rc) {
+            break;
+        }
+    }
+
+    /*stops the service*/
+    if (QZ_OK == rc) {
+        rc = doServiceLost();
+    }
+    qzSvcStop();
+    return rc;
+}
+
 int qzFuncTests(void)
 {
     int i = 0;
@@ -2006,6 +4689,7 @@ int qzFuncTests(void)
         qzDecompressStandalone,
         qzDecompressForceSW,
         qzCompressSWL9DecompressHW,
+        qzDecompressParallelStdGzip,
     };
 
     for (i = 0; i < ARRAY_LEN(sw_failover_func_tests); i++) {
@@ -2040,6 +4724,86 @@ int qzFuncTests(void)
         }
     }
     QZ_PRINT("qz_compress_crc_positive test : Passed\n");
+
+    int (*qz_data_format_positive[])(void) = {
+        qzCompressStdGzipMember,
+        qzCompressRawAndZlib,
+        qzCompressZlibAdler,
+        qzCompressIndexTrailer,
+        qzDecompressRangeTest,
+        qzDecompressedLengthTest,
+        qzDecompressCrcTest,
+    };
+
+    for (i = 0; i < ARRAY_LEN(qz_data_format_positive); i++) {
+        if (qz_data_format_positive[i]()) {
+            QZ_ERROR("qz_data_format_positive[%d] : failed\n", i);
+            return -1;
+        }
+    }
+    QZ_PRINT("qz_data_format_positive test : Passed\n");
+
+    int (*qz_compress_strategy_positive[])(void) = {
+        qzCompressIncompressible,
+        qzCompressDictionary,
+        qzCompressCache,
+        qzCompressRsyncable,
+        qzCompressBulk,
+        qzAdaptiveChunkTest,
+    };
+
+    for (i = 0; i < ARRAY_LEN(qz_compress_strategy_positive); i++) {
+        if (qz_compress_strategy_positive[i]()) {
+            QZ_ERROR("qz_compress_strategy_positive[%d] : failed\n", i);
+            return -1;
+        }
+    }
+    QZ_PRINT("qz_compress_strategy_positive test : Passed\n");
+
+    int (*qz_instance_positive[])(void) = {
+        qzInstanceWaitTest,
+        qzDeadlineTest,
+        qzInstanceHealthTest,
+        qzDecompressFaultCrcTest,
+        qzDeviceLoadTest,
+        qzBuffCntTest,
+    };
+
+    for (i = 0; i < ARRAY_LEN(qz_instance_positive); i++) {
+        if (qz_instance_positive[i]()) {
+            QZ_ERROR("qz_instance_positive[%d] : failed\n", i);
+            return -1;
+        }
+    }
+    QZ_PRINT("qz_instance_positive test : Passed\n");
+
+    int (*qz_process_positive[])(void) = {
+        qzServiceTest,
+        qzForkTest,
+        qzWarmupTest,
+    };
+
+    for (i = 0; i < ARRAY_LEN(qz_process_positive); i++) {
+        if (qz_process_positive[i]()) {
+            QZ_ERROR("qz_process_positive[%d] : failed\n", i);
+            return -1;
+        }
+    }
+    QZ_PRINT("qz_process_positive test : Passed\n");
+
+    int (*qz_stats_positive[])(void) = {
+        qzStatsTest,
+        qzThreadStatsTest,
+        qzLatencyTest,
+    };
+
+    for (i = 0; i < ARRAY_LEN(qz_stats_positive); i++) {
+        if (qz_stats_positive[i]()) {
+            QZ_ERROR("qz_stats_positive[%d] : failed\n", i);
+            return -1;
+        }
+    }
+    QZ_PRINT("qz_stats_positive test : Passed\n");
     return 0;
 }
 
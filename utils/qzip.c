@@ -58,7 +58,7 @@ static char const *const g_version_str = "v0.2.3";
 #include <pthread.h>
 #include <qatzipP.h>
 
-/* Estimate maximum data expansion after decompression */
+/* Estimate maximum data expansion after decompression of non QZ streams */
 #define DECOMP_BUFSZ_EXPANSION 5
 
 /* Return codes from qzip */
@@ -84,7 +84,7 @@ static QzSession_T g_sess;
 static QzSessionParams_T g_params_th = {(QzHuffmanHdr_T)0,};
 
 /* Command line options*/
-static char const g_short_opts[] = "A:H:L:C:dhkV";
+static char const g_short_opts[] = "A:H:L:C:dhkRV";
 static const struct option g_long_opts[] = {
     /* { name  has_arg  *flag  val } */
     {"decompress", 0, 0, 'd'}, /* decompress */
@@ -96,6 +96,7 @@ static const struct option g_long_opts[] = {
     {"huffmanhdr", 1, 0, 'H'}, /* set huffman header type */
     {"level",      1, 0, 'L'}, /* set compression level */
     {"chunksz",    1, 0, 'C'}, /* set chunk size */
+    {"rsyncable",  0, 0, 'R'}, /* content defined chunk boundaries */
     { 0, 0, 0, 0 }
 };
 
@@ -123,6 +124,7 @@ static void help(void)
         "  -V, --version     display version number",
         "  -L, --level       set compression level",
         "  -C, --chunksz     set chunk size",
+        "  -R, --rsyncable   make rsync-friendly archive",
         0
     };
     char const *const *p = help_msg;
@@ -247,13 +249,30 @@ static int doProcessBuffer(QzSession_T *sess,
     return ret;
 }
 
+/* Exact output size of the QZ members in src, a guess for other streams */
+static unsigned int decompBufferSize(const unsigned char *src,
+                                     unsigned int src_len)
+{
+    unsigned long out_len = 0;
+    unsigned int members = 0;
+    int rc;
+
+    rc = qzDecompressedLength(src, src_len, &out_len, &members);
+    if ((QZ_OK == rc || QZ_DATA_ERROR == rc) &&
+        out_len > 0 && out_len <= UINT_MAX) {
+        return (unsigned int)out_len;
+    }
+
+    return src_len * DECOMP_BUFSZ_EXPANSION;
+}
+
 void doProcessFile(QzSession_T *sess, const char *src_file_name,
                    const char *dst_file_name, int is_compress)
 {
     int ret = OK;
     struct stat src_file_stat;
     unsigned int src_buffer_size = 0, src_file_size = 0;
-    unsigned int dst_buffer_size = 0, dst_file_size = 0;
+    unsigned int dst_buffer_size = 0, dst_file_size = 0, buf_size = 0;
     unsigned int file_remaining = 0;
     unsigned char *src_buffer = NULL;
     unsigned char *dst_buffer = NULL;
@@ -284,14 +303,14 @@ void doProcessFile(QzSession_T *sess, const char *src_file_name,
     src_buffer_size = (src_file_size > SRC_BUFF_LEN) ? SRC_BUFF_LEN : src_file_size;
     if (is_compress) {
         dst_buffer_size = qzMaxCompressedLength(src_buffer_size);
-    } else { /* decompress */
-        dst_buffer_size = src_buffer_size * DECOMP_BUFSZ_EXPANSION;
     }
 
     src_buffer = malloc(src_buffer_size);
     assert(src_buffer != NULL);
-    dst_buffer = malloc(dst_buffer_size);
-    assert(dst_buffer != NULL);
+    if (is_compress) {
+        dst_buffer = malloc(dst_buffer_size);
+        assert(dst_buffer != NULL);
+    }
     src_file = fopen(src_file_name, "r");
     assert(src_file != NULL);
 
@@ -303,6 +322,17 @@ void doProcessFile(QzSession_T *sess, const char *src_file_name,
         bytes_read = fread(src_buffer, 1, src_buffer_size, src_file);
         QZ_PRINT("Reading input file %s (%u Bytes)\n", src_file_name, bytes_read);
 
+        if (!is_compress) {
+            /* size the output buffer once the input is known */
+            buf_size = decompBufferSize(src_buffer, bytes_read);
+            if (buf_size > dst_buffer_size) {
+                free(dst_buffer);
+                dst_buffer = malloc(buf_size);
+                assert(dst_buffer != NULL);
+                dst_buffer_size = buf_size;
+            }
+        }
+
         ret = doProcessBuffer(sess, src_buffer, &bytes_read, dst_buffer,
                               dst_buffer_size, time_list_head, dst_file,
                               &dst_file_size, is_compress);
@@ -557,6 +587,9 @@ int main(int argc, char **argv)
                 return -1;
             }
             break;
+        case 'R':
+            g_params_th.rsyncable = 1;
+            break;
         default:
             tryHelp();
         }
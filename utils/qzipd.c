@@ -0,0 +1,167 @@
+/***************************************************************************
+ *
+ *   BSD LICENSE
+ *
+ *   Copyright(c) 2007-2017 Intel Corporation. All rights reserved.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***************************************************************************/
+
+
+/* qzipd serves the compression requests of the processes of its user
+ * whose sessions set the service parameter. It owns the QAT instances so
+ * that the clients need neither instances nor pinned buffers, and runs
+ * in the foreground until SIGINT or SIGTERM.
+ */
+
+static char const *const g_license_msg[] = {
+    "Copyright (C) 2017 Intel Corporation.",
+    0
+};
+
+static char const *const g_version_str = "v0.2.3";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <pthread.h>
+#include <qz_utils.h>
+#include <qatzip.h>
+#include <cpa_dc.h>
+#include <qatzipP.h>
+
+/* Return codes from qzipd */
+#define OK      0
+#define ERROR   1
+
+#define THREADS_DEFAULT     8
+
+static char *g_program_name = NULL;
+
+static char const g_short_opts[] = "t:hV";
+
+static const struct option g_long_opts[] = {
+    /* { name  has_arg  *flag  val } */
+    {"threads",    1, 0, 't'}, /* worker threads */
+    {"help",       0, 0, 'h'}, /* give help */
+    {"version",    0, 0, 'V'}, /* display version number */
+    { 0, 0, 0, 0 }
+};
+
+static void help(void)
+{
+    static char const *const help_msg[] = {
+        "Serve the compression requests of the processes of this user.",
+        "",
+        "  -t, --threads N   serve requests with N threads, default 8",
+        "  -h, --help        give this help",
+        "  -V, --version     display version number",
+        0
+    };
+    char const *const *p = help_msg;
+
+    QZ_PRINT("Usage: %s [OPTION]...\n", g_program_name);
+    while (*p) {
+        QZ_PRINT("%s\n", *p++);
+    }
+}
+
+static void version(void)
+{
+    char const *const *p = g_license_msg;
+
+    QZ_PRINT("%s %s\n", g_program_name, g_version_str);
+    while (*p) {
+        QZ_PRINT("%s\n", *p++);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int optc, rc, sig;
+    unsigned int threads = THREADS_DEFAULT;
+    QzSession_T sess = {0};
+    sigset_t set;
+
+    g_program_name = argv[0];
+    while (true) {
+        optc = getopt_long(argc, argv, g_short_opts, g_long_opts, NULL);
+        if (optc < 0) {
+            break;
+        }
+        switch (optc) {
+        case 't':
+            threads = strtoul(optarg, NULL, 0);
+            break;
+        case 'h':
+            help();
+            exit(OK);
+            break;
+        case 'V':
+            version();
+            exit(OK);
+            break;
+        default:
+            QZ_PRINT("Try `%s --help' for more information.\n",
+                     g_program_name);
+            exit(ERROR);
+        }
+    }
+
+    /*the signals are taken by sigwait, every thread inherits the mask*/
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    rc = qzInit(&sess, 1);
+    if (QZ_OK != rc && QZ_NO_HW != rc) {
+        QZ_ERROR("qzInit failed: %d\n", rc);
+        exit(ERROR);
+    }
+    if (QZ_NO_HW == rc) {
+        QZ_PRINT("%s: no QAT device, serving requests in software\n",
+                 g_program_name);
+    }
+
+    rc = qzSvcStart(threads);
+    if (QZ_OK != rc) {
+        QZ_ERROR("Cannot start the service: %d\n", rc);
+        qzClose(&sess);
+        exit(ERROR);
+    }
+
+    (void)sigwait(&set, &sig);
+    qzSvcStop();
+    qzClose(&sess);
+    return OK;
+}